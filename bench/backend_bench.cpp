@@ -0,0 +1,139 @@
+// epoll与io_uring后端的对比：进程内启动服务端，大量连接各自保持若干个在途请求，
+// 依次测量两种后端的吞吐。
+// 用法：backend_bench [连接数=1000] [每连接在途请求数=4] [秒数=5] [服务端线程数=4]
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "rpc_server.h"
+#include "rpc_client.h"
+#include "io_service_pool.h"
+
+int echo(int a) { return a; }
+
+struct bench_result {
+    double qps = 0;
+    double mean_us = 0;
+    uint64_t errors = 0;
+};
+
+// 一条连接上的请求链：每个请求完成后立即发出下一个，保持在途请求数不变
+struct call_chain : std::enable_shared_from_this<call_chain> {
+    rpc_client &client;
+    std::atomic<bool> &stop;
+    std::atomic<uint64_t> &done;
+    std::atomic<uint64_t> &errors;
+    std::atomic<uint64_t> &total_us;
+
+    call_chain(rpc_client &c, std::atomic<bool> &s, std::atomic<uint64_t> &d,
+               std::atomic<uint64_t> &e, std::atomic<uint64_t> &t)
+        : client(c), stop(s), done(d), errors(e), total_us(t) {}
+
+    void next() {
+        if (stop) {
+            return;
+        }
+        auto start = std::chrono::steady_clock::now();
+        client.async_call<int>(
+            "echo",
+            [self = shared_from_this(), start](rpc_future<int> f) {
+                try {
+                    f.get();
+                    self->done.fetch_add(1, std::memory_order_relaxed);
+                    self->total_us.fetch_add(
+                        std::chrono::duration_cast<std::chrono::microseconds>(
+                            std::chrono::steady_clock::now() - start)
+                            .count(),
+                        std::memory_order_relaxed);
+                } catch (const std::exception &) {
+                    self->errors.fetch_add(1, std::memory_order_relaxed);
+                }
+                self->next();
+            },
+            1);
+    }
+};
+
+bench_result run(io_backend backend, unsigned short port, size_t connections,
+                 size_t depth, size_t seconds, size_t server_threads) {
+    rpc_server server(port, server_threads, 3600);
+    server.set_io_backend(backend);
+    server.register_handler("echo", echo);
+    std::thread server_thread([&server] { server.run(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    io_service_pool client_ios(std::max<size_t>(1, std::thread::hardware_concurrency() / 2));
+    std::vector<std::unique_ptr<rpc_client>> clients;
+    for (size_t i = 0; i < connections; ++i) {
+        clients.emplace_back(std::make_unique<rpc_client>(
+            client_ios.get_io_service(), "127.0.0.1", port));
+    }
+    client_ios.start();
+    for (auto &c : clients) {
+        c->connect(3);
+    }
+
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> done{0}, errors{0}, total_us{0};
+    for (auto &c : clients) {
+        auto chain = std::make_shared<call_chain>(*c, stop, done, errors, total_us);
+        for (size_t d = 0; d < depth; ++d) {
+            chain->next();
+        }
+    }
+    // 预热一秒后计数
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    uint64_t done0 = done, us0 = total_us;
+    auto t0 = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    uint64_t n = done - done0, us = total_us - us0;
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    stop = true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    bench_result r;
+    r.qps = n / elapsed;
+    r.mean_us = n ? static_cast<double>(us) / n : 0;
+    r.errors = errors;
+
+    client_ios.stop();
+    client_ios.join();
+    clients.clear();
+    server.stop();
+    server_thread.join();
+    return r;
+}
+
+int main(int argc, char **argv) {
+    size_t connections = argc > 1 ? std::stoul(argv[1]) : 1000;
+    size_t depth = argc > 2 ? std::stoul(argv[2]) : 4;
+    size_t seconds = argc > 3 ? std::stoul(argv[3]) : 5;
+    size_t threads = argc > 4 ? std::stoul(argv[4]) : 4;
+
+    std::cout << "connections=" << connections << " depth=" << depth
+              << " seconds=" << seconds << " server_threads=" << threads
+              << std::endl;
+    struct {
+        const char *name;
+        io_backend backend;
+    } backends[] = {{"epoll", io_backend::epoll}, {"io_uring", io_backend::uring}};
+    unsigned short port = 9700;
+    for (auto &b : backends) {
+        if (b.backend == io_backend::uring) {
+            rpc_server probe(port++, 1);
+            probe.set_io_backend(b.backend);
+            if (probe.get_io_backend() != io_backend::uring) {
+                std::cout << b.name << ": not supported by this kernel" << std::endl;
+                continue;
+            }
+        }
+        auto r = run(b.backend, port++, connections, depth, seconds, threads);
+        std::cout << b.name << ": qps=" << static_cast<uint64_t>(r.qps)
+                  << " mean_latency_us=" << r.mean_us << " errors=" << r.errors
+                  << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,309 @@
+// 编解码与分发的微基准：msgpack_codec的参数打包/解包、结果打包、
+// rpc_server注册后的分发入口(invoker<F>::apply)、function_traits的std::function调用，
+// 以及协议头的编解码。每项报告ns/op和每次操作的内存分配次数及字节数，
+// 用于验证去除这些路径上内存分配的改动。
+// 分配通过替换glibc的malloc系列函数计数，operator new和msgpack的缓冲区都经过它们。
+// 用法：codec_bench [--filter=名称子串] [--min-ms=200] [--format=text|json]
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "rpc_server.h"
+
+static uint64_t g_allocs = 0;      // 分配次数，基准单线程运行
+static uint64_t g_alloc_bytes = 0; // 分配字节数
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t n, size_t size);
+void *__libc_realloc(void *p, size_t size);
+void __libc_free(void *p);
+
+void *malloc(size_t size) {
+    ++g_allocs;
+    g_alloc_bytes += size;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+    ++g_allocs;
+    g_alloc_bytes += n * size;
+    return __libc_calloc(n, size);
+}
+
+// 扩容也计为一次分配
+void *realloc(void *p, size_t size) {
+    ++g_allocs;
+    g_alloc_bytes += size;
+    return __libc_realloc(p, size);
+}
+
+void free(void *p) { __libc_free(p); }
+}
+
+// 阻止编译器优化掉结果
+template <typename T> inline void keep(const T &v) {
+    asm volatile("" : : "g"(&v) : "memory");
+}
+
+struct bench_options {
+    std::string filter;
+    std::string format = "text";
+    uint64_t min_ns = 200 * 1000 * 1000;
+};
+
+struct bench_result {
+    std::string name;
+    uint64_t iterations = 0;
+    double ns = 0;
+    double allocs = 0;
+    double bytes = 0;
+};
+
+class bench_runner {
+  public:
+    explicit bench_runner(const bench_options &o) : options_(o) {}
+
+    // 倍增迭代次数直到一轮的耗时超过min_ns，报告最后一轮
+    template <typename F> void run(const std::string &name, F &&f) {
+        if (!options_.filter.empty() &&
+            name.find(options_.filter) == std::string::npos) {
+            return;
+        }
+        for (int i = 0; i < 1000; ++i) {
+            f();
+        }
+        uint64_t n = 1000;
+        for (;;) {
+            uint64_t allocs = g_allocs, bytes = g_alloc_bytes;
+            auto t0 = std::chrono::steady_clock::now();
+            for (uint64_t i = 0; i < n; ++i) {
+                f();
+            }
+            uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                              std::chrono::steady_clock::now() - t0)
+                              .count();
+            if (ns >= options_.min_ns) {
+                bench_result r;
+                r.name = name;
+                r.iterations = n;
+                r.ns = static_cast<double>(ns) / n;
+                r.allocs = static_cast<double>(g_allocs - allocs) / n;
+                r.bytes = static_cast<double>(g_alloc_bytes - bytes) / n;
+                results_.push_back(r);
+                if (options_.format != "json") {
+                    print(r);
+                }
+                return;
+            }
+            n *= ns > 0 && options_.min_ns / ns < 2 ? 2 : 10;
+        }
+    }
+
+    void report() const {
+        if (options_.format != "json") {
+            return;
+        }
+        std::ostringstream os;
+        os << "[";
+        for (size_t i = 0; i < results_.size(); ++i) {
+            auto &r = results_[i];
+            os << (i ? "," : "") << "{\"name\":\"" << r.name
+               << "\",\"iterations\":" << r.iterations
+               << ",\"ns_per_op\":" << r.ns
+               << ",\"allocs_per_op\":" << r.allocs
+               << ",\"bytes_per_op\":" << r.bytes << "}";
+        }
+        os << "]\n";
+        std::cout << os.str();
+    }
+
+  private:
+    static void print(const bench_result &r) {
+        char line[256];
+        snprintf(line, sizeof(line), "%-60s %10.1f ns/op %8.2f allocs/op %10.1f B/op\n",
+                 r.name.c_str(), r.ns, r.allocs, r.bytes);
+        std::cout << line << std::flush;
+    }
+
+    const bench_options &options_;
+    std::vector<bench_result> results_;
+};
+
+int add(int a, int b) { return a + b; }
+std::string echo(std::string s) { return s; }
+int64_t sum(std::vector<int> v) {
+    int64_t s = 0;
+    for (int x : v) {
+        s += x;
+    }
+    return s;
+}
+void noop() {}
+
+using codec = RPCbufferPack::msgpack_codec;
+
+// rpc_server的分发入口不公开，基准测试经友元取得
+struct rpc_server_bench_access {
+    static const handler_entry *find_handler(const rpc_server &server,
+                                             std::string_view name) {
+        return server.find_handler(name);
+    }
+};
+
+// 一种参数形状：打包、整体解包、以及服务端的按zone解析再转换参数
+template <typename Tuple, typename... Args>
+void bench_shape(bench_runner &b, const std::string &shape, Args... args) {
+    b.run("pack_args " + shape, [&] {
+        auto buf = codec::pack_args(args...);
+        keep(buf);
+    });
+    auto packed = codec::pack_args(args...);
+    b.run("unpack " + shape, [&] {
+        codec c;
+        auto tp = c.unpack<Tuple>(packed.data(), packed.size());
+        keep(tp);
+    });
+    msgpack::zone zone;
+    b.run("unpack_object+params " + shape, [&] {
+        zone.clear();
+        auto obj = codec::unpack_object(zone, packed.data(), packed.size());
+        auto tp = codec::unpack_params<Tuple>(obj.via.array);
+        keep(tp);
+    });
+}
+
+static bool parse_options(int argc, char **argv, bench_options &o) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto eq = arg.find('=');
+        if (arg.compare(0, 2, "--") != 0 || eq == std::string::npos) {
+            return false;
+        }
+        std::string key = arg.substr(2, eq - 2), value = arg.substr(eq + 1);
+        if (key == "filter") {
+            o.filter = value;
+        } else if (key == "format") {
+            o.format = value;
+        } else if (key == "min-ms") {
+            o.min_ns = std::stoull(value) * 1000 * 1000;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    bench_options o;
+    if (!parse_options(argc, argv, o)) {
+        std::cerr << "usage: codec_bench [--filter=SUBSTR] [--min-ms=200]"
+                     " [--format=text|json]\n";
+        return 2;
+    }
+    bench_runner b(o);
+
+    // 参数打包与解包
+    std::string s32(32, 's');
+    std::vector<int> v256(256, 7);
+    std::vector<std::string> v8(8, std::string(16, 'v'));
+    bench_shape<std::tuple<int, int>>(b, "(int,int)", 1, 2);
+    bench_shape<std::tuple<std::string>>(b, "(string32)", s32);
+    bench_shape<std::tuple<std::vector<int>>>(b, "(vector<int>256)", v256);
+    bench_shape<std::tuple<int, std::string, double, std::vector<std::string>>>(
+        b, "(int,string32,double,vector<string16>8)", 42, s32, 3.5, v8);
+
+    // 结果打包
+    std::string s64(64, 'r');
+    b.run("pack_args_str (OK,int)", [&] {
+        auto r = codec::pack_args_str(result_code::OK, 42);
+        keep(r);
+    });
+    b.run("pack_args_str (OK,string64)", [&] {
+        auto r = codec::pack_args_str(result_code::OK, s64);
+        keep(r);
+    });
+    buffer_type reused(codec::init_size);
+    b.run("pack_args_to reused (OK,int)", [&] {
+        reused.clear();
+        codec::pack_args_to(reused, result_code::OK, 42);
+        keep(reused);
+    });
+
+    // 注册后的分发入口：与连接相同，参数已解析为对象数组，结果写入复用的缓冲区
+    rpc_server server(0, 1);
+    auto find_handler = [&server](std::string_view name) {
+        return rpc_server_bench_access::find_handler(server, name);
+    };
+    server.register_handler("add", add);
+    server.register_handler("echo", echo);
+    server.register_handler("sum", sum);
+    server.register_handler("noop", noop);
+    b.run("find_handler by name", [&] {
+        auto *entry = find_handler("echo");
+        keep(entry);
+    });
+    auto dispatch = [&](const std::string &label, const char *name,
+                        const buffer_type &request) {
+        const handler_entry *entry = find_handler(name);
+        msgpack::zone zone;
+        auto obj = codec::unpack_object(zone, request.data(), request.size());
+        msgpack::object_array params = obj.via.array;
+        buffer_type result(codec::init_size);
+        b.run("invoker::apply " + label, [&] {
+            result.clear();
+            entry->sync(params, result);
+            keep(result);
+        });
+        msgpack::zone req_zone;
+        b.run("decode+invoker::apply " + label, [&] {
+            req_zone.clear();
+            auto req =
+                codec::unpack_object(req_zone, request.data(), request.size());
+            result.clear();
+            entry->sync(req.via.array, result);
+            keep(result);
+        });
+    };
+    dispatch("noop()", "noop", codec::pack_args());
+    dispatch("add(int,int)", "add", codec::pack_args(1, 2));
+    dispatch("echo(string32)", "echo", codec::pack_args(s32));
+    dispatch("sum(vector<int>256)", "sum", codec::pack_args(v256));
+
+    // function_traits得到的std::function与直接调用的差别
+    int (*volatile fp)(int, int) = add;
+    meta_util::function_traits<decltype(add)>::stl_function_type fn = add;
+    meta_util::function_traits<decltype(add)>::params_tuple args{1, 2};
+    b.run("call add via function pointer", [&] {
+        int r = fp(1, 2);
+        keep(r);
+    });
+    b.run("call add via function_traits std::function", [&] {
+        int r = fn(1, 2);
+        keep(r);
+    });
+    b.run("call add via std::apply(params_tuple)", [&] {
+        int r = std::apply(fn, args);
+        keep(r);
+    });
+
+    // 协议头
+    char head[HEAD_LEN];
+    rpc_header h{128, 42, request_type::req_res, 7, 100, 0};
+    b.run("encode_header", [&] {
+        encode_header(head, h);
+        keep(head);
+    });
+    encode_header(head, h);
+    b.run("decode_header", [&] {
+        rpc_header d = decode_header(head);
+        keep(d);
+    });
+
+    b.report();
+    return 0;
+}
@@ -0,0 +1,460 @@
+// 端到端的吞吐与延迟基准：进程内启动服务端，客户端经回环地址(或uri指定的传输)压测，
+// 报告QPS及延迟分位数，结果可输出为json供CI比较。
+// 闭环模式：每条连接保持depth个在途请求，完成一个发出一个，延迟从实际发出算起；
+// 开环模式：所有连接合计按rate的固定速率发出请求，不等待应答，延迟从计划发出的时刻算起，
+// 服务端变慢时请求的排队时间计入延迟，避免协同遗漏(coordinated omission)。
+// 用法：rpc_bench [--选项=值 ...]，选项见usage()
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "rpc_server.h"
+#include "rpc_client.h"
+#include "io_service_pool.h"
+
+static uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+/*
+* 延迟直方图
+ 与HdrHistogram相同的对数线性分桶：每个2的幂区间均分为2^(SUB_BITS-1)格，
+ 相对误差不超过1/2^(SUB_BITS-1)，记录为一次数组自增。单线程使用，结束后合并。
+*/
+class latency_histogram {
+  public:
+    static const unsigned SUB_BITS = 8;  // 相对误差<0.8%
+    static const unsigned MAX_BITS = 40; // 可记录的最大值约1100秒(纳秒)
+
+    latency_histogram() : counts_(index((uint64_t(1) << MAX_BITS) - 1) + 1) {}
+
+    void record(uint64_t ns) {
+        ns = std::min(ns, (uint64_t(1) << MAX_BITS) - 1);
+        ++counts_[index(ns)];
+        ++total_;
+        sum_ += ns;
+        min_ = std::min(min_, ns);
+        max_ = std::max(max_, ns);
+    }
+
+    void merge(const latency_histogram &other) {
+        for (size_t i = 0; i < counts_.size(); ++i) {
+            counts_[i] += other.counts_[i];
+        }
+        total_ += other.total_;
+        sum_ += other.sum_;
+        min_ = std::min(min_, other.min_);
+        max_ = std::max(max_, other.max_);
+    }
+
+    uint64_t count() const { return total_; }
+    uint64_t min() const { return total_ ? min_ : 0; }
+    uint64_t max() const { return max_; }
+    double mean() const { return total_ ? static_cast<double>(sum_) / total_ : 0; }
+
+    // 不小于p%的记录值的最小值，取所在格的上界
+    uint64_t percentile(double p) const {
+        if (total_ == 0) {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(std::ceil(p / 100.0 * total_));
+        rank = std::max<uint64_t>(rank, 1);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts_.size(); ++i) {
+            seen += counts_[i];
+            if (seen >= rank) {
+                return std::min(highest_equivalent(i), max_);
+            }
+        }
+        return max_;
+    }
+
+  private:
+    static const uint64_t HALF = uint64_t(1) << (SUB_BITS - 1);
+
+    static size_t index(uint64_t v) {
+        unsigned msb = 63 - __builtin_clzll(v | 1);
+        unsigned bucket = msb < SUB_BITS ? 0 : msb - (SUB_BITS - 1);
+        return static_cast<size_t>(bucket * HALF + (v >> bucket));
+    }
+
+    static uint64_t highest_equivalent(size_t i) {
+        if (i < 2 * HALF) {
+            return i;
+        }
+        unsigned bucket = static_cast<unsigned>((i >> (SUB_BITS - 1)) - 1);
+        uint64_t sub = i - bucket * HALF;
+        return ((sub + 1) << bucket) - 1;
+    }
+
+    std::vector<uint64_t> counts_;
+    uint64_t total_ = 0;
+    uint64_t sum_ = 0;
+    uint64_t min_ = UINT64_MAX;
+    uint64_t max_ = 0;
+};
+
+struct bench_options {
+    std::string endpoint = "tcp://127.0.0.1:9800";
+    std::string mode = "closed"; // closed或open
+    std::string backend = "epoll";
+    std::string format = "text"; // text或json
+    std::string out;             // 结果写入的文件，默认标准输出
+    size_t server_threads = 2;
+    size_t handler_threads = 0; // 处理函数线程池，0表示在io线程执行
+    size_t client_threads = 2;
+    size_t connections = 16;
+    size_t depth = 8;   // 闭环模式每条连接的在途请求数
+    double rate = 0;    // 开环模式的总请求速率(次/秒)
+    size_t payload = 64; // 请求和应答的数据字节数
+    bool no_delay = true; // tcp连接设置TCP_NODELAY
+    double work_us = 0;  // 处理函数的计算开销(微秒)
+    double seconds = 10;
+    double warmup = 2;
+};
+
+static void usage() {
+    std::cerr
+        << "usage: rpc_bench [--option=value ...]\n"
+           "  --endpoint=URI         tcp://host:port, unix:///path or shm://name"
+           " (tcp://127.0.0.1:9800)\n"
+           "  --mode=closed|open     closed loop keeps depth calls in flight;"
+           " open loop sends at a fixed rate (closed)\n"
+           "  --rate=N               open loop: total calls per second\n"
+           "  --connections=N        client connections (16)\n"
+           "  --depth=N              closed loop: calls in flight per connection (8)\n"
+           "  --payload=BYTES        request and response payload size (64)\n"
+           "  --work-us=US           handler busy time per call (0)\n"
+           "  --server-threads=N     server io threads (2)\n"
+           "  --handler-threads=N    offload handlers to a pool of N threads (0)\n"
+           "  --client-threads=N     client io threads (2)\n"
+           "  --backend=epoll|uring  server io backend (epoll)\n"
+           "  --no-delay=0|1         set TCP_NODELAY on tcp connections (1)\n"
+           "  --seconds=S            measured duration (10)\n"
+           "  --warmup=S             warmup before measuring (2)\n"
+           "  --format=text|json     result format (text)\n"
+           "  --out=PATH             write the result to PATH instead of stdout\n";
+}
+
+static bool parse_options(int argc, char **argv, bench_options &o) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto eq = arg.find('=');
+        if (arg.compare(0, 2, "--") != 0 || eq == std::string::npos) {
+            return false;
+        }
+        std::string key = arg.substr(2, eq - 2), value = arg.substr(eq + 1);
+        try {
+            if (key == "endpoint") o.endpoint = value;
+            else if (key == "mode") o.mode = value;
+            else if (key == "backend") o.backend = value;
+            else if (key == "format") o.format = value;
+            else if (key == "out") o.out = value;
+            else if (key == "server-threads") o.server_threads = std::stoul(value);
+            else if (key == "handler-threads") o.handler_threads = std::stoul(value);
+            else if (key == "client-threads") o.client_threads = std::stoul(value);
+            else if (key == "connections") o.connections = std::stoul(value);
+            else if (key == "depth") o.depth = std::stoul(value);
+            else if (key == "rate") o.rate = std::stod(value);
+            else if (key == "payload") o.payload = std::stoul(value);
+            else if (key == "no-delay") o.no_delay = std::stoul(value) != 0;
+            else if (key == "work-us") o.work_us = std::stod(value);
+            else if (key == "seconds") o.seconds = std::stod(value);
+            else if (key == "warmup") o.warmup = std::stod(value);
+            else return false;
+        } catch (const std::exception &) {
+            return false;
+        }
+    }
+    if (o.mode != "closed" && o.mode != "open") {
+        return false;
+    }
+    if (o.mode == "open" && o.rate <= 0) {
+        std::cerr << "open loop mode needs --rate" << std::endl;
+        return false;
+    }
+    return o.connections > 0 && o.client_threads > 0 && o.server_threads > 0 &&
+           o.seconds > 0 && (o.mode == "open" || o.depth > 0);
+}
+
+// 处理函数：空转work_ns模拟计算开销，原样返回数据
+std::string work(std::string payload, uint64_t work_ns) {
+    if (work_ns > 0) {
+        uint64_t end = now_ns() + work_ns;
+        while (now_ns() < end) {
+        }
+    }
+    return payload;
+}
+
+// 每个客户端io线程一份，只在该线程上访问；计数另供主线程读取
+struct alignas(64) thread_stats {
+    latency_histogram hist;
+    uint64_t done = 0;   // 计划发出时刻在测量区间内且完成的请求
+    uint64_t errors = 0; // 测量区间内失败的请求
+    uint64_t sent = 0;   // 计划发出时刻在测量区间内的请求
+    std::atomic<int64_t> outstanding{0};
+};
+
+struct bench_window {
+    uint64_t start_ns; // 测量区间，请求按计划发出的时刻归入
+    uint64_t end_ns;
+    std::atomic<bool> stop{false};
+};
+
+// 一条连接上的负载：闭环时每完成一个请求立即发出下一个，开环时按定时器发出
+struct connection_load : std::enable_shared_from_this<connection_load> {
+    rpc_client &client;
+    thread_stats &stats;
+    bench_window &window;
+    const std::string &payload;
+    uint64_t work_ns;
+    boost::asio::steady_timer timer;
+    uint64_t interval_ns = 0; // 开环模式相邻请求的间隔
+    uint64_t next_ns = 0;     // 开环模式下一个请求的计划发出时刻
+
+    connection_load(rpc_client &c, boost::asio::io_service &ios,
+                    thread_stats &s, bench_window &w, const std::string &p,
+                    uint64_t work)
+        : client(c), stats(s), window(w), payload(p), work_ns(work),
+          timer(ios) {}
+
+    // 发出一个请求，延迟从start计起；完成后按需调用then
+    template <typename Then> void send(uint64_t start, Then then) {
+        bool measured = start >= window.start_ns && start < window.end_ns;
+        if (measured) {
+            ++stats.sent;
+        }
+        stats.outstanding.fetch_add(1, std::memory_order_relaxed);
+        client.async_call<std::string>(
+            rpc_method::by_id("work"),
+            [self = shared_from_this(), start, measured,
+             then](rpc_future<std::string> f) {
+                auto &stats = self->stats;
+                try {
+                    f.get();
+                    if (measured) {
+                        stats.hist.record(now_ns() - start);
+                        ++stats.done;
+                    }
+                } catch (const std::exception &) {
+                    if (measured) {
+                        ++stats.errors;
+                    }
+                }
+                stats.outstanding.fetch_sub(1, std::memory_order_relaxed);
+                then(*self);
+            },
+            payload, work_ns);
+    }
+
+    void closed_loop() {
+        if (window.stop) {
+            return;
+        }
+        send(now_ns(), [](connection_load &self) { self.closed_loop(); });
+    }
+
+    void open_loop() {
+        if (window.stop) {
+            return;
+        }
+        // 定时器迟到时补发所有已到计划时刻的请求，延迟仍从各自的计划时刻算起
+        uint64_t now = now_ns();
+        while (next_ns <= now) {
+            send(next_ns, [](connection_load &) {});
+            next_ns += interval_ns;
+        }
+        timer.expires_at(std::chrono::steady_clock::time_point(
+            std::chrono::nanoseconds(next_ns)));
+        timer.async_wait([self = shared_from_this()](
+                             const boost::system::error_code &ec) {
+            if (!ec) {
+                self->open_loop();
+            }
+        });
+    }
+};
+
+struct bench_result {
+    latency_histogram hist;
+    uint64_t sent = 0;
+    uint64_t done = 0;
+    uint64_t errors = 0;
+    int64_t incomplete = 0; // 结束时仍未完成的请求
+    double seconds = 0;
+};
+
+static bench_result run(const bench_options &o) {
+    endpoint_uri endpoint = endpoint_uri::parse(o.endpoint);
+    rpc_server server(endpoint, o.server_threads, 15, 10);
+    server.set_io_backend(o.backend == "uring" ? io_backend::uring
+                                               : io_backend::epoll);
+    server.set_no_delay(o.no_delay);
+    if (o.handler_threads > 0) {
+        server.set_handler_pool(o.handler_threads);
+        server.register_handler("work", work, exec_policy::offload);
+    } else {
+        server.register_handler("work", work);
+    }
+    std::thread server_thread([&server] { server.run(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    io_service_pool client_ios(o.client_threads);
+    std::vector<std::unique_ptr<rpc_client>> clients;
+    for (size_t i = 0; i < o.connections; ++i) {
+        clients.emplace_back(std::make_unique<rpc_client>(
+            client_ios.get_io_service(i % o.client_threads), endpoint));
+        clients.back()->set_no_delay(o.no_delay);
+    }
+    client_ios.start();
+    for (auto &c : clients) {
+        if (!c->connect(3)) {
+            throw std::runtime_error("connect to " + o.endpoint + " failed");
+        }
+    }
+
+    std::vector<std::unique_ptr<thread_stats>> stats;
+    for (size_t i = 0; i < o.client_threads; ++i) {
+        stats.emplace_back(std::make_unique<thread_stats>());
+    }
+    bench_window window;
+    uint64_t begin = now_ns();
+    window.start_ns = begin + static_cast<uint64_t>(o.warmup * 1e9);
+    window.end_ns = window.start_ns + static_cast<uint64_t>(o.seconds * 1e9);
+
+    std::string payload(o.payload, 'x');
+    uint64_t work_ns = static_cast<uint64_t>(o.work_us * 1000);
+    bool open = o.mode == "open";
+    for (size_t i = 0; i < o.connections; ++i) {
+        auto &ios = client_ios.get_io_service(i % o.client_threads);
+        auto load = std::make_shared<connection_load>(
+            *clients[i], ios, *stats[i % o.client_threads], window, payload,
+            work_ns);
+        if (open) {
+            // 各连接的发送时刻错开，合计为均匀的总速率
+            double interval = 1e9 * o.connections / o.rate;
+            load->interval_ns = std::max<uint64_t>(1, static_cast<uint64_t>(interval));
+            load->next_ns = begin + static_cast<uint64_t>(interval * i / o.connections);
+        }
+        // 在连接所属的io线程上发出，统计只在该线程访问
+        boost::asio::post(ios, [load, open, depth = o.depth] {
+            if (open) {
+                load->open_loop();
+            } else {
+                for (size_t d = 0; d < depth; ++d) {
+                    load->closed_loop();
+                }
+            }
+        });
+    }
+
+    std::this_thread::sleep_for(std::chrono::nanoseconds(window.end_ns - now_ns()));
+    window.stop = true;
+    // 等待测量区间内发出的请求完成
+    auto drain_until = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    auto outstanding = [&stats] {
+        int64_t n = 0;
+        for (auto &s : stats) {
+            n += s->outstanding.load(std::memory_order_relaxed);
+        }
+        return n;
+    };
+    while (outstanding() > 0 && std::chrono::steady_clock::now() < drain_until) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    bench_result r;
+    r.incomplete = outstanding();
+    client_ios.stop();
+    client_ios.join();
+    for (auto &s : stats) {
+        r.hist.merge(s->hist);
+        r.sent += s->sent;
+        r.done += s->done;
+        r.errors += s->errors;
+    }
+    r.seconds = o.seconds;
+    clients.clear();
+    server.stop();
+    server_thread.join();
+    return r;
+}
+
+static std::string report(const bench_options &o, const bench_result &r) {
+    auto us = [](uint64_t ns) { return ns / 1000.0; };
+    const auto &h = r.hist;
+    std::ostringstream os;
+    os.setf(std::ios::fixed);
+    os.precision(1);
+    if (o.format == "json") {
+        os << "{\"mode\":\"" << o.mode << "\",\"endpoint\":\"" << o.endpoint
+           << "\",\"backend\":\"" << o.backend
+           << "\",\"server_threads\":" << o.server_threads
+           << ",\"handler_threads\":" << o.handler_threads
+           << ",\"client_threads\":" << o.client_threads
+           << ",\"connections\":" << o.connections << ",\"depth\":" << o.depth
+           << ",\"rate\":" << o.rate << ",\"payload\":" << o.payload
+           << ",\"no_delay\":" << (o.no_delay ? "true" : "false")
+           << ",\"work_us\":" << o.work_us << ",\"seconds\":" << r.seconds
+           << ",\"sent\":" << r.sent << ",\"completed\":" << r.done
+           << ",\"errors\":" << r.errors << ",\"incomplete\":" << r.incomplete
+           << ",\"qps\":" << r.done / r.seconds << ",\"latency_us\":{\"min\":"
+           << us(h.min()) << ",\"mean\":" << h.mean() / 1000.0
+           << ",\"p50\":" << us(h.percentile(50))
+           << ",\"p90\":" << us(h.percentile(90))
+           << ",\"p99\":" << us(h.percentile(99))
+           << ",\"p999\":" << us(h.percentile(99.9))
+           << ",\"max\":" << us(h.max()) << "}}\n";
+    } else {
+        os << "mode=" << o.mode << " endpoint=" << o.endpoint
+           << " backend=" << o.backend << " connections=" << o.connections;
+        if (o.mode == "open") {
+            os << " rate=" << o.rate;
+        } else {
+            os << " depth=" << o.depth;
+        }
+        os << " payload=" << o.payload << " work_us=" << o.work_us << "\n"
+           << "qps:        " << r.done / r.seconds << "\n"
+           << "completed:  " << r.done << " of " << r.sent
+           << " (errors " << r.errors << ", incomplete " << r.incomplete << ")\n"
+           << "latency us: min " << us(h.min()) << "  mean " << h.mean() / 1000.0
+           << "  p50 " << us(h.percentile(50)) << "  p90 " << us(h.percentile(90))
+           << "  p99 " << us(h.percentile(99)) << "  p999 "
+           << us(h.percentile(99.9)) << "  max " << us(h.max()) << "\n";
+    }
+    return os.str();
+}
+
+int main(int argc, char **argv) {
+    bench_options o;
+    if (!parse_options(argc, argv, o)) {
+        usage();
+        return 2;
+    }
+    bench_result r;
+    try {
+        r = run(o);
+    } catch (const std::exception &e) {
+        std::cerr << "rpc_bench: " << e.what() << std::endl;
+        return 1;
+    }
+    std::string text = report(o, r);
+    if (o.out.empty()) {
+        // 连接的日志在标准错误，标准输出只有结果
+        std::cout << text << std::flush;
+    } else {
+        std::ofstream(o.out) << text;
+    }
+    return r.errors == 0 && r.incomplete == 0 ? 0 : 1;
+}
@@ -0,0 +1,73 @@
+#pragma once
+#ifndef TINY_RPC_BUFFER_POOL_H_
+#define TINY_RPC_BUFFER_POOL_H_
+
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <boost/asio.hpp>
+#include "codec.h"
+
+/*
+* 发送缓冲区池
+ 结果直接打包进池中的缓冲区，发送完成后缓冲区清空并归还，
+ 稳定运行时小消息的应答不再分配内存。多线程安全，由server和所有connection共享。
+*/
+class buffer_pool : public std::enable_shared_from_this<buffer_pool>,
+                    private boost::asio::noncopyable {
+  public:
+    // 析构时把缓冲区归还到池中
+    struct recycler {
+        std::shared_ptr<buffer_pool> pool;
+        void operator()(buffer_type *buf) const { pool->release(buf); }
+    };
+    using buffer_ptr = std::unique_ptr<buffer_type, recycler>;
+
+    // max_cached：最多缓存的缓冲区个数；max_keep_bytes：超过该大小的缓冲区不缓存
+    explicit buffer_pool(size_t max_cached = 1024,
+                         size_t max_keep_bytes = 64 * 1024)
+        : max_cached_(max_cached), max_keep_bytes_(max_keep_bytes) {}
+
+    ~buffer_pool() {
+        for (auto *buf : free_) {
+            delete buf;
+        }
+    }
+
+    // 取出一个空的缓冲区
+    buffer_ptr acquire() {
+        buffer_type *buf = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            if (!free_.empty()) {
+                buf = free_.back();
+                free_.pop_back();
+            }
+        }
+        if (buf == nullptr) {
+            buf = new buffer_type(RPCbufferPack::msgpack_codec::init_size);
+        }
+        return buffer_ptr(buf, recycler{shared_from_this()});
+    }
+
+  private:
+    void release(buffer_type *buf) {
+        // 大缓冲区直接释放，避免长期占用内存
+        if (buf->size() <= max_keep_bytes_) {
+            buf->clear();
+            std::unique_lock<std::mutex> lock(mtx_);
+            if (free_.size() < max_cached_) {
+                free_.push_back(buf);
+                return;
+            }
+        }
+        delete buf;
+    }
+
+    std::mutex mtx_;
+    std::vector<buffer_type *> free_;
+    size_t max_cached_;
+    size_t max_keep_bytes_;
+};
+
+#endif
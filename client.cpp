@@ -26,7 +26,7 @@
 //	cout << "GreetFun = :" << ret << endl;
 //	cout << "calcFun = :" << ans << endl;
 //
-//	std::string aaaa = asy_->get();
+//	std::string aaaa = asy_.get();
 //	cout << "GreetFun_async = :" << aaaa << endl;
 //
 //	printf("===========================\n");
@@ -90,6 +90,7 @@
 // }
 
 /*示例3*/
+#include <chrono>
 #include <iostream>
 #include <thread>
 #include "rpc_client.h"
@@ -98,7 +99,7 @@ using namespace std;
 
 // 封装客户端逻辑的函数
 void clientFunction(std::string name, int a, int b) {
-    Sleep((a - 2) * 1000);
+    std::this_thread::sleep_for(std::chrono::seconds(a - 2));
     rpc_client client("127.0.0.1", 9000); // IP 地址，端口号
     std::cout << "Address of rpc_client instance: " << &client << std::endl;
     bool has_connected = client.connect(5);
@@ -3,6 +3,15 @@
 #define TINY_RPC_CODEC_H_
 
 #include <msgpack.hpp>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 using buffer_type = msgpack::sbuffer;
 
@@ -32,6 +41,15 @@ struct msgpack_codec {
         return std::string(buffer.data(), buffer.size());
     }
 
+    // 打包枚举类型到调用方提供的缓冲区，缓冲区可复用，避免每次分配
+    template <
+        typename Arg, typename... Args,
+        typename = typename std::enable_if<std::is_enum<Arg>::value>::type>
+    static void pack_args_to(buffer_type &buffer, Arg arg, Args &&...args) {
+        msgpack::pack(buffer, std::forward_as_tuple(
+                                  (int)arg, std::forward<Args>(args)...));
+    }
+
     // 打包单个参数
     template <typename T> buffer_type pack(T &&t) const {
         buffer_type buffer;
@@ -49,10 +67,306 @@ struct msgpack_codec {
         }
     }
 
+    // 解析到调用方提供的zone中，字符串和二进制直接引用原始数据不做拷贝，
+    // 返回的对象在zone清空且原始数据释放前有效
+    static msgpack::object unpack_object(msgpack::zone &zone, char const *data,
+                                         size_t length) {
+        try {
+            return msgpack::unpack(zone, data, length, &reference_all);
+        } catch (...) {
+            throw std::invalid_argument("unpack failed: invalid request!");
+        }
+    }
+
+    // 从已解析的参数数组(不含函数名)转换参数
+    template <typename Tuple>
+    static Tuple unpack_params(const msgpack::object_array &params) {
+        if (params.size != std::tuple_size<Tuple>::value) {
+            throw std::invalid_argument("unpack failed: Args not match!");
+        }
+        try {
+            return convert_params<Tuple>(
+                params.ptr,
+                std::make_index_sequence<std::tuple_size<Tuple>::value>{});
+        } catch (...) {
+            throw std::invalid_argument("unpack failed: Args not match!");
+        }
+    }
+
+  private:
+    static bool reference_all(msgpack::type::object_type, size_t, void *) {
+        return true;
+    }
+
+    template <typename Tuple, size_t... Indices>
+    static Tuple convert_params(const msgpack::object *objs,
+                                std::index_sequence<Indices...>) {
+        return Tuple{objs[Indices].as<std::tuple_element_t<Indices, Tuple>>()...};
+    }
+
   private:
     msgpack::unpacked msg_;
 };
 
+/*
+* 标明结构体、枚举等类型可以平坦编码，即任意字节内容都是合法的值且不含指针：
+ template <> struct RPCbufferPack::flat_type<sample> : std::true_type {};
+ 默认只有除bool外的算术类型及其序列可以平坦编码，其他类型需由使用方逐个标明。
+*/
+template <typename T> struct flat_type : std::false_type {};
+
+/*
+* 标明类型没有msgpack的适配，只能平坦编码，例如未用MSGPACK_DEFINE的结构体：
+ template <> struct RPCbufferPack::flat_only_type<point> : std::true_type {};
+ 同时表示该类型可以平坦编码，无需再特化flat_type。参数或返回类型含有这样的类型时，
+ 服务端只登记平坦编码的处理，客户端总是使用平坦编码。
+*/
+template <typename T> struct flat_only_type : std::false_type {};
+
+/*
+* 平坦编码
+ 参数和返回值都是可平坦编码的值或其连续序列(std::vector、std::basic_string、std::array)时，
+ 按内存布局直接memcpy，不逐个元素编解码。可平坦编码的值是除bool外的算术类型，
+ 以及由flat_type或flat_only_type标明的可平凡拷贝的类型；服务端直接把网络上的字节
+ 拷入这些类型，因此不自动接受bool、枚举和任意结构体。要求两端为相同的类型和字节序，
+ 由类型签名在调用时校验：标明的类型以其类型名和大小参与签名，不同的类型互不接受。
+ 是否可用在编译期由参数和返回类型决定。
+ 请求体：[函数名长度u32][函数名][类型签名u32][参数...]，按id调用时函数名为空；
+ 应答体：[状态码u8][返回值]，失败时为[状态码u8][长度u32][错误信息]；
+ 序列编码为[元素个数u32][元素...]，其他类型按sizeof原样写入。
+*/
+struct flat_codec {
+    // 由使用方标明可平坦编码的类型
+    template <typename T>
+    struct is_tagged
+        : std::bool_constant<(flat_type<T>::value ||
+                              flat_only_type<T>::value) &&
+                             std::is_trivially_copyable_v<T>> {};
+
+    // 可按内存布局直接拷贝的单个值：任意字节内容都合法的算术类型，或标明的类型
+    template <typename T>
+    struct is_flat_scalar
+        : std::bool_constant<(std::is_arithmetic_v<T> &&
+                              !std::is_same_v<T, bool>) ||
+                             is_tagged<T>::value> {};
+    template <typename T, size_t N>
+    struct is_flat_scalar<std::array<T, N>> : is_flat_scalar<T> {};
+
+    template <typename T> struct is_sequence : std::false_type {};
+    template <typename T, typename A>
+    struct is_sequence<std::vector<T, A>> : is_flat_scalar<T> {};
+    template <typename A>
+    struct is_sequence<std::vector<bool, A>> : std::false_type {};
+    template <typename C, typename Tr, typename A>
+    struct is_sequence<std::basic_string<C, Tr, A>> : is_flat_scalar<C> {};
+
+    template <typename T>
+    struct is_flat
+        : std::bool_constant<is_sequence<T>::value || is_flat_scalar<T>::value> {};
+    // string_view等视图可平凡拷贝，但只携带指针
+    template <typename C, typename Tr>
+    struct is_flat<std::basic_string_view<C, Tr>> : std::false_type {};
+
+    // 是否只能平坦编码：默认所有类型都可以按msgpack编解码(内置类型、MSGPACK_ADD_ENUM的枚举、
+    // MSGPACK_DEFINE或非侵入式适配的结构体等)；没有msgpack适配的类型由使用方特化flat_only_type标明
+    template <typename T>
+    struct is_flat_only : flat_only_type<std::remove_cv_t<T>> {};
+    template <typename T, typename A>
+    struct is_flat_only<std::vector<T, A>> : is_flat_only<T> {};
+    template <typename T, size_t N>
+    struct is_flat_only<std::array<T, N>> : is_flat_only<T> {};
+
+  private:
+    static constexpr uint32_t mix(uint32_t h, uint32_t v) {
+        return (h ^ v) * 16777619u;
+    }
+
+    // 类型名的散列，取自包含模板实参的__PRETTY_FUNCTION__，不同的类型得到不同的值
+    template <typename T> static constexpr uint32_t type_name_code() {
+        std::string_view name = __PRETTY_FUNCTION__;
+        uint32_t h = 2166136261u;
+        for (char c : name) {
+            h = mix(h, static_cast<unsigned char>(c));
+        }
+        return h;
+    }
+
+    // 类型编码：算术类型为种类和大小，序列和数组再加上元素的编码，
+    // 标明的类型为类型名和大小
+    template <typename T> static constexpr uint32_t type_code() {
+        if constexpr (std::is_void_v<T>) {
+            return mix(2166136261u, '0');
+        } else if constexpr (is_sequence<T>::value) {
+            return mix(mix(2166136261u, 'v'),
+                       type_code<typename T::value_type>());
+        } else if constexpr (is_tagged<T>::value) {
+            return mix(mix(mix(2166136261u, 's'), type_name_code<T>()),
+                       sizeof(T));
+        } else if constexpr (std::is_arithmetic_v<T>) {
+            uint32_t kind = std::is_floating_point_v<T> ? 'f'
+                            : std::is_signed_v<T>        ? 'i'
+                                                         : 'u';
+            return mix(mix(2166136261u, kind), sizeof(T));
+        } else {
+            // std::array
+            return mix(mix(mix(2166136261u, 'a'), std::tuple_size<T>::value),
+                       type_code<typename T::value_type>());
+        }
+    }
+
+    template <typename Ret, typename... Args>
+    static constexpr uint32_t signature_of() {
+        uint32_t h = mix(2166136261u, type_code<Ret>());
+        ((h = mix(h, type_code<Args>())), ...);
+        return mix(h, sizeof...(Args));
+    }
+
+  public:
+    // 返回类型和参数元组的编码信息：是否可平坦编码，及类型签名
+    template <typename Ret, typename Tuple> struct layout;
+    template <typename Ret, typename... Args>
+    struct layout<Ret, std::tuple<Args...>> {
+        static constexpr bool supported =
+            (std::is_void_v<Ret> || is_flat<Ret>::value) &&
+            (is_flat<Args>::value && ...);
+        static constexpr uint32_t signature =
+            signature_of<Ret, Args...>();
+        // 有类型只能平坦编码时(见flat_only_type)，不生成msgpack的编解码
+        static constexpr bool flat_only =
+            supported && (is_flat_only<Ret>::value ||
+                          (is_flat_only<Args>::value || ...));
+    };
+
+    // 打包请求：函数名为空表示按id调用
+    template <typename... Args>
+    static void pack_request(buffer_type &buffer, std::string_view name,
+                             uint32_t signature, const Args &...args) {
+        put_u32(buffer, static_cast<uint32_t>(name.size()));
+        buffer.write(name.data(), name.size());
+        put_u32(buffer, signature);
+        (pack_value(buffer, args), ...);
+    }
+
+    // 解析请求头部，args指向参数区，不拷贝数据
+    static bool parse_request(const char *data, size_t size,
+                              std::string_view &name, uint32_t &signature,
+                              const char *&args, size_t &args_len) {
+        const char *p = data;
+        const char *end = data + size;
+        uint32_t name_len = 0;
+        if (!get_u32(p, end, name_len) ||
+            static_cast<size_t>(end - p) < name_len) {
+            return false;
+        }
+        name = std::string_view(p, name_len);
+        p += name_len;
+        if (!get_u32(p, end, signature)) {
+            return false;
+        }
+        args = p;
+        args_len = static_cast<size_t>(end - p);
+        return true;
+    }
+
+    // 从参数区拷出参数，长度不符时抛出异常
+    template <typename Tuple>
+    static Tuple unpack_args(const char *data, size_t size) {
+        Tuple tp;
+        const char *p = data;
+        const char *end = data + size;
+        bool ok = std::apply(
+            [&](auto &...xs) { return (unpack_value(p, end, xs) && ...); }, tp);
+        if (!ok || p != end) {
+            throw std::invalid_argument("unpack failed: Args not match!");
+        }
+        return tp;
+    }
+
+    // 打包应答：状态码，以及可选的返回值
+    template <typename Code, typename... T>
+    static void pack_result(buffer_type &buffer, Code code, const T &...value) {
+        static_assert(sizeof...(T) <= 1, "at most one result value");
+        uint8_t c = static_cast<uint8_t>(code);
+        buffer.write(reinterpret_cast<const char *>(&c), 1);
+        (pack_value(buffer, value), ...);
+    }
+
+    template <typename Code>
+    static void pack_error(buffer_type &buffer, Code code,
+                           const std::string &error) {
+        pack_result(buffer, code, error);
+    }
+
+    // 解包应答，返回状态码；成功时取出返回值，否则取出错误信息
+    template <typename T>
+    static uint8_t unpack_result(const char *data, size_t size, T &value,
+                                 std::string &error) {
+        if (size == 0) {
+            throw std::invalid_argument("unpack failed: empty response!");
+        }
+        uint8_t code = static_cast<uint8_t>(data[0]);
+        const char *p = data + 1;
+        const char *end = data + size;
+        bool ok = code == 0 ? unpack_value(p, end, value)
+                            : unpack_value(p, end, error);
+        if (!ok || p != end) {
+            throw std::invalid_argument("unpack failed: result not match!");
+        }
+        return code;
+    }
+
+  private:
+    static void put_u32(buffer_type &buffer, uint32_t v) {
+        buffer.write(reinterpret_cast<const char *>(&v), 4);
+    }
+
+    static bool get_u32(const char *&p, const char *end, uint32_t &v) {
+        if (end - p < 4) {
+            return false;
+        }
+        memcpy(&v, p, 4);
+        p += 4;
+        return true;
+    }
+
+    template <typename T>
+    static void pack_value(buffer_type &buffer, const T &v) {
+        if constexpr (is_sequence<T>::value) {
+            put_u32(buffer, static_cast<uint32_t>(v.size()));
+            buffer.write(reinterpret_cast<const char *>(v.data()),
+                         v.size() * sizeof(typename T::value_type));
+        } else {
+            buffer.write(reinterpret_cast<const char *>(&v), sizeof(T));
+        }
+    }
+
+    template <typename T>
+    static bool unpack_value(const char *&p, const char *end, T &v) {
+        if constexpr (is_sequence<T>::value) {
+            uint32_t n = 0;
+            if (!get_u32(p, end, n)) {
+                return false;
+            }
+            size_t bytes = size_t(n) * sizeof(typename T::value_type);
+            if (static_cast<size_t>(end - p) < bytes) {
+                return false;
+            }
+            v.resize(n);
+            if (bytes != 0) {
+                memcpy(&v[0], p, bytes);
+            }
+            p += bytes;
+        } else {
+            if (static_cast<size_t>(end - p) < sizeof(T)) {
+                return false;
+            }
+            memcpy(&v, p, sizeof(T));
+            p += sizeof(T);
+        }
+        return true;
+    }
+};
+
 } // namespace RPCbufferPack
 
 #endif
\ No newline at end of file
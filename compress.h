@@ -0,0 +1,185 @@
+#pragma once
+#ifndef TINY_RPC_COMPRESS_H_
+#define TINY_RPC_COMPRESS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/*
+* 内置的快速压缩
+ LZ77类的块压缩，格式与LZ4的块格式相同：由若干序列组成，每个序列为
+ [标记][字面量长度扩展][字面量][偏移u16][匹配长度扩展]，标记高4位为字面量长度，
+ 低4位为匹配长度减4，取15时后跟以255累加的扩展字节；最后一个序列只有字面量。
+ 单遍哈希查找，不做最优解析，以速度为先，适合压缩较大的消息体。
+*/
+namespace lz {
+
+static const size_t MIN_MATCH = 4;
+static const size_t LAST_LITERALS = 5; // 末尾至少保留的字面量
+static const size_t MF_LIMIT = 12;     // 距末尾少于该值时不再查找匹配
+static const size_t MAX_OFFSET = 65535;
+static const int HASH_LOG = 12;
+
+// 压缩结果的最大长度
+inline size_t compress_bound(size_t n) { return n + n / 255 + 16; }
+
+namespace detail {
+inline uint32_t read32(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+inline uint32_t hash(uint32_t v) {
+    return (v * 2654435761u) >> (32 - HASH_LOG);
+}
+
+// 写入以255累加的扩展长度
+inline unsigned char *put_length(unsigned char *op, size_t len) {
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = static_cast<unsigned char>(len);
+    return op;
+}
+
+// 写入一个序列，mlen为0表示最后一个只有字面量的序列；空间不足时返回nullptr
+inline unsigned char *put_sequence(unsigned char *op, unsigned char *oend,
+                                   const unsigned char *lit, size_t lit_len,
+                                   size_t offset, size_t mlen) {
+    size_t need = 1 + lit_len / 255 + 1 + lit_len + 2 + mlen / 255 + 1;
+    if (static_cast<size_t>(oend - op) < need) {
+        return nullptr;
+    }
+    unsigned char *token = op++;
+    *token = static_cast<unsigned char>((lit_len >= 15 ? 15 : lit_len) << 4);
+    if (lit_len >= 15) {
+        op = put_length(op, lit_len - 15);
+    }
+    memcpy(op, lit, lit_len);
+    op += lit_len;
+    if (mlen == 0) {
+        return op;
+    }
+    *op++ = static_cast<unsigned char>(offset);
+    *op++ = static_cast<unsigned char>(offset >> 8);
+    size_t m = mlen - MIN_MATCH;
+    *token |= static_cast<unsigned char>(m >= 15 ? 15 : m);
+    if (m >= 15) {
+        op = put_length(op, m - 15);
+    }
+    return op;
+}
+
+// 读取以255累加的扩展长度
+inline bool get_length(const unsigned char *&ip, const unsigned char *iend,
+                       size_t &len) {
+    unsigned char b;
+    do {
+        if (ip == iend) {
+            return false;
+        }
+        b = *ip++;
+        len += b;
+    } while (b == 255);
+    return true;
+}
+} // namespace detail
+
+// 压缩n个字节到dst，返回压缩后的长度，cap不足时返回0
+inline size_t compress(const char *src, size_t n, char *dst, size_t cap) {
+    const unsigned char *base = reinterpret_cast<const unsigned char *>(src);
+    unsigned char *op = reinterpret_cast<unsigned char *>(dst);
+    unsigned char *oend = op + cap;
+    // 存放位置加1，0表示空
+    uint32_t table[1 << HASH_LOG] = {0};
+    size_t ip = 0;
+    size_t anchor = 0;
+    if (n >= MF_LIMIT) {
+        size_t limit = n - MF_LIMIT;
+        while (ip <= limit) {
+            uint32_t seq = detail::read32(base + ip);
+            uint32_t h = detail::hash(seq);
+            size_t ref = table[h];
+            table[h] = static_cast<uint32_t>(ip + 1);
+            if (ref == 0 || ip + 1 - ref > MAX_OFFSET ||
+                detail::read32(base + ref - 1) != seq) {
+                // 长时间没有匹配时加大步长，不可压缩的数据很快跳过
+                ip += 1 + ((ip - anchor) >> 6);
+                continue;
+            }
+            --ref;
+            size_t mlen = MIN_MATCH;
+            size_t max_len = n - LAST_LITERALS - ip;
+            while (mlen < max_len && base[ref + mlen] == base[ip + mlen]) {
+                ++mlen;
+            }
+            op = detail::put_sequence(op, oend, base + anchor, ip - anchor,
+                                      ip - ref, mlen);
+            if (op == nullptr) {
+                return 0;
+            }
+            ip += mlen;
+            anchor = ip;
+        }
+    }
+    op = detail::put_sequence(op, oend, base + anchor, n - anchor, 0, 0);
+    if (op == nullptr) {
+        return 0;
+    }
+    return static_cast<size_t>(op - reinterpret_cast<unsigned char *>(dst));
+}
+
+// 解压到dst，out_len为原始长度；数据损坏时返回false，不会越界读写
+inline bool decompress(const char *src, size_t n, char *dst, size_t out_len) {
+    const unsigned char *ip = reinterpret_cast<const unsigned char *>(src);
+    const unsigned char *iend = ip + n;
+    unsigned char *out = reinterpret_cast<unsigned char *>(dst);
+    size_t op = 0;
+    while (ip < iend) {
+        unsigned char token = *ip++;
+        size_t lit_len = token >> 4;
+        if (lit_len == 15 && !detail::get_length(ip, iend, lit_len)) {
+            return false;
+        }
+        if (lit_len > static_cast<size_t>(iend - ip) ||
+            lit_len > out_len - op) {
+            return false;
+        }
+        memcpy(out + op, ip, lit_len);
+        ip += lit_len;
+        op += lit_len;
+        if (ip == iend) {
+            break; // 最后一个序列
+        }
+        if (iend - ip < 2) {
+            return false;
+        }
+        size_t offset = ip[0] | (static_cast<size_t>(ip[1]) << 8);
+        ip += 2;
+        size_t mlen = token & 15;
+        if (mlen == 15 && !detail::get_length(ip, iend, mlen)) {
+            return false;
+        }
+        mlen += MIN_MATCH;
+        if (offset == 0 || offset > op || mlen > out_len - op) {
+            return false;
+        }
+        if (offset >= mlen) {
+            memcpy(out + op, out + op - offset, mlen);
+        } else {
+            // 重叠的匹配逐字节复制，重复前面的内容
+            for (size_t i = 0; i < mlen; ++i) {
+                out[op + i] = out[op - offset + i];
+            }
+        }
+        op += mlen;
+    }
+    return op == out_len;
+}
+
+} // namespace lz
+
+#endif
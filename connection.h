@@ -6,17 +6,29 @@
 #include <functional>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <unordered_set>
 #include <array>
-#include <deque>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
 #include <boost/asio.hpp>
 #include "codec.h"
 #include "meta_util.h"
+#include "thread_pool.h"
+#include "recv_buffer.h"
+#include "buffer_pool.h"
+#include "compress.h"
+#include "transport.h"
+#include "timer_wheel.h"
 
 // 协议常量
 enum class result_code : int {
     OK = 0,
     FAIL = 1,
+    OVERLOADED = 2, // 服务端过载拒绝，请求未执行，可以换节点重试
 };
 
 enum class error_code {
@@ -26,26 +38,674 @@ enum class error_code {
     TIMEOUT,
     CANCEL,
     BADCONNECTION,
+    OVERLOADED,
 };
 
-enum class request_type : uint8_t { req_res, sub_pub };
+// batch：请求体为多个调用组成的数组，应答体为按顺序排列的各项结果；
+// sub_pub：客户端发出时为订阅或退订，服务端发出时为发布的消息；
+// handshake：连接建立后客户端发出，双方交换各自支持的帧标志；
+// stream：流式调用，一个请求对应多个应答帧；stream_ctrl：客户端的流控帧
+enum class request_type : uint8_t {
+    req_res,
+    sub_pub,
+    batch,
+    handshake,
+    stream,
+    stream_ctrl,
+};
 
-struct message_type {
-    std::uint64_t req_id;
-    request_type req_type;
-    std::shared_ptr<std::string> content;
+// 流式应答帧的类型，位于消息体的第一个字节，其后为msgpack编码的内容
+enum class stream_frame : uint8_t {
+    data,  // 一个结果
+    end,   // 正常结束，无内容
+    error, // 出错结束，内容为[状态码, 错误信息]
 };
 
-// 13个字节,但因为字节对齐，拓展为24字节
+// 帧标志
+static const uint8_t FRAME_FLAT = 0x01;       // 消息体为平坦编码，见flat_codec
+static const uint8_t FRAME_COMPRESSED = 0x02; // 消息体已压缩，见frame_compression
+
+// 协议头，按字段紧凑编码为HEAD_LEN(22)个字节，不受结构体对齐影响
 struct rpc_header {
     uint32_t body_len;
     uint64_t req_id;
     request_type req_type;
+    uint32_t method_id;  // 0表示按请求体中的函数名调用
+    uint32_t timeout_ms; // 调用期限，相对于服务端收到请求的时刻，0表示不限
+    uint8_t flags;       // 帧标志，应答与请求的编码相同
+};
+
+static const size_t HEAD_LEN = 22;
+
+inline void encode_header(char *buf, const rpc_header &h) {
+    memcpy(buf, &h.body_len, 4);
+    memcpy(buf + 4, &h.req_id, 8);
+    memcpy(buf + 12, &h.req_type, 1);
+    memcpy(buf + 13, &h.method_id, 4);
+    memcpy(buf + 17, &h.timeout_ms, 4);
+    memcpy(buf + 21, &h.flags, 1);
+}
+
+inline rpc_header decode_header(const char *buf) {
+    rpc_header h;
+    memcpy(&h.body_len, buf, 4);
+    memcpy(&h.req_id, buf + 4, 8);
+    memcpy(&h.req_type, buf + 12, 1);
+    memcpy(&h.method_id, buf + 13, 4);
+    memcpy(&h.timeout_ms, buf + 17, 4);
+    memcpy(&h.flags, buf + 21, 1);
+    return h;
+}
+
+using deadline_type = std::chrono::steady_clock::time_point;
+
+// 是否已过期限，time_point::max()表示不限
+inline bool deadline_expired(deadline_type deadline) {
+    return deadline != deadline_type::max() &&
+           std::chrono::steady_clock::now() >= deadline;
+}
+
+// 待发送的消息，协议头在入队时编码好，发送期间地址保持有效；
+// 消息体来自缓冲区池，发送完成后随消息析构归还；
+// 发布的消息体由所有订阅者共享同一份编码，不逐个拷贝
+struct message_type {
+    char head[HEAD_LEN];
+    buffer_pool::buffer_ptr content;
+    std::shared_ptr<const buffer_type> shared; // 发布的消息体
+    bool admitted = false; // 是否为已准入请求的应答，发送完成后释放名额
+
+    const char *data() const {
+        return content ? content->data() : shared->data();
+    }
+    size_t size() const { return content ? content->size() : shared->size(); }
+};
+
+// 由函数名在编译期计算方法id(FNV-1a)，0保留给按名调用
+constexpr uint32_t method_id_of(std::string_view name) {
+    uint32_t h = 2166136261u;
+    for (char c : name) {
+        h ^= static_cast<uint8_t>(c);
+        h *= 16777619u;
+    }
+    return h == 0 ? 1 : h;
+}
+
+// 请求和应答的编码
+enum class codec_type : uint8_t {
+    msgpack, // 通用编码，服务端按参数类型转换
+    flat,    // 平坦编码，参数和返回类型都支持时使用，否则退回msgpack
+};
+
+/*
+* 调用目标
+ 由函数名隐式构造时按名调用，请求体携带函数名；
+ 由rpc_method::by_id()构造时id在编译期算出，放在协议头中，请求体只含参数。
+ constexpr rpc_method calc_fun = rpc_method::by_id("calcFun");
+ with_codec(codec_type::flat)指定平坦编码，参数和返回类型须与服务端函数完全一致。
+*/
+struct rpc_method {
+    uint32_t id = 0;
+    std::string_view name;
+    codec_type codec = codec_type::msgpack;
+
+    rpc_method(const char *n) : name(n) {}
+    rpc_method(const std::string &n) : name(n) {}
+    rpc_method(std::string_view n) : name(n) {}
+
+    static constexpr rpc_method by_id(std::string_view n) {
+        return rpc_method(method_id_of(n), n);
+    }
+
+    constexpr rpc_method with_codec(codec_type c) const {
+        rpc_method m = *this;
+        m.codec = c;
+        return m;
+    }
+
+  private:
+    constexpr rpc_method(uint32_t i, std::string_view n) : id(i), name(n) {}
+};
+
+// 处理函数的执行方式
+enum class exec_policy : uint8_t {
+    inline_io, // 在io线程上直接执行，适合耗时很短的函数
+    offload,   // 投递到处理函数线程池执行，io线程只负责收发和解码
+};
+
+/*
+* 准入控制
+ 限制每个连接和整个服务端的在途请求数(从准入到应答发送完成)，
+ 以及请求在处理函数线程池中的排队时间(只对offload的处理函数有效)；超过限制的请求以OVERLOADED拒绝而不执行，
+ 过载时服务端按自身能力持续处理，而不是让队列无限增长。
+ 流式函数等待窗口时占用线程池的线程，另外限制其等待时间和同时等待的流数。
+ 配置在run()之前设置，之后只读；计数由server和所有connection共享。
+*/
+struct admission_control {
+    size_t max_conn_inflight = 0;   // 每个连接的在途请求上限，0表示不限
+    size_t max_server_inflight = 0; // 服务端的在途请求上限，0表示不限
+    std::chrono::milliseconds max_queue_delay{0}; // 排队时间上限，0表示不限
+    std::atomic<size_t> inflight{0};              // 服务端的在途请求数
+    // 流等待窗口的时间上限，超过时以错误结束该流，0表示不限
+    std::chrono::milliseconds stream_stall_timeout{30000};
+    size_t max_stalled_streams = 0; // 同时等待窗口的流数上限，0表示不限
+    std::atomic<size_t> stalled_streams{0}; // 正在等待窗口的流数
+
+    // 是否需要计数
+    bool limited() const {
+        return max_conn_inflight != 0 || max_server_inflight != 0;
+    }
+
+    // 占用一个服务端名额，已达上限时返回false
+    bool try_acquire() {
+        size_t cur = inflight.load(std::memory_order_relaxed);
+        do {
+            if (max_server_inflight != 0 && cur >= max_server_inflight) {
+                return false;
+            }
+        } while (!inflight.compare_exchange_weak(cur, cur + 1,
+                                                 std::memory_order_relaxed));
+        return true;
+    }
+
+    void release(size_t n = 1) {
+        inflight.fetch_sub(n, std::memory_order_relaxed);
+    }
+
+    // 开始等待窗口，同时等待的流数已达上限时返回false
+    bool try_stall_stream() {
+        size_t cur = stalled_streams.load(std::memory_order_relaxed);
+        do {
+            if (max_stalled_streams != 0 && cur >= max_stalled_streams) {
+                return false;
+            }
+        } while (!stalled_streams.compare_exchange_weak(
+            cur, cur + 1, std::memory_order_relaxed));
+        return true;
+    }
+
+    void end_stall_stream() {
+        stalled_streams.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    // 从开始排队到现在是否已超过排队时间上限
+    bool queued_too_long(deadline_type since) const {
+        return max_queue_delay.count() != 0 &&
+               std::chrono::steady_clock::now() - since > max_queue_delay;
+    }
+};
+
+class connection;
+
+/*
+* 流的服务端状态
+ credits为客户端授予、尚未用完的窗口，写出一个结果消耗一个；
+ 窗口用完时写出方阻塞，客户端取走结果后授予新的窗口，
+ 慢速的客户端不会使服务端缓存所有结果。客户端取消或连接断开时唤醒写出方。
+ 阻塞的写出方占用线程池的线程，等待超过准入控制的时间上限、或同时等待的流过多时，
+ 流以错误结束，不让慢速的客户端占满线程池。
+*/
+struct stream_state {
+    explicit stream_state(uint32_t window) : credits(window) {}
+
+    // 等待并消耗一个窗口，流已取消或因等待过久而结束时返回false
+    bool acquire(admission_control &limits) {
+        std::unique_lock<std::mutex> lock(mtx);
+        auto ready = [this] { return credits > 0 || cancelled; };
+        if (!ready()) {
+            if (!limits.try_stall_stream()) {
+                fail(result_code::OVERLOADED,
+                     "server busy: too many stalled streams");
+                return false;
+            }
+            bool woken = true;
+            if (limits.stream_stall_timeout.count() == 0) {
+                cv.wait(lock, ready);
+            } else {
+                woken = cv.wait_for(lock, limits.stream_stall_timeout, ready);
+            }
+            limits.end_stall_stream();
+            if (!woken) {
+                fail(result_code::FAIL,
+                     "stream stalled: reader granted no credit");
+                return false;
+            }
+        }
+        if (cancelled) {
+            return false;
+        }
+        --credits;
+        return true;
+    }
+
+    void grant(uint32_t n) {
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            credits += n;
+        }
+        cv.notify_all();
+    }
+
+    void cancel() {
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            cancelled = true;
+        }
+        cv.notify_all();
+    }
+
+    bool is_cancelled() {
+        std::unique_lock<std::mutex> lock(mtx);
+        return cancelled;
+    }
+
+    // 流是否因等待窗口失败而结束，是则取出状态码和错误信息
+    bool failed(result_code &code, std::string &msg) {
+        std::unique_lock<std::mutex> lock(mtx);
+        if (error.empty()) {
+            return false;
+        }
+        code = error_code_;
+        msg = error;
+        return true;
+    }
+
+    std::mutex mtx;
+    std::condition_variable cv;
+    uint64_t credits;
+    bool cancelled = false;
+    result_code error_code_ = result_code::OK; // 等待窗口失败时的状态码
+    std::string error;                         // 等待窗口失败时的错误信息
+
+  private:
+    // 持锁调用：以错误结束流，之后的写出都返回false
+    void fail(result_code code, const char *msg) {
+        cancelled = true;
+        error_code_ = code;
+        error = msg;
+    }
+};
+
+/*
+* 流式函数的写出端
+ 与请求的req_id绑定，每次write()写出一个结果帧，窗口用完时阻塞等待客户端；
+ 流式函数返回后发送结束帧，抛出异常时发送错误帧。
+*/
+class stream_writer {
+  public:
+    stream_writer(std::shared_ptr<connection> conn, std::uint64_t reqid,
+                  std::shared_ptr<stream_state> state)
+        : conn_(std::move(conn)), reqid_(reqid), state_(std::move(state)) {}
+
+    // 写出一个结果；客户端已取消或连接已断开时返回false，流式函数应随即返回
+    template <typename T> inline bool write(const T &value);
+
+    // 客户端是否已取消
+    bool cancelled() const { return state_->is_cancelled(); }
+
+  private:
+    std::shared_ptr<connection> conn_;
+    std::uint64_t reqid_;
+    std::shared_ptr<stream_state> state_;
+};
+
+// 注册函数表的表项，参数为已解析的参数数组(不含函数名)
+struct handler_entry {
+    exec_policy policy = exec_policy::inline_io;
+    // 同步处理：参数数组，结果打包进的缓冲区
+    std::function<void(const msgpack::object_array &, buffer_type &)> sync;
+    // 异步处理(协程)：参数数组，完成时以结果调用的回调
+    std::function<void(const msgpack::object_array &,
+                       std::function<void(std::string)>)>
+        async;
+    // 平坦编码处理：参数区，结果打包进的缓冲区；参数和返回类型都支持时才有
+    std::function<void(const char *, size_t, buffer_type &)> flat;
+    uint32_t flat_signature = 0; // 参数和返回类型的签名，与请求中的比对
+    // 流式处理：参数数组，写出结果的stream_writer
+    std::function<void(const msgpack::object_array &, stream_writer &)> stream;
+};
+
+// 支持以string_view查找的哈希，避免为函数名构造std::string
+struct string_hash {
+    using is_transparent = void;
+    size_t operator()(std::string_view s) const {
+        return std::hash<std::string_view>{}(s);
+    }
+};
+
+using handler_map =
+    std::unordered_map<std::string, handler_entry, string_hash, std::equal_to<>>;
+
+/*
+* 注册函数表
+ 按名字查找的哈希表，以及按方法id查找的开放寻址扁平表，
+ 注册完成后只读，由server和所有connection共享。
+*/
+class handler_table {
+  public:
+    // 注册函数，方法id冲突时抛出异常
+    void add(const std::string &name, handler_entry entry) {
+        uint32_t id = method_id_of(name);
+        auto it = by_name_.find(name);
+        if (it == by_name_.end()) {
+            const slot *s = find_slot(id);
+            if (s != nullptr) {
+                throw std::invalid_argument("method id collision: " + name +
+                                            " and " + *s->name);
+            }
+            it = by_name_.emplace(name, handler_entry{}).first;
+            insert_slot(slot{id, &it->second, &it->first});
+        }
+        it->second = std::move(entry);
+    }
+
+    const handler_entry *find(std::string_view name) const {
+#if defined(__cpp_lib_generic_unordered_lookup) &&                             \
+    __cpp_lib_generic_unordered_lookup >= 201811L
+        auto it = by_name_.find(name);
+#else
+        // 不支持异构查找时复用线程内缓冲区，稳定后不再分配内存
+        thread_local std::string key;
+        key.assign(name.data(), name.size());
+        auto it = by_name_.find(key);
+#endif
+        return it == by_name_.end() ? nullptr : &it->second;
+    }
+
+    const handler_entry *find(uint32_t id) const {
+        const slot *s = find_slot(id);
+        return s == nullptr ? nullptr : s->entry;
+    }
+
+  private:
+    struct slot {
+        uint32_t id = 0; // 0表示空槽
+        const handler_entry *entry = nullptr;
+        const std::string *name = nullptr;
+    };
+
+    const slot *find_slot(uint32_t id) const {
+        if (slots_.empty()) {
+            return nullptr;
+        }
+        size_t mask = slots_.size() - 1;
+        for (size_t i = id & mask;; i = (i + 1) & mask) {
+            if (slots_[i].id == id) {
+                return &slots_[i];
+            }
+            if (slots_[i].id == 0) {
+                return nullptr;
+            }
+        }
+    }
+
+    void insert_slot(const slot &s) {
+        // 负载因子不超过1/2，容量为2的幂
+        if ((count_ + 1) * 2 > slots_.size()) {
+            std::vector<slot> old;
+            old.swap(slots_);
+            slots_.resize(old.empty() ? 16 : old.size() * 2);
+            for (auto &o : old) {
+                if (o.id != 0) {
+                    place(o);
+                }
+            }
+        }
+        place(s);
+        ++count_;
+    }
+
+    void place(const slot &s) {
+        size_t mask = slots_.size() - 1;
+        size_t i = s.id & mask;
+        while (slots_[i].id != 0) {
+            i = (i + 1) & mask;
+        }
+        slots_[i] = s;
+    }
+
+    handler_map by_name_;
+    std::vector<slot> slots_;
+    size_t count_ = 0;
 };
 
 static const size_t MAX_BUF_LEN = 1048576 * 10;
-static const size_t HEAD_LEN = 13;
 static const size_t INIT_BUF_SIZE = 2 * 1024;
+static const size_t RECV_BUF_SIZE = 64 * 1024;
+// 单次gather写最多聚合的消息数(每条消息占两个iovec)和字节数
+static const size_t MAX_WRITE_BATCH = 64;
+static const size_t MAX_WRITE_BYTES = 256 * 1024;
+// offload请求占用的解析zone最多缓存的个数
+static const size_t MAX_SPARE_ZONES = 8;
+
+// 压缩统计的快照
+struct compression_stats {
+    uint64_t compressed_frames = 0;   // 压缩后发送的帧数
+    uint64_t skipped_frames = 0;      // 超过阈值但压缩无效果、按原样发送的帧数
+    uint64_t raw_bytes = 0;           // 压缩前的字节数
+    uint64_t wire_bytes = 0;          // 压缩后的字节数
+    uint64_t compress_us = 0;         // 压缩耗时
+    uint64_t decompressed_frames = 0; // 收到并解压的帧数
+    uint64_t decompress_us = 0;       // 解压耗时
+
+    // 压缩率：压缩后与压缩前的字节数之比
+    double ratio() const {
+        return raw_bytes == 0 ? 1.0 : double(wire_bytes) / double(raw_bytes);
+    }
+};
+
+/*
+* 消息体压缩
+ 超过阈值的消息体压缩后发送，帧标志带FRAME_COMPRESSED，接收方透明解压；
+ 阈值以下的小消息不压缩，不影响小调用的延迟。
+ 压缩后的消息体为[原始长度u32][压缩数据]，压缩无效果时按原样发送。
+ 只有对端在握手中表明支持时才压缩，双方始终能解压。
+*/
+struct frame_compression {
+    size_t threshold = 0; // 压缩的最小消息体大小，0表示不压缩
+
+    // 是否应压缩该消息体
+    bool should_compress(size_t len) const {
+        return threshold != 0 && len >= threshold;
+    }
+
+    // 压缩消息体到out，压缩后不比原始数据小时返回false
+    bool compress(const char *data, size_t len, buffer_type &out) {
+        auto start = std::chrono::steady_clock::now();
+        // 压缩到线程内的缓冲区，稳定后不再分配内存
+        thread_local std::vector<char> scratch;
+        scratch.resize(4 + lz::compress_bound(len));
+        uint32_t raw_len = static_cast<uint32_t>(len);
+        memcpy(scratch.data(), &raw_len, 4);
+        size_t n = lz::compress(data, len, scratch.data() + 4, len - len / 16);
+        record(compress_us_, start);
+        if (n == 0) {
+            skipped_frames_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        out.write(scratch.data(), 4 + n);
+        compressed_frames_.fetch_add(1, std::memory_order_relaxed);
+        raw_bytes_.fetch_add(len, std::memory_order_relaxed);
+        wire_bytes_.fetch_add(4 + n, std::memory_order_relaxed);
+        return true;
+    }
+
+    // 解压消息体，原始长度超过max_len或数据损坏时返回false
+    bool decompress(const char *data, size_t len, std::vector<char> &out,
+                    size_t max_len) {
+        uint32_t raw_len = 0;
+        if (len < 4) {
+            return false;
+        }
+        memcpy(&raw_len, data, 4);
+        if (raw_len >= max_len) {
+            return false;
+        }
+        auto start = std::chrono::steady_clock::now();
+        out.resize(raw_len);
+        bool ok = lz::decompress(data + 4, len - 4, out.data(), raw_len);
+        record(decompress_us_, start);
+        decompressed_frames_.fetch_add(1, std::memory_order_relaxed);
+        return ok;
+    }
+
+    compression_stats stats() const {
+        compression_stats s;
+        s.compressed_frames = compressed_frames_.load();
+        s.skipped_frames = skipped_frames_.load();
+        s.raw_bytes = raw_bytes_.load();
+        s.wire_bytes = wire_bytes_.load();
+        s.compress_us = compress_us_.load();
+        s.decompressed_frames = decompressed_frames_.load();
+        s.decompress_us = decompress_us_.load();
+        return s;
+    }
+
+  private:
+    static void record(std::atomic<uint64_t> &total, deadline_type start) {
+        total.fetch_add(std::chrono::duration_cast<std::chrono::microseconds>(
+                            std::chrono::steady_clock::now() - start)
+                            .count(),
+                        std::memory_order_relaxed);
+    }
+
+    std::atomic<uint64_t> compressed_frames_{0};
+    std::atomic<uint64_t> skipped_frames_{0};
+    std::atomic<uint64_t> raw_bytes_{0};
+    std::atomic<uint64_t> wire_bytes_{0};
+    std::atomic<uint64_t> compress_us_{0};
+    std::atomic<uint64_t> decompressed_frames_{0};
+    std::atomic<uint64_t> decompress_us_{0};
+};
+
+// 订阅者的发送队列满时的处理
+enum class slow_consumer_policy : uint8_t {
+    drop_newest, // 丢弃新发布的消息
+    drop_oldest, // 丢弃队列中最早的发布消息
+    disconnect,  // 断开该订阅者
+};
+
+// 发布订阅统计的快照
+struct pubsub_stats {
+    uint64_t published = 0;    // 发布的消息数
+    uint64_t delivered = 0;    // 进入订阅者发送队列的消息数
+    uint64_t dropped = 0;      // 因队列满丢弃的消息数
+    uint64_t disconnected = 0; // 因队列满断开的订阅者数
+};
+
+/*
+* 发布订阅的主题表
+ 每个主题对应订阅者列表的只读快照，订阅和退订时整体替换(写时复制)，
+ 发布时只在锁内取快照，不随订阅者数量拷贝或分配。
+ 配置在run()之前设置，之后只读；由server和所有connection共享。
+*/
+class pubsub_hub {
+  public:
+    struct subscriber {
+        const connection *id; // 用于退订，连接析构时仍可比较
+        std::weak_ptr<connection> conn;
+    };
+    using subscriber_list = std::vector<subscriber>;
+
+    size_t max_queue = 1024; // 每个订阅者未发送的发布消息上限
+    slow_consumer_policy policy = slow_consumer_policy::drop_oldest;
+
+    void subscribe(const std::string &topic, const connection *id,
+                   std::weak_ptr<connection> conn) {
+        std::unique_lock<std::mutex> lock(mtx_);
+        auto &list = topics_[topic];
+        auto next = list ? std::make_shared<subscriber_list>(*list)
+                         : std::make_shared<subscriber_list>();
+        for (auto &s : *next) {
+            if (s.id == id) {
+                return;
+            }
+        }
+        next->push_back(subscriber{id, std::move(conn)});
+        list = std::move(next);
+    }
+
+    void unsubscribe(const std::string &topic, const connection *id) {
+        std::unique_lock<std::mutex> lock(mtx_);
+        auto it = topics_.find(topic);
+        if (it == topics_.end()) {
+            return;
+        }
+        auto next = std::make_shared<subscriber_list>();
+        for (auto &s : *it->second) {
+            if (s.id != id) {
+                next->push_back(s);
+            }
+        }
+        if (next->empty()) {
+            topics_.erase(it);
+        } else {
+            it->second = std::move(next);
+        }
+    }
+
+    // 主题的订阅者快照，没有订阅者时返回nullptr
+    std::shared_ptr<const subscriber_list>
+    subscribers(const std::string &topic) const {
+        std::unique_lock<std::mutex> lock(mtx_);
+        auto it = topics_.find(topic);
+        return it == topics_.end() ? nullptr : it->second;
+    }
+
+    pubsub_stats stats() const {
+        pubsub_stats s;
+        s.published = published.load();
+        s.delivered = delivered.load();
+        s.dropped = dropped.load();
+        s.disconnected = disconnected.load();
+        return s;
+    }
+
+    std::atomic<uint64_t> published{0};
+    std::atomic<uint64_t> delivered{0};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<uint64_t> disconnected{0};
+
+  private:
+    mutable std::mutex mtx_;
+    std::unordered_map<std::string, std::shared_ptr<const subscriber_list>>
+        topics_;
+};
+
+class connection;
+
+/*
+* 连接表
+ server记录当前的连接，连接关闭时自行删除，不需要定时扫描；
+ 只保存弱引用，不延长连接的生命周期，多线程安全
+*/
+class connection_table {
+  public:
+    // 添加连接，返回连接id，从1开始
+    int64_t add(std::weak_ptr<connection> conn) {
+        std::unique_lock<std::mutex> lock(mtx_);
+        int64_t id = next_id_++;
+        conns_.emplace(id, std::move(conn));
+        return id;
+    }
+
+    void remove(int64_t id) {
+        std::unique_lock<std::mutex> lock(mtx_);
+        conns_.erase(id);
+    }
+
+    size_t size() const {
+        std::unique_lock<std::mutex> lock(mtx_);
+        return conns_.size();
+    }
+
+    // 取消所有连接上进行中的流，server析构时用于唤醒阻塞的流式函数
+    void cancel_streams();
+
+  private:
+    mutable std::mutex mtx_;
+    int64_t next_id_ = 1;
+    std::unordered_map<int64_t, std::weak_ptr<connection>> conns_;
+};
 
 /*
 * 连接类
@@ -55,177 +715,1010 @@ static const size_t INIT_BUF_SIZE = 2 * 1024;
 */
 class connection : public std::enable_shared_from_this<connection>,
                    private boost::asio::noncopyable {
+    friend class stream_writer;
+    friend class idle_wheel_service<connection>;
+    friend class connection_table;
+
   public:
     connection(boost::asio::io_service &io_service, std::size_t timeout_seconds,
-               std::shared_ptr<std::unordered_map<
-                   std::string,
-                   std::function<void(const char *, size_t, std::string &)>>>
-                   ptr)
-        : socket_(io_service), timer_(io_service), body_(INIT_BUF_SIZE),
-          timeout_seconds_(timeout_seconds), m_sharedMapPtr_(ptr),
-          has_closed_(false) {
-        conn_id_ = 0;
-        memset(head_, 0, sizeof(head_));
+               std::shared_ptr<handler_table> ptr,
+               std::shared_ptr<thread_pool> pool = nullptr,
+               std::shared_ptr<buffer_pool> buffers = nullptr,
+               std::shared_ptr<admission_control> admission = nullptr,
+               std::shared_ptr<frame_compression> compression = nullptr,
+               std::shared_ptr<pubsub_hub> hub = nullptr,
+               std::shared_ptr<connection_table> table = nullptr)
+        : socket_(io_service), strand_(io_service),
+          timeout_seconds_(timeout_seconds), has_closed_(false),
+          recv_(RECV_BUF_SIZE), m_sharedMapPtr_(ptr), m_poolPtr_(pool),
+          m_buffersPtr_(buffers ? buffers : std::make_shared<buffer_pool>()),
+          m_admissionPtr_(admission ? admission
+                                    : std::make_shared<admission_control>()),
+          m_compressionPtr_(compression
+                                ? compression
+                                : std::make_shared<frame_compression>()),
+          m_hubPtr_(hub ? hub : std::make_shared<pubsub_hub>()),
+          m_tablePtr_(table) {
+        conn_id_ = -1;
+        if (timeout_seconds_ > 0) {
+            // 空闲超时由所在io线程的时间轮统一管理
+            m_wheelPtr_ =
+                &boost::asio::use_service<idle_wheel_service<connection>>(
+                    io_service);
+            idle_ticks_ = idle_wheel_service<connection>::ticks(
+                std::chrono::seconds(timeout_seconds_));
+        }
     }
 
-    ~connection() { close(); }
+    ~connection() {
+        close();
+        // 未发送完的应答和被丢弃的请求占用的服务端名额
+        m_admissionPtr_->release(inflight_.load());
+    }
 
     // 返回连接对于的socket
-    boost::asio::ip::tcp::socket &socket() { return socket_; }
+    rpc_socket &socket() { return socket_; }
 
-    // 返回连接id
+    // 设置连接id，即在连接表中的序号
     void set_conn_id(int64_t id) { conn_id_ = id; }
 
     // 返回连接是否已经关闭
     bool has_closed() const { return has_closed_; }
 
+    // 投递一条发布的消息，消息体由所有订阅者共享，多线程安全
+    void deliver(std::shared_ptr<const buffer_type> msg) {
+        boost::asio::post(strand_, [self = this->shared_from_this(),
+                                    m = std::move(msg)]() mutable {
+            self->enqueue_publish(std::move(m));
+        });
+    }
+
     // 开始连接，外部接口，接收信息，返回调用
     void start() {
-        // 递归读取请求头，接收连接
-        read_header();
+        // 递归读取请求头，接收连接；连接的所有回调都在strand_上串行执行
+        boost::asio::dispatch(strand_, [self = this->shared_from_this()] {
+            self->watch_idle();
+            self->read_header();
+        });
     }
 
     // 消息的解析系列函数
   private:
-    // 解析消息头
+    // 读取数据：一次读入尽可能多的字节，再取出其中所有完整的帧
     void read_header() {
-        // 重置定时器
-        reset_timer();
         // 确保对象在异步操作完成之前不会被销毁
         auto self(this->shared_from_this());
-        boost::asio::async_read(
-            socket_, boost::asio::buffer(head_, HEAD_LEN),
-            [this, self](boost::system::error_code ec, std::size_t length) {
+        socket_.async_read_some(
+            recv_.prepare(),
+            boost::asio::bind_executor(strand_, [this, self](
+                                                    boost::system::error_code ec,
+                                                    std::size_t length) {
                 if (!socket_.is_open())
                     return;
-                if (!ec) {
-                    uint32_t body_len = 0;
-                    memcpy(&body_len, head_, 4);
-                    memcpy(&req_id_, head_ + 4, 8);
-                    memcpy(&req_type_, head_ + 12, 1);
-
-                    if (body_len > 0 && body_len < MAX_BUF_LEN) {
-                        if (body_.size() < body_len) {
-                            body_.resize(body_len);
-                        }
-                        read_body(body_len);
-                        return;
-                    }
-                    if (body_len == 0) {
-                        // 删除定时，重新等待通信
-                        cancel_timer();
-                        read_header();
-                        return;
-                    }
-                } else {
+                if (ec) {
                     // 出错了断开连接
                     close();
                     return;
                 }
-            });
+                recv_.commit(length);
+                // 本次读到的帧以此作为到达时刻计算期限
+                read_time_ = std::chrono::steady_clock::now();
+                touch();
+                process_frames();
+            }));
     }
 
-    // 解析消息体
-    void read_body(std::size_t size) {
+    // 依次处理缓冲区中的完整帧，剩余半帧留待下次读取
+    void process_frames() {
+        while (recv_.size() >= HEAD_LEN) {
+            rpc_header header = decode_header(recv_.data());
+            if (header.body_len >= MAX_BUF_LEN) {
+                // 非法长度，断开连接
+                close();
+                return;
+            }
+            size_t frame_len = HEAD_LEN + header.body_len;
+            if (recv_.size() < frame_len) {
+                if (frame_len > recv_.capacity()) {
+                    // 超过缓冲区的大帧，单独读取剩余的消息体
+                    read_body(header);
+                    return;
+                }
+                break;
+            }
+            // 空消息体，继续等待通信
+            if (header.body_len > 0) {
+                dispatch_frame(header, recv_.data() + HEAD_LEN, recv_.hold());
+            }
+            recv_.consume(frame_len);
+            if (has_closed()) {
+                return;
+            }
+        }
+        read_header();
+    }
+
+    // 解析大的消息体：已收到的部分拷入body_，剩余部分直接读入body_
+    void read_body(const rpc_header &header) {
+        size_t have = recv_.size() - HEAD_LEN;
+        // 上一个大消息体仍被处理中的请求持有时换用新的
+        if (!body_ || body_.use_count() > 1) {
+            body_ = std::make_shared<std::vector<char>>(header.body_len);
+        } else {
+            // 与任务线程释放body_时的修改同步
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (body_->size() < header.body_len) {
+                body_->resize(header.body_len);
+            }
+        }
+        memcpy(body_->data(), recv_.data() + HEAD_LEN, have);
+        recv_.consume(recv_.size());
+
         auto self(this->shared_from_this());
         boost::asio::async_read(
-            socket_, boost::asio::buffer(body_.data(), size),
-            [this, self](boost::system::error_code ec, std::size_t length) {
-                // 取消定时，避免超时断开连接
-                cancel_timer();
+            socket_,
+            boost::asio::buffer(body_->data() + have, header.body_len - have),
+            boost::asio::bind_executor(strand_, [this, self, header](
+                                                    boost::system::error_code ec,
+                                                    std::size_t length) {
                 if (!socket_.is_open()) {
                     return;
                 }
                 if (!ec) {
-                    // 递归读，等待下一次调用，备份消息避免两次消息对冲混淆
-                    request_type tmp_req_type = req_type_;
-                    std::string tmp_body(body_.data(), length);
+                    read_time_ = std::chrono::steady_clock::now();
+                    touch();
+                    dispatch_frame(header, body_->data(), body_);
+                    // 递归读，等待下一次调用
                     read_header();
-                    if (req_type_ == request_type::req_res) {
-                        route(tmp_body.data(), length); // 调用函数
-                    } else {
-                        // 返回错误信息
-                    }
                 } else {
                     // 出错了断开连接
                     close();
                     return;
                 }
-            });
+            }));
     }
 
-    // 处理信息，路由调用函数
-    void route(const char *data, std::size_t size) {
+    // 处理一个完整的帧，解析结果直接引用帧数据，owner为帧数据所在的块
+    void dispatch_frame(const rpc_header &header, const char *body,
+                        const recv_buffer::chunk_ptr &owner) {
+        if (header.flags & FRAME_COMPRESSED) {
+            // 任何类型的帧都可能被压缩，先解压到新的块(由处理中的请求持有)，再按类型处理
+            auto raw = std::make_shared<std::vector<char>>();
+            if (!m_compressionPtr_->decompress(body, header.body_len, *raw,
+                                               MAX_BUF_LEN) ||
+                raw->empty()) {
+                close();
+                return;
+            }
+            rpc_header h = header;
+            h.flags &= ~FRAME_COMPRESSED;
+            h.body_len = static_cast<uint32_t>(raw->size());
+            dispatch_frame(h, raw->data(), raw);
+            return;
+        }
+        if (header.req_type == request_type::handshake) {
+            handshake(header.req_id, body, header.body_len);
+            return;
+        }
+        if (header.req_type == request_type::stream_ctrl) {
+            stream_control(header.req_id, body, header.body_len);
+            return;
+        }
+        if (header.req_type == request_type::sub_pub) {
+            subscription(body, header.body_len);
+            return;
+        }
+        deadline_type deadline =
+            header.timeout_ms == 0
+                ? deadline_type::max()
+                : read_time_ + std::chrono::milliseconds(header.timeout_ms);
+        // 调用方已放弃的请求不再执行，也不写回
+        if (deadline_expired(deadline)) {
+            return;
+        }
+        if (header.req_type != request_type::req_res &&
+            header.req_type != request_type::batch &&
+            header.req_type != request_type::stream) {
+            // 未知的请求类型，忽略
+            return;
+        }
+        // 准入控制：超过在途上限时直接拒绝，不解析请求体；
+        // 排队时间只在投递到处理函数线程池时检查
+        uint8_t flags = header.flags & FRAME_FLAT;
+        if (!admit()) {
+            // 流的应答须是带类型的流式应答帧
+            if (header.req_type == request_type::stream) {
+                stream_error(header.req_id, result_code::OVERLOADED,
+                             "server overloaded", false);
+            } else {
+                response(header.req_id,
+                         error_buffer(flags, result_code::OVERLOADED,
+                                      "server overloaded"),
+                         header.req_type, flags, false);
+            }
+            return;
+        }
+        if (header.req_type == request_type::req_res && flags != 0) {
+            route_flat(header.req_id, header.method_id, deadline, body,
+                       header.body_len, owner);
+        } else if (header.req_type == request_type::req_res) {
+            route(header.req_id, header.method_id, deadline, body,
+                  header.body_len, owner); // 调用函数
+        } else if (header.req_type == request_type::stream) {
+            route_stream(header.req_id, header.method_id, body,
+                         header.body_len, owner);
+        } else {
+            route_batch(header.req_id, deadline, body, header.body_len, owner);
+        }
+    }
+
+    // 订阅或退订：消息体为[是否订阅, 主题]，不回复
+    void subscription(const char *body, std::size_t size) {
+        std::tuple<bool, std::string> req;
+        try {
+            RPCbufferPack::msgpack_codec codec;
+            req = codec.unpack<std::tuple<bool, std::string>>(body, size);
+        } catch (const std::invalid_argument &) {
+            return;
+        }
+        const std::string &topic = std::get<1>(req);
+        if (std::get<0>(req)) {
+            if (topics_.insert(topic).second) {
+                m_hubPtr_->subscribe(topic, this, this->weak_from_this());
+            }
+        } else if (topics_.erase(topic) != 0) {
+            m_hubPtr_->unsubscribe(topic, this);
+        }
+    }
+
+    // 发布的消息入队；未发送的发布消息达到上限时按慢速订阅者策略处理
+    void enqueue_publish(std::shared_ptr<const buffer_type> msg) {
+        if (has_closed()) {
+            return;
+        }
+        if (pub_queued_ >= m_hubPtr_->max_queue) {
+            switch (m_hubPtr_->policy) {
+            case slow_consumer_policy::drop_newest:
+                m_hubPtr_->dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            case slow_consumer_policy::drop_oldest:
+                for (auto it = write_queue_.begin(); it != write_queue_.end();
+                     ++it) {
+                    if (it->shared) {
+                        write_queue_.erase(it);
+                        --pub_queued_;
+                        break;
+                    }
+                }
+                m_hubPtr_->dropped.fetch_add(1, std::memory_order_relaxed);
+                break;
+            case slow_consumer_policy::disconnect:
+                m_hubPtr_->disconnected.fetch_add(1,
+                                                  std::memory_order_relaxed);
+                close();
+                return;
+            }
+        }
+        message_type m;
+        encode_header(m.head,
+                      rpc_header{static_cast<uint32_t>(msg->size()), 0,
+                                 request_type::sub_pub, 0, 0, 0});
+        m.shared = std::move(msg);
+        write_queue_.emplace_back(std::move(m));
+        ++pub_queued_;
+        m_hubPtr_->delivered.fetch_add(1, std::memory_order_relaxed);
+        if (!is_write_) {
+            is_write_ = true;
+            write();
+        }
+    }
+
+    // 握手：记录客户端支持的帧标志，回复本端支持的帧标志
+    void handshake(std::uint64_t reqid, const char *body, std::size_t size) {
+        peer_flags_ = size > 0 ? static_cast<uint8_t>(body[0]) : 0;
+        auto buf = m_buffersPtr_->acquire();
+        char flags = static_cast<char>(FRAME_FLAT | FRAME_COMPRESSED);
+        buf->write(&flags, 1);
+        response(reqid, std::move(buf), request_type::handshake, 0, false);
+    }
+
+    // 处理信息，路由调用函数；请求体只解析一次，处理函数直接使用解析结果。
+    // method_id非0时按id查扁平表，请求体只含参数；否则第一个元素为函数名
+    void route(std::uint64_t reqid, uint32_t method_id, deadline_type deadline,
+               const char *data, std::size_t size,
+               const recv_buffer::chunk_ptr &owner) {
         std::string result;
-        std::uint64_t reqid = req_id_;
-
-        RPCbufferPack::msgpack_codec codec;
-        std::tuple<std::string> p =
-            codec.unpack<std::tuple<std::string>>(data, size);
-        // 得到函数名
-        std::string func_name = std::get<0>(p);
-
-        auto it = m_sharedMapPtr_->find(func_name);
-        if (it == m_sharedMapPtr_->end()) {
-            result = codec.pack_args_str(result_code::FAIL,
-                                         "unknown function: " + func_name);
+        msgpack::object req;
+        zone_->clear();
+        try {
+            req = RPCbufferPack::msgpack_codec::unpack_object(*zone_, data,
+                                                              size);
+        } catch (const std::invalid_argument &e) {
+            response(reqid, RPCbufferPack::msgpack_codec::pack_args_str(
+                                result_code::FAIL, e.what()));
+            return;
+        }
+        if (req.type != msgpack::type::ARRAY) {
+            response(reqid, RPCbufferPack::msgpack_codec::pack_args_str(
+                                result_code::FAIL, "invalid request"));
+            return;
+        }
+
+        std::string error;
+        msgpack::object_array params = req.via.array;
+        const handler_entry *entry = find_handler(method_id, params, error);
+
+        if (entry == nullptr) {
+            // 写回错误信息
+            result = RPCbufferPack::msgpack_codec::pack_args_str(
+                result_code::FAIL, error);
+        } else if (entry->policy == exec_policy::offload && m_poolPtr_ &&
+                   m_poolPtr_->running()) {
+            // 投递到处理函数线程池，任务持有解析结果所在的zone和帧数据所在的块，
+            // 连接换用空闲的zone和块继续处理，帧数据不拷贝；结果回到strand_写回
+            auto self = this->shared_from_this();
+            offloaded_.fetch_add(1, std::memory_order_relaxed);
+            // 排队期间过了期限的请求直接丢弃，排队过久的请求以过载拒绝
+            bool posted = m_poolPtr_->try_post(
+                [self, entry, reqid, params, deadline, queued = enqueue_time(),
+                 zone = zone_, owner]() {
+                    if (deadline_expired(deadline)) {
+                        self->release();
+                    } else if (self->m_admissionPtr_->queued_too_long(queued)) {
+                        self->post_response(
+                            reqid, RPCbufferPack::msgpack_codec::pack_args_str(
+                                       result_code::OVERLOADED,
+                                       "server overloaded"));
+                    } else {
+                        self->invoke(*entry, reqid, params);
+                    }
+                    self->offloaded_.fetch_sub(1, std::memory_order_relaxed);
+                });
+            if (posted) {
+                zone_ = spare_zone();
+                return;
+            }
+            offloaded_.fetch_sub(1, std::memory_order_relaxed);
+            result = RPCbufferPack::msgpack_codec::pack_args_str(
+                result_code::OVERLOADED, "server busy: handler queue is full");
         } else {
-            // 调用函数
-            it->second(data, size, result);
+            invoke(*entry, reqid, params);
+            return;
         }
         // 写回操作
-        response(req_id_, std::move(result));
+        response(reqid, std::move(result));
+    }
+
+    // 处理平坦编码的请求：参数区直接交给处理函数按内存布局拷出，不经过msgpack解析；
+    // 函数不支持平坦编码或两端类型签名不一致时返回错误
+    void route_flat(std::uint64_t reqid, uint32_t method_id,
+                    deadline_type deadline, const char *data, std::size_t size,
+                    const recv_buffer::chunk_ptr &owner) {
+        std::string_view name;
+        uint32_t signature = 0;
+        const char *args = nullptr;
+        size_t args_len = 0;
+        std::string error;
+        const handler_entry *entry = nullptr;
+        if (!RPCbufferPack::flat_codec::parse_request(data, size, name,
+                                                      signature, args,
+                                                      args_len)) {
+            error = "invalid request";
+        } else if (method_id != 0) {
+            entry = m_sharedMapPtr_->find(method_id);
+            if (entry == nullptr) {
+                error = "unknown method id: " + std::to_string(method_id);
+            }
+        } else {
+            entry = m_sharedMapPtr_->find(name);
+            if (entry == nullptr) {
+                error = "unknown function: " + std::string(name);
+            }
+        }
+        if (entry != nullptr && entry->stream) {
+            error = "stream function requires a stream call";
+        } else if (entry != nullptr && !entry->flat) {
+            error = "codec mismatch: function does not support flat codec";
+        } else if (entry != nullptr && entry->flat_signature != signature) {
+            error = "codec mismatch: argument or result types differ";
+        }
+        if (!error.empty()) {
+            response(reqid, error_buffer(FRAME_FLAT, result_code::FAIL, error),
+                     request_type::req_res, FRAME_FLAT);
+            return;
+        }
+
+        if (entry->policy == exec_policy::offload && m_poolPtr_ &&
+            m_poolPtr_->running()) {
+            // 任务持有帧数据所在的块，参数区不拷贝
+            auto self = this->shared_from_this();
+            offloaded_.fetch_add(1, std::memory_order_relaxed);
+            bool posted = m_poolPtr_->try_post(
+                [self, entry, reqid, args, args_len, deadline,
+                 queued = enqueue_time(), owner]() {
+                    if (deadline_expired(deadline)) {
+                        self->release();
+                    } else if (self->m_admissionPtr_->queued_too_long(queued)) {
+                        self->post_response(
+                            reqid,
+                            self->error_buffer(FRAME_FLAT,
+                                               result_code::OVERLOADED,
+                                               "server overloaded"),
+                            request_type::req_res, FRAME_FLAT);
+                    } else {
+                        self->invoke_flat(*entry, reqid, args, args_len);
+                    }
+                    self->offloaded_.fetch_sub(1, std::memory_order_relaxed);
+                });
+            if (!posted) {
+                offloaded_.fetch_sub(1, std::memory_order_relaxed);
+                response(reqid,
+                         error_buffer(FRAME_FLAT, result_code::OVERLOADED,
+                                      "server busy: handler queue is full"),
+                         request_type::req_res, FRAME_FLAT);
+            }
+            return;
+        }
+        invoke_flat(*entry, reqid, args, args_len);
+    }
+
+    // 执行平坦编码的处理函数，可能在io线程或处理函数线程池中调用
+    void invoke_flat(const handler_entry &entry, std::uint64_t reqid,
+                     const char *args, size_t args_len) {
+        auto result = m_buffersPtr_->acquire();
+        entry.flat(args, args_len, *result);
+        if (strand_.running_in_this_thread()) {
+            response(reqid, std::move(result), request_type::req_res,
+                     FRAME_FLAT);
+        } else {
+            post_response(reqid, std::move(result), request_type::req_res,
+                          FRAME_FLAT);
+        }
+    }
+
+    // 按请求的编码打包错误应答
+    buffer_pool::buffer_ptr error_buffer(uint8_t flags, result_code code,
+                                         const std::string &error) {
+        auto buf = m_buffersPtr_->acquire();
+        if (flags & FRAME_FLAT) {
+            RPCbufferPack::flat_codec::pack_error(*buf, code, error);
+        } else {
+            RPCbufferPack::msgpack_codec::pack_args_to(*buf, code, error);
+        }
+        return buf;
+    }
+
+    // 处理流式请求：请求体为[初始窗口u32]加上与普通调用相同的msgpack数组。
+    // 流式函数会阻塞等待窗口，总是在处理函数线程池中执行；整个流占用一个在途名额，
+    // 并计入offloaded_，进行中的流不会被当作空闲连接断开
+    void route_stream(std::uint64_t reqid, uint32_t method_id, const char *data,
+                      std::size_t size, const recv_buffer::chunk_ptr &owner) {
+        uint32_t window = 0;
+        msgpack::object req;
+        zone_->clear();
+        if (size < 4) {
+            stream_error(reqid, result_code::FAIL, "invalid stream request");
+            return;
+        }
+        memcpy(&window, data, 4);
+        try {
+            req = RPCbufferPack::msgpack_codec::unpack_object(*zone_, data + 4,
+                                                              size - 4);
+        } catch (const std::invalid_argument &e) {
+            stream_error(reqid, result_code::FAIL, e.what());
+            return;
+        }
+        if (req.type != msgpack::type::ARRAY) {
+            stream_error(reqid, result_code::FAIL, "invalid stream request");
+            return;
+        }
+        std::string error;
+        msgpack::object_array params = req.via.array;
+        const handler_entry *entry =
+            find_handler(method_id, params, error, true);
+        if (entry == nullptr) {
+            stream_error(reqid, result_code::FAIL, error);
+            return;
+        }
+        if (!m_poolPtr_ || !m_poolPtr_->running()) {
+            stream_error(reqid, result_code::FAIL,
+                         "stream functions need a handler pool");
+            return;
+        }
+        // 窗口至少为1，否则流无法推进
+        auto state = std::make_shared<stream_state>(window == 0 ? 1 : window);
+        // 先登记再投递，cancel_streams()总能看到已开始执行的流
+        add_stream(reqid, state);
+        auto self = this->shared_from_this();
+        offloaded_.fetch_add(1, std::memory_order_relaxed);
+        bool posted = m_poolPtr_->try_post(
+            [self, entry, reqid, params, state, zone = zone_, owner]() {
+                self->run_stream(*entry, reqid, params, state);
+            });
+        if (!posted) {
+            offloaded_.fetch_sub(1, std::memory_order_relaxed);
+            remove_stream(reqid);
+            stream_error(reqid, result_code::OVERLOADED,
+                         "server busy: handler queue is full");
+            return;
+        }
+        zone_ = spare_zone();
+    }
+
+    // 在处理函数线程池中执行流式函数，结束后回到strand_发送结束帧或错误帧
+    void run_stream(const handler_entry &entry, std::uint64_t reqid,
+                    const msgpack::object_array &params,
+                    const std::shared_ptr<stream_state> &state) {
+        auto self = this->shared_from_this();
+        auto buf = m_buffersPtr_->acquire();
+        {
+            stream_writer writer(self, reqid, state);
+            try {
+                entry.stream(params, writer);
+                char kind = static_cast<char>(stream_frame::end);
+                buf->write(&kind, 1);
+            } catch (const std::exception &e) {
+                pack_stream_error(*buf, result_code::FAIL, e.what());
+            }
+        }
+        boost::asio::post(strand_, [self, reqid, state,
+                                    b = std::move(buf)]() mutable {
+            self->remove_stream(reqid);
+            self->offloaded_.fetch_sub(1, std::memory_order_relaxed);
+            // 等待窗口过久，以错误帧结束
+            result_code code;
+            std::string error;
+            if (state->failed(code, error)) {
+                self->stream_error(reqid, code, error);
+                return;
+            }
+            // 客户端已取消或连接已断开，不再发送结束帧
+            if (state->is_cancelled()) {
+                self->release();
+                return;
+            }
+            self->response(reqid, std::move(b), request_type::stream);
+        });
+    }
+
+    // 写出一个流式结果帧，由stream_writer在处理函数线程池中调用
+    void post_stream_frame(std::uint64_t reqid, buffer_pool::buffer_ptr buf) {
+        boost::asio::post(strand_, [self = this->shared_from_this(), reqid,
+                                    b = std::move(buf)]() mutable {
+            // 结果帧不占名额，名额随结束帧释放
+            self->response(reqid, std::move(b), request_type::stream, 0,
+                           false);
+        });
+    }
+
+    // 流控帧：消息体为授予的窗口u32，0表示客户端取消
+    void stream_control(std::uint64_t reqid, const char *body,
+                        std::size_t size) {
+        if (size < 4) {
+            return;
+        }
+        std::shared_ptr<stream_state> state;
+        {
+            std::unique_lock<std::mutex> lock(streams_mtx_);
+            auto it = streams_.find(reqid);
+            if (it == streams_.end()) {
+                return;
+            }
+            state = it->second;
+        }
+        uint32_t credits = 0;
+        memcpy(&credits, body, 4);
+        if (credits == 0) {
+            state->cancel();
+        } else {
+            state->grant(credits);
+        }
+    }
+
+    // 登记进行中的流，已调用cancel_streams()时立即取消
+    void add_stream(std::uint64_t reqid,
+                    const std::shared_ptr<stream_state> &state) {
+        std::unique_lock<std::mutex> lock(streams_mtx_);
+        streams_[reqid] = state;
+        if (streams_cancelled_) {
+            state->cancel();
+        }
+    }
+
+    // 流结束或未能开始时删除
+    void remove_stream(std::uint64_t reqid) {
+        std::unique_lock<std::mutex> lock(streams_mtx_);
+        streams_.erase(reqid);
+    }
+
+    // 流在开始之前失败或等待窗口过久，以错误帧结束；
+    // admitted为false表示准入前就拒绝的流，其应答不占名额
+    void stream_error(std::uint64_t reqid, result_code code,
+                      const std::string &error, bool admitted = true) {
+        auto buf = m_buffersPtr_->acquire();
+        pack_stream_error(*buf, code, error);
+        response(reqid, std::move(buf), request_type::stream, 0, admitted);
+    }
+
+    static void pack_stream_error(buffer_type &buf, result_code code,
+                                  const std::string &error) {
+        char kind = static_cast<char>(stream_frame::error);
+        buf.write(&kind, 1);
+        RPCbufferPack::msgpack_codec::pack_args_to(buf, code, error);
+    }
+
+    // 占用连接和服务端的在途名额，未配置上限时不计数
+    bool admit() {
+        if (!m_admissionPtr_->limited()) {
+            return true;
+        }
+        if (m_admissionPtr_->max_conn_inflight != 0 &&
+            inflight_.load(std::memory_order_relaxed) >=
+                m_admissionPtr_->max_conn_inflight) {
+            return false;
+        }
+        if (!m_admissionPtr_->try_acquire()) {
+            return false;
+        }
+        inflight_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // 释放一个在途名额，可能在处理函数线程池中调用
+    void release() {
+        if (!m_admissionPtr_->limited()) {
+            return;
+        }
+        inflight_.fetch_sub(1, std::memory_order_relaxed);
+        m_admissionPtr_->release();
+    }
+
+    // 投递到线程池时记录排队起点，未配置排队时间上限时不取时间
+    deadline_type enqueue_time() const {
+        return m_admissionPtr_->max_queue_delay.count() != 0
+                   ? std::chrono::steady_clock::now()
+                   : deadline_type();
+    }
+
+    // 查找处理函数：method_id非0时按id查找，否则取params的第一个元素为函数名
+    // 并从params中去掉；找不到时返回nullptr并给出错误信息。
+    // stream指定查找流式函数还是普通函数，两者不能互相调用
+    const handler_entry *find_handler(uint32_t method_id,
+                                      msgpack::object_array &params,
+                                      std::string &error,
+                                      bool stream = false) const {
+        if (method_id != 0) {
+            const handler_entry *entry = m_sharedMapPtr_->find(method_id);
+            if (entry == nullptr) {
+                error = "unknown method id: " + std::to_string(method_id);
+            }
+            return msgpack_entry(entry, error, stream);
+        }
+        if (params.size == 0 || params.ptr[0].type != msgpack::type::STR) {
+            error = "invalid request";
+            return nullptr;
+        }
+        // 得到函数名，直接引用解析结果
+        std::string_view func_name(params.ptr[0].via.str.ptr,
+                                   params.ptr[0].via.str.size);
+        params.ptr++;
+        params.size--;
+        const handler_entry *entry = m_sharedMapPtr_->find(func_name);
+        if (entry == nullptr) {
+            error = "unknown function: " + std::string(func_name);
+        }
+        return msgpack_entry(entry, error, stream);
+    }
+
+    // 只登记了平坦编码处理的函数不接受msgpack编码的请求
+    static const handler_entry *msgpack_entry(const handler_entry *entry,
+                                              std::string &error, bool stream) {
+        if (entry == nullptr) {
+            return nullptr;
+        }
+        if (stream != static_cast<bool>(entry->stream)) {
+            error = stream ? "not a stream function"
+                           : "stream function requires a stream call";
+            return nullptr;
+        }
+        if (!stream && !entry->sync && !entry->async) {
+            error = "codec mismatch: function only supports flat codec";
+            return nullptr;
+        }
+        return entry;
+    }
+
+    // 批量请求的执行状态，所有项完成后按顺序合并为一个应答
+    struct batch_state {
+        explicit batch_state(size_t n) : results(n), remaining(n) {}
+
+        std::uint64_t reqid = 0;
+        deadline_type deadline = deadline_type::max();
+        std::vector<buffer_pool::buffer_ptr> results; // 各项已打包的结果
+        std::atomic<size_t> remaining;                // 未完成的项数
+        std::shared_ptr<msgpack::zone> zone;          // 解析结果所在的zone
+        recv_buffer::chunk_ptr owner;                 // 帧数据所在的块
+    };
+
+    // 处理批量请求：请求体为数组，每项为[方法id或函数名, 参数...]。
+    // inline_io的项在io线程上依次执行，offload的项投递到线程池并行执行；
+    // 应答体为数组，每项与单个调用的应答相同，带各自的状态码
+    void route_batch(std::uint64_t reqid, deadline_type deadline,
+                     const char *data, std::size_t size,
+                     const recv_buffer::chunk_ptr &owner) {
+        msgpack::object req;
+        zone_->clear();
+        try {
+            req = RPCbufferPack::msgpack_codec::unpack_object(*zone_, data,
+                                                              size);
+        } catch (const std::invalid_argument &e) {
+            response(reqid,
+                     RPCbufferPack::msgpack_codec::pack_args_str(
+                         result_code::FAIL, e.what()),
+                     request_type::batch);
+            return;
+        }
+        if (req.type != msgpack::type::ARRAY) {
+            response(reqid,
+                     RPCbufferPack::msgpack_codec::pack_args_str(
+                         result_code::FAIL, "invalid batch request"),
+                     request_type::batch);
+            return;
+        }
+
+        const msgpack::object_array &items = req.via.array;
+        auto state = std::make_shared<batch_state>(items.size);
+        state->reqid = reqid;
+        state->deadline = deadline;
+        state->zone = zone_;
+        state->owner = owner;
+        if (items.size == 0) {
+            complete_batch(*state);
+            return;
+        }
+
+        auto self = this->shared_from_this();
+        for (uint32_t i = 0; i < items.size; ++i) {
+            const msgpack::object &item = items.ptr[i];
+            std::string error = "invalid request";
+            const handler_entry *entry = nullptr;
+            msgpack::object_array params{};
+            if (item.type == msgpack::type::ARRAY && item.via.array.size > 0) {
+                params = item.via.array;
+                uint32_t method_id = 0;
+                if (params.ptr[0].type == msgpack::type::POSITIVE_INTEGER) {
+                    method_id = static_cast<uint32_t>(params.ptr[0].via.u64);
+                    params.ptr++;
+                    params.size--;
+                }
+                entry = find_handler(method_id, params, error);
+            }
+
+            if (entry == nullptr) {
+                state->results[i] = to_buffer(
+                    RPCbufferPack::msgpack_codec::pack_args_str(
+                        result_code::FAIL, error));
+                finish_item(state);
+            } else if (entry->policy == exec_policy::offload && m_poolPtr_ &&
+                       m_poolPtr_->running()) {
+                bool posted = m_poolPtr_->try_post(
+                    [self, entry, state, i, params, queued = enqueue_time()]() {
+                        if (self->m_admissionPtr_->queued_too_long(queued)) {
+                            state->results[i] = self->to_buffer(
+                                RPCbufferPack::msgpack_codec::pack_args_str(
+                                    result_code::OVERLOADED,
+                                    "server overloaded"));
+                            self->finish_item(state);
+                        } else {
+                            self->invoke_item(*entry, state, i, params);
+                        }
+                    });
+                if (!posted) {
+                    state->results[i] = to_buffer(
+                        RPCbufferPack::msgpack_codec::pack_args_str(
+                            result_code::OVERLOADED,
+                            "server busy: handler queue is full"));
+                    finish_item(state);
+                }
+            } else {
+                invoke_item(*entry, state, i, params);
+            }
+        }
+        // 仍有项在其他线程执行，zone_随state保留，换用空闲的zone
+        if (state->remaining.load(std::memory_order_acquire) != 0) {
+            zone_ = spare_zone();
+        }
+    }
+
+    // 执行批量请求中的一项，可能在io线程或处理函数线程池中调用
+    void invoke_item(const handler_entry &entry,
+                     const std::shared_ptr<batch_state> &state, size_t index,
+                     const msgpack::object_array &params) {
+        // 过了期限的项不再执行
+        if (deadline_expired(state->deadline)) {
+            state->results[index] =
+                to_buffer(RPCbufferPack::msgpack_codec::pack_args_str(
+                    result_code::FAIL, "deadline exceeded"));
+            finish_item(state);
+            return;
+        }
+        if (entry.async) {
+            auto self = this->shared_from_this();
+            entry.async(params, [self, state, index](std::string result) {
+                state->results[index] = self->to_buffer(result);
+                self->finish_item(state);
+            });
+            return;
+        }
+        auto result = m_buffersPtr_->acquire();
+        entry.sync(params, *result);
+        state->results[index] = std::move(result);
+        finish_item(state);
+    }
+
+    // 完成一项，最后一项完成时合并应答
+    void finish_item(const std::shared_ptr<batch_state> &state) {
+        if (state->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            complete_batch(*state);
+        }
+    }
+
+    // 各项结果已是打包好的msgpack对象，加上数组头直接拼接
+    void complete_batch(batch_state &state) {
+        auto buf = m_buffersPtr_->acquire();
+        msgpack::packer<buffer_type>(*buf).pack_array(
+            static_cast<uint32_t>(state.results.size()));
+        for (auto &r : state.results) {
+            buf->write(r->data(), r->size());
+            r.reset();
+        }
+        if (strand_.running_in_this_thread()) {
+            response(state.reqid, std::move(buf), request_type::batch);
+        } else {
+            post_response(state.reqid, std::move(buf), request_type::batch);
+        }
+    }
+
+    // 执行处理函数，可能在io线程或处理函数线程池中调用
+    void invoke(const handler_entry &entry, std::uint64_t reqid,
+                const msgpack::object_array &params) {
+        auto self = this->shared_from_this();
+        if (entry.async) {
+            // 协程处理函数可能在其他线程完成
+            entry.async(params, [self, reqid](std::string result) {
+                self->post_response(reqid, std::move(result));
+            });
+            return;
+        }
+        // 结果直接打包进池中的缓冲区
+        auto result = m_buffersPtr_->acquire();
+        entry.sync(params, *result);
+        if (strand_.running_in_this_thread()) {
+            response(reqid, std::move(result));
+        } else {
+            post_response(reqid, std::move(result));
+        }
+    }
+
+    // 从其他线程写回，投递到本连接的strand_上执行
+    void post_response(std::uint64_t reqid, buffer_pool::buffer_ptr result,
+                       request_type req_type = request_type::req_res,
+                       uint8_t flags = 0) {
+        boost::asio::post(strand_, [self = this->shared_from_this(), reqid,
+                                    r = std::move(result), req_type,
+                                    flags]() mutable {
+            self->response(reqid, std::move(r), req_type, flags);
+        });
+    }
+
+    void post_response(std::uint64_t reqid, const std::string &result) {
+        post_response(reqid, to_buffer(result));
+    }
+
+    // 把已打包的字符串拷入池中的缓冲区
+    buffer_pool::buffer_ptr to_buffer(const std::string &data) {
+        auto buf = m_buffersPtr_->acquire();
+        buf->write(data.data(), data.size());
+        return buf;
+    }
+
+    // 换用一个没有被处理中的请求持有的zone，池中没有时新建
+    std::shared_ptr<msgpack::zone> spare_zone() {
+        for (auto &z : zones_) {
+            if (z != zone_ && z.use_count() == 1) {
+                // 与任务线程释放zone时的修改同步
+                std::atomic_thread_fence(std::memory_order_acquire);
+                return z;
+            }
+        }
+        auto z = std::make_shared<msgpack::zone>();
+        if (zones_.size() < MAX_SPARE_ZONES) {
+            zones_.push_back(z);
+        }
+        return z;
     }
 
     /*写回操作的系列函数*/
   private:
-    void response(uint64_t req_id, std::string data,
-                  request_type req_type = request_type::req_res) {
-        auto len = data.size();
+    // 写回结果，只在strand_上调用
+    // flags为应答的帧标志；admitted为false表示准入前就拒绝的请求，其应答不占名额
+    void response(uint64_t req_id, buffer_pool::buffer_ptr data,
+                  request_type req_type = request_type::req_res,
+                  uint8_t flags = 0, bool admitted = true) {
+        // 对端支持时压缩超过阈值的消息体
+        if ((peer_flags_ & FRAME_COMPRESSED) &&
+            m_compressionPtr_->should_compress(data->size())) {
+            auto packed = m_buffersPtr_->acquire();
+            if (m_compressionPtr_->compress(data->data(), data->size(),
+                                            *packed)) {
+                data = std::move(packed);
+                flags |= FRAME_COMPRESSED;
+            }
+        }
+        auto len = data->size();
         assert(len < MAX_BUF_LEN);
 
-        // async_write
-        // 不能同时写两次，保证第一次写完再写第二次，否则会乱码，这也是write_queue_的作用
-        {
-            std::unique_lock<std::mutex> lock(write_mtx_);
-            write_queue_.emplace_back(
-                message_type{req_id, req_type,
-                             std::make_shared<std::string>(std::move(data))});
-        }
+        // 不能同时写两次，正在发送时只入队，由发送完成的回调继续发送
+        message_type msg;
+        encode_header(msg.head, rpc_header{static_cast<uint32_t>(len), req_id,
+                                           req_type, 0, 0, flags});
+        msg.content = std::move(data);
+        msg.admitted = admitted;
+        write_queue_.emplace_back(std::move(msg));
 
         if (!is_write_) {
-            {
-                std::unique_lock<std::mutex> lock(write_mtx_);
-                is_write_ = true;
-                write();
-            }
+            is_write_ = true;
+            write();
         }
     }
 
+    void response(uint64_t req_id, const std::string &data,
+                  request_type req_type = request_type::req_res) {
+        response(req_id, to_buffer(data), req_type);
+    }
+
+    // 把队列中的消息聚合为一次gather写，受消息数和字节数限制
     void write() {
-        auto &msg = write_queue_.front();
-        uint32_t sendsz = msg.content->size();
-        std::array<boost::asio::const_buffer, 4> write_buffers;
-        write_buffers[0] = boost::asio::buffer(&sendsz, sizeof(uint32_t));
-        write_buffers[1] = boost::asio::buffer(&msg.req_id, sizeof(uint64_t));
-        write_buffers[2] =
-            boost::asio::buffer(&msg.req_type, sizeof(request_type));
-        write_buffers[3] = boost::asio::buffer(msg.content->data(), sendsz);
+        size_t bytes = 0;
+        size_t n = 0;
+        while (n < write_queue_.size() && n < MAX_WRITE_BATCH &&
+               (n == 0 || bytes < MAX_WRITE_BYTES)) {
+            bytes += HEAD_LEN + write_queue_[n].size();
+            if (write_queue_[n].shared) {
+                --pub_queued_;
+            }
+            sending_.emplace_back(std::move(write_queue_[n]));
+            ++n;
+        }
+        // 队列用vector保留容量，稳定后入队出队不再分配内存
+        write_queue_.erase(write_queue_.begin(), write_queue_.begin() + n);
+
+        write_buffers_.clear();
+        for (auto &msg : sending_) {
+            write_buffers_.emplace_back(boost::asio::buffer(msg.head, HEAD_LEN));
+            write_buffers_.emplace_back(
+                boost::asio::buffer(msg.data(), msg.size()));
+        }
 
         auto self = this->shared_from_this();
         boost::asio::async_write(
-            socket_, write_buffers,
-            [this, self](boost::system::error_code ec, std::size_t length) {
-                if (!ec) {
-                    std::cout
-                        << "Write completed. Bytes transferred: " << length
-                        << std::endl;
-                }
-                do_write(ec, length);
-            });
+            socket_, write_buffers_,
+            boost::asio::bind_executor(
+                strand_, [this, self](boost::system::error_code ec,
+                                      std::size_t length) {
+                    do_write(ec, length);
+                }));
     }
 
     void do_write(boost::system::error_code ec, std::size_t length) {
+        if (!ec) {
+            for (auto &msg : sending_) {
+                if (msg.admitted) {
+                    release();
+                }
+            }
+        }
+        sending_.clear();
         if (ec) {
             close();
             return;
@@ -233,8 +1726,6 @@ class connection : public std::enable_shared_from_this<connection>,
         if (has_closed()) {
             return;
         }
-        std::unique_lock<std::mutex> lock(write_mtx_);
-        write_queue_.pop_front();
         // 循环发送
         if (!write_queue_.empty()) {
             write();
@@ -244,22 +1735,70 @@ class connection : public std::enable_shared_from_this<connection>,
     }
 
   private:
-    // 重置定时器，回调函数为删除连接
-    void reset_timer() {
-        if (timeout_seconds_ == 0) {
+    // 加入时间轮，timeout_seconds_个空闲秒后检查
+    void watch_idle() {
+        if (m_wheelPtr_ == nullptr) {
             return;
         }
-        auto self(this->shared_from_this());
-        timer_.expires_from_now(std::chrono::seconds(timeout_seconds_));
-        timer_.async_wait([this, self](const boost::system::error_code &ec) {
-            if (has_closed()) {
+        // watch()先把时间轮追上实际时间，之后记录的时刻才是准确的
+        m_wheelPtr_->watch(this->weak_from_this(), idle_ticks_);
+        touch();
+    }
+
+    // 记录最近活动的时刻，只写入时间轮的当前tick，不操作定时器
+    void touch() {
+        if (m_wheelPtr_ != nullptr) {
+            last_active_.store(m_wheelPtr_->now(), std::memory_order_relaxed);
+        }
+    }
+
+    // 时间轮到期时在io线程上调用，返回下次检查的tick，0表示不再检查
+    uint64_t check_idle(uint64_t now) {
+        if (has_closed_) {
+            return 0;
+        }
+        uint64_t deadline =
+            last_active_.load(std::memory_order_relaxed) + idle_ticks_;
+        if (deadline > now) {
+            return deadline;
+        }
+        // 处理中的请求和进行中的流不算空闲，避免处理过程中超时断开连接
+        if (offloaded_.load(std::memory_order_relaxed) > 0 ||
+            inflight_.load(std::memory_order_relaxed) > 0) {
+            return now + idle_ticks_;
+        }
+        boost::asio::post(strand_, [self = this->shared_from_this()] {
+            if (self->has_closed()) {
                 return;
             }
-            if (ec) {
+            uint64_t deadline =
+                self->last_active_.load(std::memory_order_relaxed) +
+                self->idle_ticks_;
+            uint64_t now = self->m_wheelPtr_->now();
+            if (deadline > now) {
+                // 投递期间又收到了数据
+                self->m_wheelPtr_->watch(self->weak_from_this(), deadline - now);
                 return;
             }
-            close();
+            // 只接收发布消息的订阅者不发送数据，有订阅时不算空闲
+            if (!self->topics_.empty()) {
+                self->m_wheelPtr_->watch(self->weak_from_this(),
+                                         self->idle_ticks_);
+                return;
+            }
+            self->close();
         });
+        return 0;
+    }
+
+    // 取消所有进行中的流，唤醒等待窗口的流式函数，之后开始的流也立即取消；
+    // 多线程安全，server析构时在io线程停止后调用
+    void cancel_streams() {
+        std::unique_lock<std::mutex> lock(streams_mtx_);
+        streams_cancelled_ = true;
+        for (auto &s : streams_) {
+            s.second->cancel();
+        }
     }
 
     // 断开当前连接
@@ -267,43 +1806,100 @@ class connection : public std::enable_shared_from_this<connection>,
         if (has_closed_) {
             return;
         }
-        boost::system::error_code ignored_ec;
-        socket_.shutdown(boost::asio::ip::tcp::socket::shutdown_both,
-                         ignored_ec);
-        socket_.close(ignored_ec);
+        socket_.close();
         has_closed_ = true;
-    }
-
-    // 取消定时器
-    void cancel_timer() {
-        // 一般调用处理函数的时候使用，避免调用过程中连接断开
-        if (timeout_seconds_ == 0) {
-            return;
+        // 唤醒等待窗口的流式函数
+        cancel_streams();
+        // 退订所有主题
+        for (auto &t : topics_) {
+            m_hubPtr_->unsubscribe(t, this);
+        }
+        topics_.clear();
+        // 从连接表删除，时间轮中的条目到期时自然丢弃；
+        // 未加入连接表的(握手失败、接受出错)不能删除别的连接
+        if (m_tablePtr_ && conn_id_ >= 0) {
+            m_tablePtr_->remove(conn_id_);
+            conn_id_ = -1;
         }
-        timer_.cancel();
     }
 
   private:
-    boost::asio::ip::tcp::socket socket_;
-    int64_t conn_id_ = 0;             // 连接类id
-    boost::asio::steady_timer timer_; // 定时器
+    rpc_socket socket_;
+    boost::asio::io_service::strand strand_; // 串行化本连接的所有回调
+    int64_t conn_id_ = -1;            // 连接类id，-1表示未加入连接表
     std::size_t timeout_seconds_;     // 超时时间
     bool has_closed_;                 // 连接断开标志
+    // 所在io线程的时间轮，超时时间为0时为空
+    idle_wheel_service<connection> *m_wheelPtr_ = nullptr;
+    uint64_t idle_ticks_ = 0;              // 超时时间对应的tick数
+    std::atomic<uint64_t> last_active_{0}; // 最近收到数据时时间轮的tick
 
-    // 存疑，以下变量在运行过程会随着同一个连接的多个请求而变换
-    char head_[HEAD_LEN];    // 消息头
-    std::vector<char> body_; // 消息体
-    std::uint64_t req_id_;   // 请求id
-    request_type req_type_;  // 请求类型
+    recv_buffer recv_;           // 接收缓冲区，一次读取可包含多个帧
+    deadline_type read_time_;    // 最近一次读取完成的时刻
+    recv_buffer::chunk_ptr body_; // 超过接收缓冲区的大消息体
 
-    std::mutex write_mtx_;
-    std::deque<message_type> write_queue_;
+    // 发送队列及正在发送的消息，只在strand_上访问；发送完成后消息体归还缓冲区池
+    std::vector<message_type> write_queue_;
+    std::vector<message_type> sending_;
+    std::vector<boost::asio::const_buffer> write_buffers_;
     bool is_write_ = false;
 
-    // 函数映射表指针-传输数据，数据长度，返回结果
-    std::shared_ptr<std::unordered_map<
-        std::string, std::function<void(const char *, size_t, std::string &)>>>
-        m_sharedMapPtr_;
+    // 请求解析所用的内存区，每个请求复用，offload时随任务转移并换用zones_中空闲的
+    std::shared_ptr<msgpack::zone> zone_ = std::make_shared<msgpack::zone>();
+    std::vector<std::shared_ptr<msgpack::zone>> zones_;
+
+    // 函数映射表指针
+    std::shared_ptr<handler_table> m_sharedMapPtr_;
+    // 处理函数线程池指针，未启动时全部在io线程执行
+    std::shared_ptr<thread_pool> m_poolPtr_;
+    // 应答缓冲区池指针，和server及其他connection共享
+    std::shared_ptr<buffer_pool> m_buffersPtr_;
+    // 准入控制，和server及其他connection共享
+    std::shared_ptr<admission_control> m_admissionPtr_;
+    std::atomic<size_t> inflight_{0}; // 本连接的在途请求数
+    std::atomic<size_t> offloaded_{0}; // 在处理函数线程池中排队或执行的请求数
+    // 压缩配置及统计，和server及其他connection共享
+    std::shared_ptr<frame_compression> m_compressionPtr_;
+    uint8_t peer_flags_ = 0; // 客户端在握手中表明支持的帧标志，只在strand_上访问
+    // 进行中的流，由streams_mtx_保护，server析构时会从其他线程取消
+    std::mutex streams_mtx_;
+    std::unordered_map<std::uint64_t, std::shared_ptr<stream_state>> streams_;
+    bool streams_cancelled_ = false;
+    // 发布订阅的主题表，和server及其他connection共享
+    std::shared_ptr<pubsub_hub> m_hubPtr_;
+    std::unordered_set<std::string> topics_; // 本连接订阅的主题，只在strand_上访问
+    size_t pub_queued_ = 0; // 发送队列中的发布消息数，只在strand_上访问
+    // server的连接表，关闭时从中删除自己
+    std::shared_ptr<connection_table> m_tablePtr_;
 };
 
+inline void connection_table::cancel_streams() {
+    // 在锁外操作连接：释放最后一个引用时连接析构，会回到remove()
+    std::vector<std::shared_ptr<connection>> live;
+    {
+        std::unique_lock<std::mutex> lock(mtx_);
+        live.reserve(conns_.size());
+        for (auto &c : conns_) {
+            if (auto p = c.second.lock()) {
+                live.push_back(std::move(p));
+            }
+        }
+    }
+    for (auto &c : live) {
+        c->cancel_streams();
+    }
+}
+
+template <typename T> bool stream_writer::write(const T &value) {
+    if (!state_->acquire(*conn_->m_admissionPtr_)) {
+        return false;
+    }
+    auto buf = conn_->m_buffersPtr_->acquire();
+    char kind = static_cast<char>(stream_frame::data);
+    buf->write(&kind, 1);
+    msgpack::pack(*buf, value);
+    conn_->post_stream_frame(reqid_, std::move(buf));
+    return true;
+}
+
 #endif
\ No newline at end of file
@@ -2,9 +2,15 @@
 #ifndef TINY_RPC_IO_SERVICE_POOL_H_
 #define TINY_RPC_IO_SERVICE_POOL_H_
 
+#include <atomic>
 #include <vector>
 #include <memory>
+#include <thread>
 #include <boost/asio.hpp>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 class io_service_pool : private boost::asio::noncopyable {
   public:
@@ -21,15 +27,35 @@ class io_service_pool : private boost::asio::noncopyable {
     }
 
     void run() {
-        // 把所有的io事件放进子线程进行监听
-        std::vector<std::shared_ptr<std::thread>> threads;
+        start();
+        join();
+    }
+
+    // 把所有的io事件放进子线程进行监听，立即返回
+    void start() {
         for (std::size_t i = 0; i < io_services_.size(); ++i) {
-            threads.emplace_back(std::make_shared<std::thread>(
-                [](io_service_ptr svr) { svr->run(); }, io_services_[i]));
+            int cpu = cpus_.empty() ? -1 : cpus_[i % cpus_.size()];
+            threads_.emplace_back(std::make_shared<std::thread>(
+                [cpu](io_service_ptr svr) {
+                    pin_to_cpu(cpu);
+                    svr->run();
+                },
+                io_services_[i]));
         }
+    }
+
+    // 第i个线程固定在cpus[i % cpus.size()]上运行，需在start()之前调用；为空时不固定
+    void set_cpu_affinity(std::vector<int> cpus) { cpus_ = std::move(cpus); }
 
-        for (std::size_t i = 0; i < threads.size(); ++i)
-            threads[i]->join();
+    const std::vector<int> &cpu_affinity() const { return cpus_; }
+
+    // 等待所有子线程退出
+    void join() {
+        for (std::size_t i = 0; i < threads_.size(); ++i) {
+            if (threads_[i]->joinable())
+                threads_[i]->join();
+        }
+        threads_.clear();
     }
 
     void stop() {
@@ -38,16 +64,35 @@ class io_service_pool : private boost::asio::noncopyable {
         }
     }
 
-    // 循环返回引用
+    // 循环返回引用，多线程安全
     boost::asio::io_service &get_io_service() {
-        boost::asio::io_service &io_service = *io_services_[next_io_service_];
-        ++next_io_service_;
-        if (next_io_service_ == io_services_.size())
-            next_io_service_ = 0;
-        return io_service;
+        std::size_t next =
+            next_io_service_.fetch_add(1, std::memory_order_relaxed);
+        return *io_services_[next % io_services_.size()];
+    }
+
+    // 第index个io_service，由第index个线程运行
+    boost::asio::io_service &get_io_service(std::size_t index) {
+        return *io_services_[index];
     }
 
+    std::size_t size() const { return io_services_.size(); }
+
   private:
+    static void pin_to_cpu(int cpu) {
+#ifdef __linux__
+        if (cpu < 0) {
+            return;
+        }
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+        (void)cpu;
+#endif
+    }
+
     typedef std::shared_ptr<boost::asio::io_service> io_service_ptr;
     typedef std::shared_ptr<boost::asio::io_service::work> work_ptr;
 
@@ -57,8 +102,14 @@ class io_service_pool : private boost::asio::noncopyable {
     // io_service::work 池，保证io_service一直能工作
     std::vector<work_ptr> work_;
 
-    // 下一个io_service的序号
-    std::size_t next_io_service_;
+    // 下一个io_service的序号，接受连接的线程和客户端并发取用
+    std::atomic<std::size_t> next_io_service_;
+
+    // 各线程固定运行的CPU
+    std::vector<int> cpus_;
+
+    // 运行io_service的子线程
+    std::vector<std::shared_ptr<std::thread>> threads_;
 };
 
 #endif
\ No newline at end of file
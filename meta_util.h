@@ -25,6 +25,9 @@ template <typename Ret, typename... Args> struct function_traits<Ret(Args...)> {
     using args_tuple =
         std::tuple<std::string,
                    std::remove_const_t<std::remove_reference_t<Args>>...>;
+    // 不含函数名的参数元组
+    using params_tuple =
+        std::tuple<std::remove_const_t<std::remove_reference_t<Args>>...>;
 };
 
 // 部分特化：第一个参数
@@ -37,6 +40,9 @@ struct function_traits<Ret(Arg, Args...)> {
     using args_tuple =
         std::tuple<std::string, Arg,
                    std::remove_const_t<std::remove_reference_t<Args>>...>;
+    using params_tuple =
+        std::tuple<remove_const_reference_t<Arg>,
+                   std::remove_const_t<std::remove_reference_t<Args>>...>;
 };
 
 // 部分特化：无参数
@@ -47,6 +53,7 @@ template <typename Ret> struct function_traits<Ret()> {
     using stl_function_type = std::function<Ret()>;
     using pointer = Ret (*)();
     using args_tuple = std::tuple<std::string>;
+    using params_tuple = std::tuple<>;
 };
 
 // 部分特化：函数指针
@@ -72,6 +79,12 @@ struct function_traits<ReturnType (ClassType::*)(Args...) const>
 template <typename Callable>
 struct function_traits : function_traits<decltype(&Callable::operator())> {};
 
+// 去掉元组的第一个元素
+template <typename Tuple> struct tuple_tail;
+template <typename T, typename... Ts> struct tuple_tail<std::tuple<T, Ts...>> {
+    using type = std::tuple<Ts...>;
+};
+
 template <int N, typename... Args>
 using nth_type_of = std::tuple_element_t<N, std::tuple<Args...>>;
 
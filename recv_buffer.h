@@ -0,0 +1,107 @@
+#pragma once
+#ifndef TINY_RPC_RECV_BUFFER_H_
+#define TINY_RPC_RECV_BUFFER_H_
+
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include <boost/asio.hpp>
+
+/*
+* 接收缓冲区
+ 一次读取尽可能多的数据，再从中依次取出所有完整的帧；
+ 未读完的尾部数据在下次读取前移动到缓冲区开头。
+ 数据存放在带引用计数的块中：交给其他线程处理的帧通过hold()持有所在的块，
+ 此时连接不会覆盖该块，而是换用池中另一个空闲块继续读取，帧数据无需拷贝。
+*/
+class recv_buffer {
+  public:
+    using chunk_ptr = std::shared_ptr<std::vector<char>>;
+
+    explicit recv_buffer(size_t capacity, size_t max_chunks = 4)
+        : capacity_(capacity), max_chunks_(max_chunks) {
+        cur_ = std::make_shared<std::vector<char>>(capacity_);
+        chunks_.push_back(cur_);
+    }
+
+    // 可读数据
+    const char *data() const { return cur_->data() + rpos_; }
+    size_t size() const { return wpos_ - rpos_; }
+    size_t capacity() const { return capacity_; }
+
+    // 持有当前块，使已读出的帧数据在处理完成前保持有效
+    const chunk_ptr &hold() const { return cur_; }
+
+    // 取出已处理的数据
+    void consume(size_t n) { rpos_ += n; }
+
+    // 丢弃所有未读数据，连接重建时使用
+    void clear() { rpos_ = wpos_; }
+
+    // 返回可写入的空间，必要时把未读数据移到开头或换用空闲块
+    boost::asio::mutable_buffer prepare() {
+        // 除连接和块池外还有持有者，说明块中的帧仍在处理，不能覆盖已读部分
+        bool shared = cur_.use_count() > (cur_pooled_ ? 2 : 1);
+        // 与其他线程释放块时的修改同步
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (rpos_ == wpos_) {
+            if (!shared) {
+                rpos_ = wpos_ = 0;
+            } else if (wpos_ == capacity_) {
+                switch_chunk();
+            }
+        } else if (wpos_ == capacity_ || rpos_ >= capacity_ / 2) {
+            if (!shared) {
+                size_t n = size();
+                memmove(cur_->data(), cur_->data() + rpos_, n);
+                rpos_ = 0;
+                wpos_ = n;
+            } else if (wpos_ == capacity_) {
+                switch_chunk();
+            }
+        }
+        return boost::asio::buffer(cur_->data() + wpos_, capacity_ - wpos_);
+    }
+
+    // 确认写入了n个字节
+    void commit(size_t n) { wpos_ += n; }
+
+  private:
+    // 换用一个没有其他持有者的块，把未读数据拷过去
+    void switch_chunk() {
+        chunk_ptr next;
+        for (auto &c : chunks_) {
+            if (c != cur_ && c.use_count() == 1) {
+                std::atomic_thread_fence(std::memory_order_acquire);
+                next = c;
+                break;
+            }
+        }
+        cur_pooled_ = true;
+        if (!next) {
+            next = std::make_shared<std::vector<char>>(capacity_);
+            // 超过上限的块不进池，处理完后自然释放
+            if (chunks_.size() < max_chunks_) {
+                chunks_.push_back(next);
+            } else {
+                cur_pooled_ = false;
+            }
+        }
+        size_t n = size();
+        memcpy(next->data(), cur_->data() + rpos_, n);
+        cur_ = std::move(next);
+        rpos_ = 0;
+        wpos_ = n;
+    }
+
+    size_t capacity_;
+    size_t max_chunks_;
+    chunk_ptr cur_;                // 当前读入的块
+    bool cur_pooled_ = true;       // 当前块是否在块池中
+    std::vector<chunk_ptr> chunks_; // 块池
+    size_t rpos_ = 0;              // 读位置
+    size_t wpos_ = 0;              // 写位置
+};
+
+#endif
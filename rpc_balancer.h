@@ -0,0 +1,286 @@
+#pragma once
+#ifndef TINY_RPC_BALANCER_H_
+#define TINY_RPC_BALANCER_H_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "rpc_client.h"
+#include "io_service_pool.h"
+
+// 负载均衡策略
+enum class lb_policy : uint8_t {
+    round_robin,     // 依次轮转
+    power_of_two,    // 随机取两个节点，选未完成请求少的
+    consistent_hash, // 按调用方给出的key做一致性哈希，相同key落在同一节点
+};
+
+// 服务端地址，host也可以是uri，见endpoint_uri
+struct rpc_endpoint {
+    std::string host;
+    unsigned short port;
+};
+
+/*
+* 多节点负载均衡客户端
+ 对每个服务端节点保持一条连接，按策略选择节点，调用接口与rpc_client相同；
+ 一致性哈希策略通过call_by_key()等接口指定key。
+ 连接失败或断开的节点被摘除，后台线程定期尝试重连，成功后重新加入。
+*/
+class rpc_balancer : private boost::asio::noncopyable {
+  public:
+    // 每个节点在哈希环上的虚拟节点数
+    static const size_t VIRTUAL_NODES = 100;
+
+    // io_threads：io线程数；probe_seconds：重连被摘除节点的间隔
+    rpc_balancer(const std::vector<rpc_endpoint> &endpoints,
+                 lb_policy policy = lb_policy::round_robin,
+                 size_t io_threads = 1, size_t probe_seconds = 1)
+        : io_service_pool_(io_threads == 0 ? 1 : io_threads), policy_(policy),
+          probe_seconds_(probe_seconds) {
+        if (endpoints.empty()) {
+            throw std::invalid_argument("rpc_balancer endpoints is empty");
+        }
+        for (auto &ep : endpoints) {
+            clients_.emplace_back(std::make_unique<rpc_client>(
+                io_service_pool_.get_io_service(), ep.host, ep.port));
+        }
+        build_ring(endpoints);
+        io_service_pool_.start();
+    }
+
+    ~rpc_balancer() {
+        {
+            std::unique_lock<std::mutex> lock(probe_mtx_);
+            stop_probe_ = true;
+        }
+        probe_cv_.notify_all();
+        if (probe_thread_ && probe_thread_->joinable()) {
+            probe_thread_->join();
+        }
+        // 先停止io线程，保证连接析构后不再有回调执行
+        io_service_pool_.stop();
+        io_service_pool_.join();
+    }
+
+    // 连接所有节点并启动重连线程，至少一个节点连接成功时返回true
+    bool connect(size_t timeout = 3) {
+        bool any = false;
+        for (auto &c : clients_) {
+            any = c->connect(timeout) || any;
+        }
+        if (!probe_thread_) {
+            probe_thread_ =
+                std::make_shared<std::thread>([this] { this->probe(); });
+        }
+        return any;
+    }
+
+    // 节点数
+    size_t size() const { return clients_.size(); }
+
+    // 当前可用的节点数
+    size_t healthy() const {
+        size_t n = 0;
+        for (auto &c : clients_) {
+            n += c->has_connected() ? 1 : 0;
+        }
+        return n;
+    }
+
+    // 阻塞式调用，参数同rpc_client::call，可以在method前指定期限；
+    // 按构造时的策略选择节点，一致性哈希策略下按轮转选择
+    template <typename T, typename... Args>
+    T call(Args &&...args) {
+        return pick().template call<T>(std::forward<Args>(args)...);
+    }
+
+    // 非阻塞式调用，future式或回调式，见rpc_client::async_call
+    template <typename T, typename... Args>
+    auto async_call(Args &&...args) {
+        return pick().template async_call<T>(std::forward<Args>(args)...);
+    }
+
+    // 按key选择节点的调用，一致性哈希策略下相同key落在同一节点，
+    // 其他策略下忽略key
+    template <typename T, typename... Args>
+    T call_by_key(std::string_view key, Args &&...args) {
+        return pick(key).template call<T>(std::forward<Args>(args)...);
+    }
+
+    template <typename T, typename... Args>
+    auto async_call_by_key(std::string_view key, Args &&...args) {
+        return pick(key).template async_call<T>(std::forward<Args>(args)...);
+    }
+
+    // 批量调用，整批发往同一个节点
+    rpc_batch batch() { return pick().batch(); }
+
+    rpc_batch batch_by_key(std::string_view key) { return pick(key).batch(); }
+
+    // 流式调用，整个流在同一个节点上，见rpc_client::stream
+    template <typename T, typename... Args>
+    rpc_stream<T> stream(Args &&...args) {
+        return pick().template stream<T>(std::forward<Args>(args)...);
+    }
+
+    template <typename T, typename... Args>
+    rpc_stream<T> stream_by_key(std::string_view key, Args &&...args) {
+        return pick(key).template stream<T>(std::forward<Args>(args)...);
+    }
+
+#ifdef TINY_RPC_HAS_COROUTINE
+    // 协程式调用
+    template <typename T, typename... Args>
+    call_awaiter<T> co_call(Args &&...args) {
+        return pick().template co_call<T>(std::forward<Args>(args)...);
+    }
+#endif
+
+  private:
+    // 按策略选择可用节点，全部不可用时返回轮转到的节点，由其以BADCONNECTION结束调用
+    rpc_client &pick() {
+        if (policy_ == lb_policy::power_of_two) {
+            return pick_two();
+        }
+        return pick_round_robin();
+    }
+
+    rpc_client &pick(std::string_view key) {
+        if (policy_ == lb_policy::consistent_hash) {
+            return pick_hash(key);
+        }
+        return pick();
+    }
+
+    rpc_client &pick_round_robin() {
+        // 跳过被摘除节点时继续推进轮转序号，其份额均摊到其他节点而不是下一个节点
+        size_t n = clients_.size();
+        size_t start = next_.fetch_add(1, std::memory_order_relaxed) % n;
+        for (size_t i = 0; i < n; ++i) {
+            size_t idx =
+                i == 0 ? start
+                       : next_.fetch_add(1, std::memory_order_relaxed) % n;
+            rpc_client &c = *clients_[idx];
+            if (c.has_connected()) {
+                return c;
+            }
+        }
+        return *clients_[start];
+    }
+
+    // 随机取两个可用节点，选择未完成请求较少的一个
+    rpc_client &pick_two() {
+        size_t n = clients_.size();
+        if (n == 1) {
+            return *clients_[0];
+        }
+        thread_local std::minstd_rand rng(std::random_device{}());
+        size_t a = rng() % n;
+        size_t b = (a + 1 + rng() % (n - 1)) % n;
+        rpc_client &ca = *clients_[a];
+        rpc_client &cb = *clients_[b];
+        if (!ca.has_connected() || !cb.has_connected()) {
+            // 抽到被摘除的节点时退化为轮转
+            if (ca.has_connected()) {
+                return ca;
+            }
+            if (cb.has_connected()) {
+                return cb;
+            }
+            return pick_round_robin();
+        }
+        return ca.outstanding() <= cb.outstanding() ? ca : cb;
+    }
+
+    // 在哈希环上顺时针找到第一个可用节点，被摘除节点的key顺延到下一节点
+    rpc_client &pick_hash(std::string_view key) {
+        uint64_t h = hash_key(key);
+        auto it = std::lower_bound(
+            ring_.begin(), ring_.end(), h,
+            [](const ring_node &node, uint64_t v) { return node.hash < v; });
+        for (size_t i = 0; i < ring_.size(); ++i, ++it) {
+            if (it == ring_.end()) {
+                it = ring_.begin();
+            }
+            rpc_client &c = *clients_[it->index];
+            if (c.has_connected()) {
+                return c;
+            }
+        }
+        return pick_round_robin();
+    }
+
+    // 64位FNV-1a
+    static uint64_t hash_key(std::string_view key) {
+        uint64_t h = 14695981039346656037ull;
+        for (char c : key) {
+            h ^= static_cast<uint8_t>(c);
+            h *= 1099511628211ull;
+        }
+        // 末尾混合，使相近的key在环上分散
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        return h;
+    }
+
+    void build_ring(const std::vector<rpc_endpoint> &endpoints) {
+        for (size_t i = 0; i < endpoints.size(); ++i) {
+            std::string base =
+                endpoints[i].host + ":" + std::to_string(endpoints[i].port) + "#";
+            for (size_t v = 0; v < VIRTUAL_NODES; ++v) {
+                ring_.push_back(ring_node{hash_key(base + std::to_string(v)), i});
+            }
+        }
+        std::sort(ring_.begin(), ring_.end(),
+                  [](const ring_node &a, const ring_node &b) {
+                      return a.hash < b.hash;
+                  });
+    }
+
+    // 定期重连被摘除的节点
+    void probe() {
+        std::unique_lock<std::mutex> lock(probe_mtx_);
+        while (!stop_probe_) {
+            probe_cv_.wait_for(lock, std::chrono::seconds(probe_seconds_));
+            if (stop_probe_) {
+                break;
+            }
+            lock.unlock();
+            for (auto &c : clients_) {
+                if (!c->has_connected()) {
+                    c->connect(1);
+                }
+            }
+            lock.lock();
+        }
+    }
+
+  private:
+    struct ring_node {
+        uint64_t hash;
+        size_t index; // 节点在clients_中的序号
+    };
+
+    io_service_pool io_service_pool_;                  // io线程及其io_service
+    std::vector<std::unique_ptr<rpc_client>> clients_; // 每个节点一条连接
+    std::vector<ring_node> ring_;                      // 一致性哈希环
+    lb_policy policy_;
+    std::atomic<size_t> next_{0}; // 轮转序号
+
+    // 重连线程
+    std::shared_ptr<std::thread> probe_thread_;
+    size_t probe_seconds_;
+    bool stop_probe_ = false;
+    std::mutex probe_mtx_;
+    std::condition_variable probe_cv_;
+};
+
+#endif
@@ -5,27 +5,428 @@
 #include <boost/asio.hpp>
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <any>
+#include <deque>
+#include <set>
 #include <unordered_map>
 #include <future>
+#include <iterator>
 #include <condition_variable>
 #include "connection.h"
+#include "rpc_future.h"
+#include "rpc_task.h"
 
 const constexpr size_t DEFAULT_TIMEOUT = 5000; // milliseconds
+// 检查调用期限的间隔，期限的精度为该值
+const constexpr size_t DEADLINE_TICK_MS = 5;
+// 流的默认窗口，见rpc_client::set_stream_window()
+const constexpr uint32_t DEFAULT_STREAM_WINDOW = 16;
+
+// 服务端状态码对应的错误码
+inline error_code error_of(result_code code) {
+    switch (code) {
+    case result_code::OK:
+        return error_code::OK;
+    case result_code::OVERLOADED:
+        return error_code::OVERLOADED;
+    default:
+        return error_code::FAIL;
+    }
+}
+
+// 远程调用失败时抛出，携带错误码
+class rpc_error : public std::runtime_error {
+  public:
+    rpc_error(error_code ec, const std::string &msg)
+        : std::runtime_error(msg), ec_(ec) {}
+
+    error_code code() const { return ec_; }
+
+  private:
+    error_code ec_;
+};
+
+/*
+* 未完成请求表
+ 按req_id分片，每个请求持有自己的完成回调，
+ 响应到达时只唤醒对应的调用者，而不是通知所有等待线程。
+ 带期限的请求同时记入所在分片按期限排序的集合，与请求在同一把锁下登记，
+ 请求完成时一并删除；过期时以TIMEOUT结束并释放表项。
+*/
+class pending_calls : private boost::asio::noncopyable {
+  public:
+    // 完成回调：错误码，响应体
+    using callback_type = std::function<void(error_code, const char *, size_t)>;
+
+    explicit pending_calls(size_t shard_count = 16) {
+        // 分片数取2的幂，便于用掩码定位
+        size_t n = 1;
+        while (n < shard_count) {
+            n <<= 1;
+        }
+        shards_.reset(new shard[n]);
+        mask_ = n - 1;
+    }
+
+    // 登记请求，必须在请求发出之前调用；deadline为max()时不限期
+    void add(std::uint64_t req_id, callback_type cb,
+             deadline_type deadline = deadline_type::max()) {
+        auto &sd = shards_[req_id & mask_];
+        std::unique_lock<std::mutex> lock(sd.mtx);
+        sd.calls.emplace(req_id, call{std::move(cb), deadline});
+        if (deadline != deadline_type::max()) {
+            sd.deadlines.emplace(deadline, req_id);
+            timed_.fetch_add(1, std::memory_order_relaxed);
+        }
+        size_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // 以TIMEOUT结束所有已过期的请求；返回是否还有未到期的期限
+    bool expire(deadline_type now) {
+        std::vector<callback_type> expired;
+        for (size_t i = 0; i <= mask_; ++i) {
+            auto &sd = shards_[i];
+            std::unique_lock<std::mutex> lock(sd.mtx);
+            while (!sd.deadlines.empty() &&
+                   sd.deadlines.begin()->first <= now) {
+                auto it = sd.calls.find(sd.deadlines.begin()->second);
+                sd.deadlines.erase(sd.deadlines.begin());
+                expired.push_back(std::move(it->second.cb));
+                sd.calls.erase(it);
+                timed_.fetch_sub(1, std::memory_order_relaxed);
+                size_.fetch_sub(1, std::memory_order_relaxed);
+            }
+        }
+        // 回调在锁外执行
+        for (auto &cb : expired) {
+            cb(error_code::TIMEOUT, nullptr, 0);
+        }
+        return has_deadlines();
+    }
+
+    // 是否有未到期的期限
+    bool has_deadlines() const {
+        return timed_.load(std::memory_order_relaxed) != 0;
+    }
+
+    // 完成请求，回调在锁外执行；请求不存在返回false
+    bool complete(std::uint64_t req_id, error_code ec, const char *data,
+                  size_t size) {
+        callback_type cb;
+        {
+            auto &sd = shards_[req_id & mask_];
+            std::unique_lock<std::mutex> lock(sd.mtx);
+            auto it = sd.calls.find(req_id);
+            if (it == sd.calls.end()) {
+                return false;
+            }
+            if (it->second.deadline != deadline_type::max()) {
+                sd.deadlines.erase(std::make_pair(it->second.deadline, req_id));
+                timed_.fetch_sub(1, std::memory_order_relaxed);
+            }
+            cb = std::move(it->second.cb);
+            sd.calls.erase(it);
+            size_.fetch_sub(1, std::memory_order_relaxed);
+        }
+        cb(ec, data, size);
+        return true;
+    }
+
+    // 以错误码结束所有未完成请求，连接断开时使用
+    void cancel_all(error_code ec) {
+        for (size_t i = 0; i <= mask_; ++i) {
+            std::unordered_map<std::uint64_t, call> calls;
+            {
+                std::unique_lock<std::mutex> lock(shards_[i].mtx);
+                calls.swap(shards_[i].calls);
+                timed_.fetch_sub(shards_[i].deadlines.size(),
+                                 std::memory_order_relaxed);
+                shards_[i].deadlines.clear();
+                size_.fetch_sub(calls.size(), std::memory_order_relaxed);
+            }
+            for (auto &item : calls) {
+                item.second.cb(ec, nullptr, 0);
+            }
+        }
+    }
+
+    // 未完成的请求数
+    size_t size() const { return size_.load(std::memory_order_relaxed); }
+
+  private:
+    struct call {
+        callback_type cb;
+        deadline_type deadline; // max()表示不限期，不在deadlines中
+    };
+
+    struct shard {
+        std::mutex mtx;
+        std::unordered_map<std::uint64_t, call> calls;
+        // 带期限的请求，按期限排序
+        std::set<std::pair<deadline_type, std::uint64_t>> deadlines;
+    };
+
+    std::unique_ptr<shard[]> shards_;
+    size_t mask_ = 0;
+    std::atomic<size_t> size_{0};
+    std::atomic<size_t> timed_{0}; // 各分片中带期限的请求数
+};
+
+// 首个参数可以以rpc_future<T>调用时视为回调
+template <typename T, typename... Args>
+struct is_call_callback : std::false_type {};
+template <typename T, typename Arg, typename... Args>
+struct is_call_callback<T, Arg, Args...>
+    : std::is_invocable<Arg, rpc_future<T>> {};
+
+/*
+* 批量调用的结果
+ 按添加顺序逐项取出，每项有自己的状态：失败的项不影响其他项。
+*/
+class batch_result {
+  public:
+    size_t size() const { return items_.size(); }
+
+    // 该项是否调用成功
+    bool ok(size_t index) const {
+        return items_.at(index).code == result_code::OK;
+    }
+
+    // 失败项的错误信息
+    const std::string &error(size_t index) const {
+        return items_.at(index).error;
+    }
+
+    // 取出结果，T须与add<T>()时一致；该项失败时抛出rpc_error
+    template <typename T> T get(size_t index) const {
+        const auto &item = items_.at(index);
+        if (item.code != result_code::OK) {
+            throw rpc_error(error_of(item.code), item.error);
+        }
+        return std::any_cast<T>(item.value);
+    }
+
+  private:
+    friend class rpc_client;
+
+    struct item {
+        result_code code = result_code::OK;
+        std::any value;
+        std::string error;
+    };
+    std::vector<item> items_;
+};
+
+class rpc_client;
+
+/*
+* 批量调用
+ 多个调用打包进一个请求帧，服务端以一个应答帧返回全部结果，
+ 省去逐个调用的帧头、系统调用和往返：
+ auto res = client.batch().add<int>("calcFun", 1, 2).add<int>(calc, 3, 4).execute().get();
+*/
+class rpc_batch {
+  public:
+    // 把结果对象转换为add<T>()指定的类型
+    using converter_type = std::any (*)(const msgpack::object &);
+
+    explicit rpc_batch(rpc_client &client)
+        : client_(client), body_(RPCbufferPack::msgpack_codec::init_size) {
+        // 预留array32数组头，execute()时填入项数
+        char head[5] = {static_cast<char>(0xdd)};
+        body_.write(head, sizeof(head));
+    }
+
+    // 添加一个调用，T为结果类型；method可以是函数名或rpc_method::by_id()
+    template <typename T, typename... Args>
+    rpc_batch &add(const rpc_method &method, Args &&...args) {
+        if (method.id != 0) {
+            msgpack::pack(body_, std::forward_as_tuple(
+                                     method.id, std::forward<Args>(args)...));
+        } else {
+            msgpack::pack(body_, std::forward_as_tuple(
+                                     method.name, std::forward<Args>(args)...));
+        }
+        converters_.push_back(&convert_item<T>);
+        return *this;
+    }
+
+    // 已添加的调用数
+    size_t size() const { return converters_.size(); }
+
+    // 发出请求，结果按添加顺序排列；之后本对象不应再使用。
+    // 不指定期限时使用客户端的默认期限
+    inline rpc_future<batch_result> execute();
+    inline rpc_future<batch_result> execute(std::chrono::milliseconds timeout);
+
+  private:
+    template <typename T> static std::any convert_item(const msgpack::object &o) {
+        if constexpr (std::is_void_v<T>) {
+            return std::any();
+        } else {
+            return std::any(o.as<T>());
+        }
+    }
+
+    rpc_client &client_;
+    buffer_type body_;
+    std::vector<converter_type> converters_;
+};
+
+/*
+* 流的客户端状态
+ io线程收到结果帧时放入队列，读取方依次取出；
+ 服务端按窗口写出，队列中的结果数不超过授予的窗口。
+*/
+struct stream_queue {
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::deque<std::string> chunks; // 未取出的结果，msgpack编码
+    bool done = false;
+    error_code ec = error_code::OK;
+    std::string error;
+
+    void push(const char *data, size_t size) {
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            chunks.emplace_back(data, size);
+        }
+        cv.notify_all();
+    }
+
+    void finish(error_code code, std::string msg) {
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            done = true;
+            ec = code;
+            error = std::move(msg);
+        }
+        cv.notify_all();
+    }
+};
+
+/*
+* 流式调用的读取端
+ 逐个读取服务端写出的结果，读完之前析构时通知服务端取消：
+ for (auto &row : client.stream<std::string>("scan", 100)) { ... }
+ 读取在调用方线程上解码；客户端须在读取端析构之前保持有效。
+*/
+template <typename T> class rpc_stream {
+  public:
+    rpc_stream(rpc_client &client, std::uint64_t req_id,
+               std::shared_ptr<stream_queue> queue, uint32_t window)
+        : client_(&client), req_id_(req_id), queue_(std::move(queue)),
+          window_(window) {}
+
+    rpc_stream(rpc_stream &&) = default;
+    rpc_stream &operator=(rpc_stream &&) = delete;
+
+    ~rpc_stream() { cancel(); }
+
+    // 阻塞读取下一个结果，流正常结束时返回false，出错时抛出rpc_error
+    inline bool next(T &value);
+
+    // 不再读取，通知服务端停止写出；之后next()返回false
+    inline void cancel();
+
+    // 单遍的输入迭代器，用于范围for
+    class iterator {
+      public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = T *;
+        using reference = T &;
+
+        iterator() = default;
+        explicit iterator(rpc_stream *s) : stream_(s) { ++*this; }
+
+        T &operator*() { return value_; }
+        T *operator->() { return &value_; }
+        iterator &operator++() {
+            if (!stream_->next(value_)) {
+                stream_ = nullptr;
+            }
+            return *this;
+        }
+        bool operator==(const iterator &o) const { return stream_ == o.stream_; }
+        bool operator!=(const iterator &o) const { return stream_ != o.stream_; }
+
+      private:
+        rpc_stream *stream_ = nullptr;
+        T value_{};
+    };
+
+    iterator begin() { return iterator(this); }
+    iterator end() { return iterator(); }
+
+  private:
+    rpc_client *client_;
+    std::uint64_t req_id_;
+    std::shared_ptr<stream_queue> queue_;
+    uint32_t window_;
+    uint32_t consumed_ = 0; // 上次补充窗口后取走的结果数
+    bool finished_ = false;
+};
+
+#ifdef TINY_RPC_HAS_COROUTINE
+// co_call返回的等待体，响应到达后投递到客户端的io_service上恢复协程
+template <typename T> class call_awaiter {
+  public:
+    call_awaiter(boost::asio::io_service &ios, rpc_future<T> fut)
+        : ios_(ios), fut_(std::move(fut)) {}
+
+    bool await_ready() const { return fut_.ready(); }
+
+    void await_suspend(std::coroutine_handle<> h) {
+        auto &ios = ios_;
+        fut_.then([&ios, h](rpc_future<T>) {
+            boost::asio::post(ios, [h] { h.resume(); });
+        });
+    }
+
+    T await_resume() { return fut_.get(); }
+
+  private:
+    boost::asio::io_service &ios_;
+    rpc_future<T> fut_;
+};
+#endif
 
 class rpc_client : private boost::asio::noncopyable {
   public:
+    // host可以是地址，也可以是uri，此时忽略port
     rpc_client(const std::string &host, unsigned short port)
-        : socket_(ioservice_), work_(ioservice_), host_(host), port_(port),
-          body_(INIT_BUF_SIZE) {
+        : rpc_client(endpoint_uri::make(host, port)) {}
+
+    // 按uri连接：tcp://host:port、unix:///path或shm://name，见endpoint_uri
+    explicit rpc_client(const std::string &uri)
+        : rpc_client(endpoint_uri::parse(uri)) {}
+
+    explicit rpc_client(const endpoint_uri &endpoint)
+        : own_ioservice_(new boost::asio::io_service),
+          ioservice_(*own_ioservice_), socket_(ioservice_), work_(ioservice_),
+          endpoint_(endpoint), recv_(RECV_BUF_SIZE) {
         has_connected_ = false;
         conn_val = false;
-        write_fg_ = false;
         m_req_id = 0;
-        // 创建子线程
+        // 创建子线程，读写均在该线程的io_service上异步完成
         thd_ = std::make_shared<std::thread>([this] { ioservice_.run(); });
-        // 创建写子线程
-        write_thd_ =
-            std::make_shared<std::thread>([this] { write_callback(); });
+    }
+
+    // 使用外部的io_service，不创建线程，由调用方运行；
+    // 调用方须在本对象析构前停止该io_service，保证不再有回调执行
+    rpc_client(boost::asio::io_service &ios, const std::string &host,
+               unsigned short port)
+        : rpc_client(ios, endpoint_uri::make(host, port)) {}
+
+    rpc_client(boost::asio::io_service &ios, const endpoint_uri &endpoint)
+        : ioservice_(ios), socket_(ioservice_), work_(ioservice_),
+          endpoint_(endpoint), recv_(RECV_BUF_SIZE) {
+        has_connected_ = false;
+        conn_val = false;
+        m_req_id = 0;
     }
 
     ~rpc_client() {
@@ -33,115 +434,415 @@ class rpc_client : private boost::asio::noncopyable {
         stop();
     }
 
-    // 开始连接
+    // 开始连接；连接断开后可再次调用以重连，上一次连接尚未完成时只等待其结果
     bool connect(size_t timeout = 3) {
         if (has_connected_)
             return true;
-        assert(port_ != 0);
-        auto addr = boost::asio::ip::address::from_string(host_);
-        boost::asio::ip::tcp::endpoint ep(
-            boost::asio::ip::address::from_string(host_), port_);
-        socket_.async_connect(ep, [this](const boost::system::error_code &ec) {
-            if (has_connected_) {
-                return;
+        assert(endpoint_.kind != transport_kind::tcp || endpoint_.port != 0);
+        if (!connecting_.exchange(true)) {
+            {
+                std::unique_lock<std::mutex> lock(conn_mtx_);
+                conn_val = false;
             }
-            if (ec) {
-                has_connected_ = false;
-                {
-                    std::unique_lock<std::mutex> lock(conn_mtx_);
-                    conn_val = true;
+            auto ep = endpoint_.socket_endpoint();
+            // 在io线程上发起连接，与该线程上的关闭操作串行
+            boost::asio::post(ioservice_, [this, ep] { do_connect(ep); });
+        }
+        // 条件变量起定时作用
+        wait_conn(timeout);
+        return has_connected_;
+    }
+
+    // 是否已连接
+    bool has_connected() const { return has_connected_; }
+
+    // 已发出但尚未收到响应的请求数
+    size_t outstanding() const { return pending_.size(); }
+
+    // 默认调用期限，未指定期限的调用使用该值，0表示不限；初始为DEFAULT_TIMEOUT
+    void set_timeout(std::chrono::milliseconds timeout) {
+        timeout_ms_ = timeout.count();
+    }
+
+    std::chrono::milliseconds timeout() const {
+        return std::chrono::milliseconds(timeout_ms_.load());
+    }
+
+    // tcp连接是否设置TCP_NODELAY，默认设置，小的请求立即发出；
+    // 在connect()之前调用，对之后建立的连接生效，其他传输方式忽略
+    void set_no_delay(bool enable) { no_delay_ = enable; }
+
+    // 请求压缩：超过threshold字节的请求体压缩后发送，0表示不压缩(默认)；
+    // 只在服务端握手表明支持后生效。收到的压缩响应总是解压
+    void set_compression(size_t threshold) {
+        compression_.threshold = threshold;
+    }
+
+    // 压缩统计：请求的压缩率和压缩耗时，以及响应的解压耗时
+    compression_stats compress_stats() const { return compression_.stats(); }
+
+    // 阻塞式调用；method可以是函数名，也可以是rpc_method::by_id()得到的方法id；
+    // 超过期限未收到响应时抛出错误码为TIMEOUT的rpc_error
+    template <typename T, typename... Args>
+    T call(const rpc_method &method, Args &&...args) {
+        return async_call<T>(method, std::forward<Args>(args)...).get();
+    }
+
+    // 指定期限的阻塞式调用
+    template <typename T, typename... Args>
+    T call(std::chrono::milliseconds timeout, const rpc_method &method,
+           Args &&...args) {
+        return async_call<T>(timeout, method, std::forward<Args>(args)...)
+            .get();
+    }
+
+    // 非阻塞式future调用,使用get()得到结果，结果由io线程直接设置
+    template <typename T, typename... Args,
+              typename = std::enable_if_t<!is_call_callback<T, Args...>::value>>
+    rpc_future<T> async_call(const rpc_method &method, Args &&...args) {
+        return async_call<T>(timeout(), method, std::forward<Args>(args)...);
+    }
+
+    // 指定期限的非阻塞式调用；期限随请求发往服务端，服务端不再执行已过期的请求。
+    // method指定平坦编码且参数和返回类型都支持时按内存布局编码，否则使用msgpack；
+    // 有类型只能平坦编码时总是使用平坦编码
+    template <typename T, typename... Args>
+    rpc_future<T> async_call(std::chrono::milliseconds timeout,
+                             const rpc_method &method, Args &&...args) {
+        using layout =
+            RPCbufferPack::flat_codec::layout<T, std::tuple<std::decay_t<Args>...>>;
+        bool flat = layout::flat_only;
+        if constexpr (layout::supported) {
+            flat = flat || method.codec == codec_type::flat;
+        }
+
+        std::uint64_t tmpReqId = m_req_id++;
+        rpc_promise<T> prom;
+        auto fut = prom.get_future();
+        // 先登记再发送，避免响应先于登记到达
+        pending_.add(
+            tmpReqId,
+            [prom, flat](error_code ec, const char *data, size_t size) mutable {
+                if constexpr (layout::supported) {
+                    if (flat) {
+                        complete_flat_call<T>(prom, ec, data, size);
+                        return;
+                    }
                 }
-                conn_cond_.notify_one();
-                return;
-            } else {
-                has_connected_ = true;
-                {
-                    std::unique_lock<std::mutex> lock(conn_mtx_);
-                    conn_val = true;
+                if constexpr (!layout::flat_only) {
+                    complete_call<T>(prom, ec, data, size);
                 }
+            },
+            deadline_of(timeout));
+        if (timeout.count() > 0) {
+            arm_deadline_timer();
+        }
 
-                // 一直循环读取
-                do_read();
+        if constexpr (layout::supported) {
+            if (flat) {
+                buffer_type body(RPCbufferPack::msgpack_codec::init_size);
+                RPCbufferPack::flat_codec::pack_request(
+                    body, method.id != 0 ? std::string_view() : method.name,
+                    layout::signature, args...);
+                write(tmpReqId, request_type::req_res, std::move(body),
+                      method.id, timeout, FRAME_FLAT);
+                return fut;
+            }
+        }
 
-                conn_cond_.notify_one();
-                printf("connected!\n");
+        if constexpr (!layout::flat_only) {
+            // 把发送信息添加到发送队列，按id调用时请求体不含函数名
+            RPCbufferPack::msgpack_codec codec;
+            if (method.id != 0) {
+                write(tmpReqId, request_type::req_res,
+                      codec.pack_args(std::forward<Args>(args)...), method.id,
+                      timeout);
+            } else {
+                write(tmpReqId, request_type::req_res,
+                      codec.pack_args(method.name, std::forward<Args>(args)...),
+                      0, timeout);
             }
-        });
-        // 条件变量起定时作用
-        wait_conn(timeout);
-        return has_connected_;
+        }
+        return fut;
     }
 
-    template <typename T> T calcThread(std::uint64_t req_id) {
-        std::string curr;
-        // 等待条件变量
-        std::unique_lock<std::mutex> slock(m_pro_mtx_);
-        m_pro_cond_.wait(slock, [this, req_id] {
-            return !m_product_.empty() &&
-                   m_product_.find(req_id) != m_product_.end();
-        });
-        curr = m_product_[req_id];
-        m_product_.erase(req_id); // 删除该信号
-        slock.unlock();
+    // 回调式调用，回调参数为已完成的rpc_future<T>，在io线程上执行，不应阻塞
+    template <typename T, typename Callback, typename... Args,
+              typename = std::enable_if_t<is_call_callback<T, Callback>::value>>
+    void async_call(const rpc_method &method, Callback &&cb, Args &&...args) {
+        async_call<T>(method, std::forward<Args>(args)...)
+            .then(std::forward<Callback>(cb));
+    }
 
-        // 解码
-        RPCbufferPack::msgpack_codec codec;
-        auto tp = codec.unpack<std::tuple<int, T>>(curr.data(), curr.size());
+    // 开始一个批量调用，见rpc_batch
+    rpc_batch batch() { return rpc_batch(*this); }
 
-        // 返回结果
-        return std::get<1>(tp);
+    // 流式调用，调用服务端以register_stream()注册的函数，见rpc_stream；
+    // method可以是函数名或rpc_method::by_id()
+    template <typename T, typename... Args>
+    rpc_stream<T> stream(const rpc_method &method, Args &&...args) {
+        uint32_t window = stream_window_.load();
+        std::uint64_t tmpReqId = m_req_id++;
+        auto queue = std::make_shared<stream_queue>();
+        {
+            std::unique_lock<std::mutex> lock(streams_mtx_);
+            streams_.emplace(tmpReqId, queue);
+        }
+        // 请求体为[初始窗口u32]加上与普通调用相同的参数数组
+        buffer_type body(RPCbufferPack::msgpack_codec::init_size);
+        body.write(reinterpret_cast<const char *>(&window), 4);
+        if (method.id != 0) {
+            msgpack::pack(body,
+                          std::forward_as_tuple(std::forward<Args>(args)...));
+        } else {
+            msgpack::pack(body, std::forward_as_tuple(
+                                    method.name, std::forward<Args>(args)...));
+        }
+        write(tmpReqId, request_type::stream, std::move(body), method.id);
+        return rpc_stream<T>(*this, tmpReqId, std::move(queue), window);
     }
 
-    // 阻塞式调用
-    template <typename T, typename... Args>
-    T call(const std::string &rpc_name, Args &&...args) {
-        req_mtx_.lock();
-        std::uint64_t tmpReqId = m_req_id;
-        m_req_id++;
-        req_mtx_.unlock();
+    // 流的窗口：服务端无需等待读取方即可写出的结果数，读取方取走一半后补充；
+    // 初始为DEFAULT_STREAM_WINDOW
+    void set_stream_window(uint32_t window) {
+        stream_window_ = window == 0 ? 1 : window;
+    }
 
-        // 把发送信息添加到发送队列
+    // 订阅主题，服务端publish()到该主题的消息转换为T后交给callback；
+    // callback在io线程上执行，不应阻塞。重复订阅时替换回调；
+    // 断线重连后自动重新订阅，断开期间发布的消息不会补发
+    template <typename T, typename Callback>
+    void subscribe(const std::string &topic, Callback &&callback) {
+        auto handler = std::make_shared<const subscriber_type>(
+            [cb = std::forward<Callback>(callback)](
+                const msgpack::object &obj) { cb(obj.as<T>()); });
+        bool added;
+        {
+            std::unique_lock<std::mutex> lock(subs_mtx_);
+            added = subs_.find(topic) == subs_.end();
+            subs_[topic] = std::move(handler);
+        }
+        if (added && has_connected_) {
+            send_subscription(true, topic);
+        }
+    }
 
-        RPCbufferPack::msgpack_codec codec;
-        auto que = codec.pack_args(rpc_name, std::forward<Args>(args)...);
+    // 退订主题，退订前已发出的消息可能仍会到达并被丢弃
+    void unsubscribe(const std::string &topic) {
+        size_t erased;
         {
-            std::unique_lock<std::mutex> lock(write_mtx_);
-            write_box_.emplace_back(client_message_type{
-                tmpReqId, request_type::req_res,
-                std::make_shared<buffer_type>(std::move(que))});
+            std::unique_lock<std::mutex> lock(subs_mtx_);
+            erased = subs_.erase(topic);
+        }
+        if (erased != 0 && has_connected_) {
+            send_subscription(false, topic);
         }
+    }
 
-        // write(tmpReqId, request_type::req_res, std::move(que));
-        return calcThread<T>(tmpReqId);
+#ifdef TINY_RPC_HAS_COROUTINE
+    // 协程式调用：co_await client.co_call<T>(...)，请求立即发出，
+    // 响应到达后协程在客户端的io线程上恢复，不占用调用方线程
+    template <typename T, typename... Args>
+    call_awaiter<T> co_call(const rpc_method &method, Args &&...args) {
+        return call_awaiter<T>(
+            ioservice_, async_call<T>(method, std::forward<Args>(args)...));
     }
 
-    // 非阻塞式future调用,使用get()得到结果
     template <typename T, typename... Args>
-    std::shared_ptr<std::future<T>> async_call(const std::string &rpc_name,
-                                               Args &&...args) {
-        req_mtx_.lock();
-        std::uint64_t tmpReqId = m_req_id;
-        m_req_id++;
-        req_mtx_.unlock();
+    call_awaiter<T> co_call(std::chrono::milliseconds timeout,
+                            const rpc_method &method, Args &&...args) {
+        return call_awaiter<T>(ioservice_,
+                               async_call<T>(timeout, method,
+                                             std::forward<Args>(args)...));
+    }
+#endif
+
+  private:
+    friend class rpc_batch;
+    template <typename T> friend class rpc_stream;
 
-        // 把发送信息添加到发送队列
+    // 补充流的窗口
+    void stream_credit(std::uint64_t req_id, uint32_t credits) {
+        buffer_type body(8);
+        body.write(reinterpret_cast<const char *>(&credits), 4);
+        write(req_id, request_type::stream_ctrl, std::move(body));
+    }
 
-        RPCbufferPack::msgpack_codec codec;
-        auto que = codec.pack_args(rpc_name, std::forward<Args>(args)...);
+    // 取消流：不再接收其结果，并通知服务端停止写出
+    void cancel_stream(std::uint64_t req_id) {
         {
-            std::unique_lock<std::mutex> lock(write_mtx_);
-            write_box_.emplace_back(client_message_type{
-                tmpReqId, request_type::req_res,
-                std::make_shared<buffer_type>(std::move(que))});
+            std::unique_lock<std::mutex> lock(streams_mtx_);
+            streams_.erase(req_id);
         }
+        stream_credit(req_id, 0);
+    }
 
-        // 异步线程等待回复
-        auto ret = std::make_shared<std::future<T>>(std::async(
-            std::launch::async, &rpc_client::calcThread<T>, this, tmpReqId));
-        return ret;
+    // 发出批量请求，body为各项调用组成的数组
+    rpc_future<batch_result>
+    async_batch(std::chrono::milliseconds timeout, buffer_type &&body,
+                std::vector<rpc_batch::converter_type> converters) {
+        std::uint64_t tmpReqId = m_req_id++;
+        rpc_promise<batch_result> prom;
+        auto fut = prom.get_future();
+        pending_.add(
+            tmpReqId,
+            [prom, conv = std::move(converters)](
+                error_code ec, const char *data, size_t size) mutable {
+                complete_batch(prom, conv, ec, data, size);
+            },
+            deadline_of(timeout));
+        if (timeout.count() > 0) {
+            arm_deadline_timer();
+        }
+        write(tmpReqId, request_type::batch, std::move(body), 0, timeout);
+        return fut;
+    }
+
+    // 解码批量应答：整体失败时应答为单个[状态码, 错误信息]，否则为各项结果的数组
+    static void
+    complete_batch(rpc_promise<batch_result> &prom,
+                   const std::vector<rpc_batch::converter_type> &converters,
+                   error_code ec, const char *data, size_t size) {
+        if (ec != error_code::OK) {
+            prom.set_exception(std::make_exception_ptr(transport_error(ec)));
+            return;
+        }
+        batch_result result;
+        try {
+            msgpack::object_handle handle = msgpack::unpack(data, size);
+            const msgpack::object &obj = handle.get();
+            if (obj.type != msgpack::type::ARRAY) {
+                throw rpc_error(error_code::FAIL, "invalid batch response");
+            }
+            const msgpack::object_array &items = obj.via.array;
+            if (items.size > 0 &&
+                items.ptr[0].type == msgpack::type::POSITIVE_INTEGER) {
+                throw rpc_error(
+                    error_of(static_cast<result_code>(items.ptr[0].via.u64)),
+                    items.size > 1 ? items.ptr[1].as<std::string>()
+                                   : std::string("batch failed"));
+            }
+            if (items.size != converters.size()) {
+                throw rpc_error(error_code::FAIL, "batch size mismatch");
+            }
+            result.items_.resize(items.size);
+            for (uint32_t i = 0; i < items.size; ++i) {
+                auto &item = result.items_[i];
+                // 每项与单个调用的应答相同：[状态码, 结果或错误信息]
+                auto tp = items.ptr[i].as<std::tuple<int, msgpack::object>>();
+                item.code = static_cast<result_code>(std::get<0>(tp));
+                try {
+                    if (item.code == result_code::OK) {
+                        item.value = converters[i](std::get<1>(tp));
+                    } else {
+                        item.error = std::get<1>(tp).as<std::string>();
+                    }
+                } catch (const std::exception &) {
+                    item.code = result_code::FAIL;
+                    item.error = "result type mismatch";
+                }
+            }
+        } catch (...) {
+            prom.set_exception(std::current_exception());
+            return;
+        }
+        prom.set_value(std::move(result));
+    }
+
+    // 未收到响应而结束的调用
+    static rpc_error transport_error(error_code ec) {
+        if (ec == error_code::TIMEOUT) {
+            return rpc_error(ec, "deadline exceeded");
+        }
+        return rpc_error(ec, "connection closed");
+    }
+
+    // 由相对期限得到绝对期限，0表示不限
+    static deadline_type deadline_of(std::chrono::milliseconds timeout) {
+        if (timeout.count() <= 0) {
+            return deadline_type::max();
+        }
+        return std::chrono::steady_clock::now() + timeout;
+    }
+
+    // 有带期限的请求时启动检查定时器，须在请求登记之后调用
+    void arm_deadline_timer() {
+        if (!deadline_armed_.exchange(true)) {
+            boost::asio::post(ioservice_, [this] { schedule_expire(); });
+        }
+    }
+
+    // 在io线程上定期结束过期的请求，没有待检查的期限时停止
+    void schedule_expire() {
+        deadline_timer_.expires_from_now(
+            std::chrono::milliseconds(DEADLINE_TICK_MS));
+        deadline_timer_.async_wait([this](const boost::system::error_code &ec) {
+            if (ec) {
+                deadline_armed_ = false;
+                return;
+            }
+            if (pending_.expire(std::chrono::steady_clock::now())) {
+                schedule_expire();
+                return;
+            }
+            deadline_armed_ = false;
+            // 清除标志前后可能有新的期限登记
+            if (pending_.has_deadlines() && !deadline_armed_.exchange(true)) {
+                schedule_expire();
+            }
+        });
+    }
+
+    // 解码响应并完成对应的future，服务端返回错误时以rpc_error结束
+    template <typename T>
+    static void complete_call(rpc_promise<T> &prom, error_code ec,
+                              const char *data, size_t size) {
+        if (ec != error_code::OK) {
+            prom.set_exception(std::make_exception_ptr(transport_error(ec)));
+            return;
+        }
+        T result;
+        try {
+            // 结果部分延后转换，失败时其内容为错误信息
+            RPCbufferPack::msgpack_codec codec;
+            auto tp =
+                codec.unpack<std::tuple<int, msgpack::object>>(data, size);
+            if ((result_code)std::get<0>(tp) != result_code::OK) {
+                throw rpc_error(error_of((result_code)std::get<0>(tp)),
+                                std::get<1>(tp).as<std::string>());
+            }
+            result = std::get<1>(tp).as<T>();
+        } catch (...) {
+            prom.set_exception(std::current_exception());
+            return;
+        }
+        prom.set_value(std::move(result));
+    }
+
+    // 解码平坦编码的响应
+    template <typename T>
+    static void complete_flat_call(rpc_promise<T> &prom, error_code ec,
+                                   const char *data, size_t size) {
+        if (ec != error_code::OK) {
+            prom.set_exception(std::make_exception_ptr(transport_error(ec)));
+            return;
+        }
+        T result{};
+        try {
+            std::string error;
+            auto code = static_cast<result_code>(
+                RPCbufferPack::flat_codec::unpack_result(data, size, result,
+                                                         error));
+            if (code != result_code::OK) {
+                throw rpc_error(error_of(code), error);
+            }
+        } catch (...) {
+            prom.set_exception(std::current_exception());
+            return;
+        }
+        prom.set_value(std::move(result));
     }
 
-  private:
     void stop() {
         if (thd_ != nullptr) {
             ioservice_.stop();
@@ -150,28 +851,64 @@ class rpc_client : private boost::asio::noncopyable {
             }
             thd_ = nullptr;
         }
-        // 关闭写线程
-        if (write_thd_ != nullptr) {
-            if (write_thd_->joinable()) {
-                write_thd_->join();
-            }
-            write_thd_ = nullptr;
-        }
     }
 
     void close() {
-        boost::system::error_code ignored_ec;
-        socket_.shutdown(boost::asio::ip::tcp::socket::shutdown_both,
-                         ignored_ec);
-        socket_.close(ignored_ec);
+        socket_.close();
         has_connected_ = false;
-        // 修改写标志
+        // 唤醒所有仍在等待响应的调用者
+        pending_.cancel_all(error_code::BADCONNECTION);
+        std::unordered_map<std::uint64_t, std::shared_ptr<stream_queue>> streams;
         {
-            std::unique_lock<std::mutex> lock(write_mtx_);
-            write_fg_ = true;
+            std::unique_lock<std::mutex> lock(streams_mtx_);
+            streams.swap(streams_);
+        }
+        for (auto &s : streams) {
+            s.second->finish(error_code::BADCONNECTION, "connection closed");
         }
     }
 
+    void do_connect(const endpoint_uri::endpoint_type &ep) {
+        socket_.stream().async_connect(ep, [this](boost::system::error_code ec) {
+            connecting_ = false;
+            if (has_connected_) {
+                return;
+            }
+            // 共享内存在控制连接建立后创建并交给服务端
+            if (!ec && endpoint_.kind == transport_kind::shm) {
+                socket_.open_shm(ec);
+            } else if (!ec) {
+                socket_.set_no_delay(no_delay_);
+            }
+            if (ec) {
+                has_connected_ = false;
+                // 关闭失败的socket，下次连接时重新打开
+                socket_.close();
+                {
+                    std::unique_lock<std::mutex> lock(conn_mtx_);
+                    conn_val = true;
+                }
+                conn_cond_.notify_all();
+                return;
+            } else {
+                has_connected_ = true;
+                {
+                    std::unique_lock<std::mutex> lock(conn_mtx_);
+                    conn_val = true;
+                }
+
+                // 重连时丢弃上一条连接残留的数据，一直循环读取
+                recv_.clear();
+                do_read();
+                send_handshake();
+                resubscribe();
+
+                conn_cond_.notify_all();
+                fprintf(stderr, "connected!\n");
+            }
+        });
+    }
+
     bool wait_conn(size_t timeout) {
         if (has_connected_) {
             return true;
@@ -184,166 +921,411 @@ class rpc_client : private boost::asio::noncopyable {
         return result;
     }
 
+    // 一次读入尽可能多的字节，再取出其中所有完整的响应帧
     void do_read() {
-        // 读取协议头
-        boost::asio::async_read(
-            socket_, boost::asio::buffer(head_, HEAD_LEN),
+        socket_.async_read_some(
+            recv_.prepare(),
             [this](boost::system::error_code ec, std::size_t length) {
                 if (!socket_.is_open()) {
-                    printf("socket close\n");
+                    fprintf(stderr, "socket close\n");
                     return;
                 }
-                if (!ec) {
-                    std::uint64_t reqidTmp = 0;
-                    request_type reqTypeTmp;
-                    uint32_t body_len = 0;
-                    memcpy(&body_len, head_, 4);
-                    memcpy(&reqidTmp, head_ + 4, 8);
-                    memcpy(&reqTypeTmp, head_ + 12, 1);
-                    if (body_len > 0 && body_len < MAX_BUF_LEN) {
-                        if (body_.size() < body_len) {
-                            body_.resize(body_len);
-                        }
-                        read_body(reqidTmp, reqTypeTmp, body_len);
-                        return;
-                    }
-                    if (body_len == 0) {
-                        // LOG
-                        printf("body information is illeagl!\n");
-                        return;
-                    }
-                } else {
+                if (ec) {
                     // 出错了断开连接
-                    printf("error in read head!\n");
+                    fprintf(stderr, "error in read: %s\n",
+                            ec.message().c_str());
                     close();
                     return;
                 }
+                recv_.commit(length);
+                process_frames();
             });
     }
 
-    // 读取携带的信息
-    void read_body(std::uint64_t req_id, request_type req_type,
-                   size_t body_len) {
+    // 依次处理缓冲区中的完整帧，剩余半帧留待下次读取
+    void process_frames() {
+        while (recv_.size() >= HEAD_LEN) {
+            rpc_header header = decode_header(recv_.data());
+            if (header.body_len == 0 || header.body_len >= MAX_BUF_LEN) {
+                // LOG
+                fprintf(stderr, "body information is illeagl!\n");
+                close();
+                return;
+            }
+            size_t frame_len = HEAD_LEN + header.body_len;
+            if (recv_.size() < frame_len) {
+                if (frame_len > recv_.capacity()) {
+                    // 超过缓冲区的大帧，单独读取剩余的消息体
+                    read_body(header);
+                    return;
+                }
+                break;
+            }
+            deal_body(header, recv_.data() + HEAD_LEN);
+            recv_.consume(frame_len);
+        }
+        // 递归进行下一次读取
+        do_read();
+    }
+
+    // 读取大的消息体：已收到的部分拷入body_，剩余部分直接读入body_
+    void read_body(const rpc_header &header) {
+        size_t have = recv_.size() - HEAD_LEN;
+        if (body_.size() < header.body_len) {
+            body_.resize(header.body_len);
+        }
+        memcpy(body_.data(), recv_.data() + HEAD_LEN, have);
+        recv_.consume(recv_.size());
+
         boost::asio::async_read(
-            socket_, boost::asio::buffer(body_.data(), body_len),
-            [this, req_id, req_type, body_len](boost::system::error_code ec,
-                                               std::size_t length) {
+            socket_,
+            boost::asio::buffer(body_.data() + have, header.body_len - have),
+            [this, header](boost::system::error_code ec, std::size_t length) {
                 if (!socket_.is_open()) {
-                    printf("socket close\n");
+                    fprintf(stderr, "socket close\n");
                     return;
                 }
                 if (!ec) {
-                    deal_body(req_id, body_.data(), length);
+                    deal_body(header, body_.data());
                     // 递归进行下一次读取
                     do_read();
                 } else {
-                    printf("error in read body!\n");
+                    fprintf(stderr, "error in read body!\n");
                     close();
                     return;
                 }
             });
     }
 
-    void deal_body(std::uint64_t req_id, const char *data, std::size_t size) {
-        RPCbufferPack::msgpack_codec codec;
-        auto p = codec.unpack<std::tuple<int>>(data, size);
-        result_code tmp = (result_code)std::get<0>(p);
-        if (tmp == result_code::OK) {
-            printf("call-response success!\n");
-            std::string strFromCharArray(data, size);
-            // 生产者
-            {
-                std::unique_lock<std::mutex> slock(m_pro_mtx_);
-                m_product_.emplace(req_id, std::move(strFromCharArray));
+    // 交给对应请求的完成回调，只唤醒该请求的调用者；
+    // 已过期的请求不在表中，其迟到的响应直接丢弃
+    void deal_body(const rpc_header &header, const char *data) {
+        if (header.req_type == request_type::handshake) {
+            peer_flags_ = static_cast<uint8_t>(data[0]);
+            return;
+        }
+        const char *body = data;
+        size_t size = header.body_len;
+        if (header.flags & FRAME_COMPRESSED) {
+            if (!compression_.decompress(data, header.body_len, inflate_,
+                                         MAX_BUF_LEN) ||
+                inflate_.empty()) {
+                fprintf(stderr, "error in decompress!\n");
+                close();
+                return;
             }
-            m_pro_cond_.notify_all();
+            body = inflate_.data();
+            size = inflate_.size();
+        }
+        if (header.req_type == request_type::stream) {
+            deal_stream(header.req_id, body, size);
+            return;
+        }
+        if (header.req_type == request_type::sub_pub) {
+            deal_publish(body, size);
+            return;
+        }
+        pending_.complete(header.req_id, error_code::OK, body, size);
+    }
 
+    // 流式应答帧：结果放入对应的队列，结束帧和错误帧结束该流；
+    // 已取消的流不在表中，其后续的帧直接丢弃
+    void deal_stream(std::uint64_t req_id, const char *data, size_t size) {
+        auto kind = static_cast<stream_frame>(data[0]);
+        std::shared_ptr<stream_queue> queue;
+        {
+            std::unique_lock<std::mutex> lock(streams_mtx_);
+            auto it = streams_.find(req_id);
+            if (it == streams_.end()) {
+                return;
+            }
+            queue = it->second;
+            if (kind != stream_frame::data) {
+                streams_.erase(it);
+            }
+        }
+        if (kind == stream_frame::data) {
+            queue->push(data + 1, size - 1);
+        } else if (kind == stream_frame::end) {
+            queue->finish(error_code::OK, std::string());
         } else {
-            printf("call-response fail!\n");
-        }
-    }
-
-    void write_callback() {
-        while (!write_fg_) {
-            while (!write_box_.empty()) {
-                auto &msg = write_box_.front();
-                uint32_t sendsz = msg.content->size();
-                // 以下4个buffer，用的是地址，发送前需要保证内容仍存在
-                std::array<boost::asio::const_buffer, 4> write_buffers;
-                write_buffers[0] =
-                    boost::asio::buffer(&sendsz, sizeof(uint32_t));
-                write_buffers[1] =
-                    boost::asio::buffer(&msg.req_id, sizeof(uint64_t));
-                write_buffers[2] =
-                    boost::asio::buffer(&msg.req_type, sizeof(request_type));
-                write_buffers[3] =
-                    boost::asio::buffer(msg.content->data(), sendsz);
-                boost::asio::write(socket_, write_buffers);
-                {
-                    std::unique_lock<std::mutex> lock(write_mtx_);
-                    write_box_.pop_front();
+            try {
+                RPCbufferPack::msgpack_codec codec;
+                auto tp = codec.unpack<std::tuple<int, std::string>>(data + 1,
+                                                                    size - 1);
+                queue->finish(error_of((result_code)std::get<0>(tp)),
+                              std::get<1>(tp));
+            } catch (const std::exception &) {
+                queue->finish(error_code::FAIL, "invalid stream frame");
+            }
+        }
+    }
+
+    // 发布的消息：消息体为[topic, value]，交给该主题的回调，回调在锁外执行
+    void deal_publish(const char *data, size_t size) {
+        try {
+            msgpack::object_handle oh = msgpack::unpack(data, size);
+            const msgpack::object &obj = oh.get();
+            if (obj.type != msgpack::type::ARRAY || obj.via.array.size != 2) {
+                return;
+            }
+            auto topic = obj.via.array.ptr[0].as<std::string>();
+            std::shared_ptr<const subscriber_type> handler;
+            {
+                std::unique_lock<std::mutex> lock(subs_mtx_);
+                auto it = subs_.find(topic);
+                if (it == subs_.end()) {
+                    return;
                 }
+                handler = it->second;
             }
+            (*handler)(obj.via.array.ptr[1]);
+        } catch (const std::exception &e) {
+            fprintf(stderr, "error in publish message: %s\n", e.what());
         }
     }
 
-    // 异步发送请求，没有并发保护
-    void write(std::uint64_t req_id, request_type type, buffer_type &&message) {
-        size_t size = message.size();
+    // 订阅或退订，消息体为[是否订阅, 主题]
+    void send_subscription(bool subscribe, const std::string &topic) {
+        buffer_type body(RPCbufferPack::msgpack_codec::init_size);
+        msgpack::pack(body, std::forward_as_tuple(subscribe, topic));
+        write(m_req_id++, request_type::sub_pub, std::move(body));
+    }
+
+    // 连接建立后重新订阅所有主题
+    void resubscribe() {
+        std::vector<std::string> topics;
+        {
+            std::unique_lock<std::mutex> lock(subs_mtx_);
+            for (auto &s : subs_) {
+                topics.push_back(s.first);
+            }
+        }
+        for (auto &t : topics) {
+            send_subscription(true, t);
+        }
+    }
+
+    // 连接建立后发出握手，表明本端支持的帧标志；收到回复前请求不压缩
+    void send_handshake() {
+        peer_flags_ = 0;
+        buffer_type body(8);
+        char flags = static_cast<char>(FRAME_FLAT | FRAME_COMPRESSED);
+        body.write(&flags, 1);
+        write(m_req_id++, request_type::handshake, std::move(body));
+    }
+
+    // 把请求放入发送队列，空闲时唤醒io线程发送，多线程安全
+    void write(std::uint64_t req_id, request_type type, buffer_type &&message,
+               uint32_t method_id = 0,
+               std::chrono::milliseconds timeout = std::chrono::milliseconds(0),
+               uint8_t flags = 0) {
+        // 服务端支持时压缩超过阈值的请求体，在调用方线程上完成
+        if ((peer_flags_ & FRAME_COMPRESSED) &&
+            compression_.should_compress(message.size())) {
+            buffer_type packed;
+            if (compression_.compress(message.data(), message.size(), packed)) {
+                message = std::move(packed);
+                flags |= FRAME_COMPRESSED;
+            }
+        }
+        uint32_t size = message.size();
         assert(size < MAX_BUF_LEN);
-        std::array<boost::asio::const_buffer, 4> write_buffers;
-        uint32_t write_size_curr = message.size();
-        write_buffers[0] =
-            boost::asio::buffer(&write_size_curr, sizeof(uint32_t));
-        write_buffers[1] = boost::asio::buffer(&req_id, sizeof(uint64_t));
-        write_buffers[2] = boost::asio::buffer(&type, sizeof(request_type));
-        write_buffers[3] = boost::asio::buffer(message.data(), write_size_curr);
+        client_message_type msg{req_id, type,
+                                std::make_shared<buffer_type>(std::move(message)),
+                                {}};
+        // 协议头在入队时编码好，发送期间地址保持有效
+        uint32_t timeout_ms = static_cast<uint32_t>(
+            std::max<int64_t>(0, std::min<int64_t>(timeout.count(), UINT32_MAX)));
+        encode_header(msg.head,
+                      rpc_header{size, req_id, type, method_id, timeout_ms,
+                                 flags});
+
+        bool need_signal = false;
+        {
+            std::unique_lock<std::mutex> lock(write_mtx_);
+            write_box_.emplace_back(std::move(msg));
+            if (!is_write_) {
+                is_write_ = true;
+                need_signal = true;
+            }
+        }
+        // 只有队列从空闲变为非空时才需要投递，正在发送时由完成回调继续
+        if (need_signal) {
+            ioservice_.post([this] { do_write(); });
+        }
+    }
+
+    // 在io线程上执行：把队列中所有待发消息聚合为一次gather写
+    void do_write() {
+        {
+            std::unique_lock<std::mutex> lock(write_mtx_);
+            size_t bytes = 0;
+            while (!write_box_.empty() &&
+                   sending_box_.size() < MAX_WRITE_BATCH &&
+                   (sending_box_.empty() || bytes < MAX_WRITE_BYTES)) {
+                bytes += HEAD_LEN + write_box_.front().content->size();
+                sending_box_.emplace_back(std::move(write_box_.front()));
+                write_box_.pop_front();
+            }
+            if (sending_box_.empty()) {
+                is_write_ = false;
+                return;
+            }
+        }
+
+        write_buffers_.clear();
+        for (auto &msg : sending_box_) {
+            write_buffers_.emplace_back(boost::asio::buffer(msg.head, HEAD_LEN));
+            write_buffers_.emplace_back(
+                boost::asio::buffer(msg.content->data(), msg.content->size()));
+        }
         boost::asio::async_write(
-            socket_, write_buffers,
-            [this](boost::system::error_code error, std::size_t length) {
-                if (!error) {
-                    std::cout << "call completed. Bytes transferred: " << length
-                              << std::endl;
-                } else {
-                    std::cerr << "call error: " << error.message() << std::endl;
+            socket_, write_buffers_,
+            [this](boost::system::error_code ec, std::size_t length) {
+                sending_box_.clear();
+                if (ec) {
+                    fprintf(stderr, "error in write: %s\n",
+                            ec.message().c_str());
+                    {
+                        std::unique_lock<std::mutex> lock(write_mtx_);
+                        write_box_.clear();
+                        is_write_ = false;
+                    }
+                    close();
+                    return;
                 }
+                // 继续发送期间新入队的消息
+                do_write();
             });
     }
 
   private:
-    boost::asio::io_service ioservice_; // 事件分发器
-    boost::asio::ip::tcp::socket socket_;
+    std::unique_ptr<boost::asio::io_service> own_ioservice_; // 自有的事件分发器
+    boost::asio::io_service &ioservice_; // 事件分发器，自有或外部的
+    rpc_socket socket_;
     boost::asio::io_service::work work_;
     std::shared_ptr<std::thread> thd_ = nullptr;
 
-    std::string host_;
-    unsigned short port_ = 0;
-    char head_[HEAD_LEN] = {};
-    std::vector<char> body_;
+    endpoint_uri endpoint_; // 服务端地址
+    recv_buffer recv_;       // 接收缓冲区，一次读取可包含多个帧
+    std::vector<char> body_; // 超过接收缓冲区的大消息体
 
     std::atomic_bool has_connected_ = {false};
+    std::atomic_bool connecting_ = {false}; // 是否有连接尝试正在进行
     std::mutex conn_mtx_; // 连接定时的条件变量的互斥锁
     std::condition_variable conn_cond_; // 连接定时的条件变量
     bool conn_val = false;
 
-    std::mutex req_mtx_;    // 请求id的并发保护锁
-    std::uint64_t m_req_id; // 请求id
+    std::atomic<std::uint64_t> m_req_id; // 请求id
 
-    // 收到消息的通知机制，生产者消费者模型
-    std::mutex m_pro_mtx_;
-    std::condition_variable m_pro_cond_;
-    std::unordered_map<std::uint64_t, std::string> m_product_;
+    // 未完成请求表，响应到达时完成对应请求
+    pending_calls pending_;
 
-    // 发送消息的通知机制
-    bool write_fg_ = false;
-    std::shared_ptr<std::thread> write_thd_ = nullptr;
-    std::mutex write_mtx_;
+    std::atomic<bool> no_delay_{true}; // tcp连接设置TCP_NODELAY
+
+    // 请求压缩的配置及统计；服务端在握手中表明支持的帧标志
+    frame_compression compression_;
+    std::atomic<uint8_t> peer_flags_{0};
+    std::vector<char> inflate_; // 解压后的响应体，仅在io线程访问
+
+    // 进行中的流，及其默认窗口
+    std::mutex streams_mtx_;
+    std::unordered_map<std::uint64_t, std::shared_ptr<stream_queue>> streams_;
+    std::atomic<uint32_t> stream_window_{DEFAULT_STREAM_WINDOW};
+
+    // 订阅的主题及其回调
+    using subscriber_type = std::function<void(const msgpack::object &)>;
+    std::mutex subs_mtx_;
+    std::unordered_map<std::string, std::shared_ptr<const subscriber_type>>
+        subs_;
+
+    // 调用期限：默认期限，以及在io线程上检查过期请求的定时器
+    std::atomic<int64_t> timeout_ms_{DEFAULT_TIMEOUT};
+    boost::asio::steady_timer deadline_timer_{ioservice_};
+    std::atomic_bool deadline_armed_{false};
+
+    // 发送消息的队列，write()入队，io线程聚合发送
     struct client_message_type {
         std::uint64_t req_id;
         request_type req_type;
         std::shared_ptr<buffer_type> content;
+        char head[HEAD_LEN]; // 编码好的协议头
     };
+    std::mutex write_mtx_;
     std::deque<client_message_type> write_box_;
+    bool is_write_ = false; // 是否有发送在进行，受write_mtx_保护
+    // 以下仅在io线程访问
+    std::vector<client_message_type> sending_box_;
+    std::vector<boost::asio::const_buffer> write_buffers_;
 };
 
+rpc_future<batch_result> rpc_batch::execute() {
+    return execute(client_.timeout());
+}
+
+rpc_future<batch_result> rpc_batch::execute(std::chrono::milliseconds timeout) {
+    // 填入array32数组头中的项数(大端)
+    uint32_t n = static_cast<uint32_t>(converters_.size());
+    char *head = body_.data();
+    head[1] = static_cast<char>(n >> 24);
+    head[2] = static_cast<char>(n >> 16);
+    head[3] = static_cast<char>(n >> 8);
+    head[4] = static_cast<char>(n);
+    return client_.async_batch(timeout, std::move(body_),
+                               std::move(converters_));
+}
+
+template <typename T> bool rpc_stream<T>::next(T &value) {
+    if (finished_) {
+        return false;
+    }
+    std::string chunk;
+    bool done = false;
+    {
+        std::unique_lock<std::mutex> lock(queue_->mtx);
+        queue_->cv.wait(lock, [this] {
+            return !queue_->chunks.empty() || queue_->done;
+        });
+        if (queue_->chunks.empty()) {
+            finished_ = true;
+            if (queue_->ec != error_code::OK) {
+                throw rpc_error(queue_->ec, queue_->error);
+            }
+            return false;
+        }
+        chunk = std::move(queue_->chunks.front());
+        queue_->chunks.pop_front();
+        done = queue_->done;
+    }
+    // 取走一半窗口后补充，服务端不必等到窗口用完再继续写出
+    if (!done && ++consumed_ >= (window_ + 1) / 2) {
+        client_->stream_credit(req_id_, consumed_);
+        consumed_ = 0;
+    }
+    try {
+        msgpack::object_handle handle =
+            msgpack::unpack(chunk.data(), chunk.size());
+        value = handle.get().as<T>();
+    } catch (const std::exception &) {
+        throw rpc_error(error_code::FAIL, "result type mismatch");
+    }
+    return true;
+}
+
+template <typename T> void rpc_stream<T>::cancel() {
+    if (!queue_ || finished_) {
+        return;
+    }
+    finished_ = true;
+    bool done = false;
+    {
+        std::unique_lock<std::mutex> lock(queue_->mtx);
+        done = queue_->done;
+    }
+    if (!done) {
+        client_->cancel_stream(req_id_);
+    }
+}
+
 #endif
\ No newline at end of file
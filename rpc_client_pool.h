@@ -0,0 +1,129 @@
+#pragma once
+#ifndef TINY_RPC_CLIENT_POOL_H_
+#define TINY_RPC_CLIENT_POOL_H_
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "rpc_client.h"
+#include "io_service_pool.h"
+
+/*
+* 连接池客户端
+ 对同一个服务端保持多条连接，由若干io线程分担收发和响应解码，
+ 每次调用选择未完成请求最少的连接，调用接口与rpc_client相同。
+ 多线程共享一个客户端时不再受限于单条连接和单个io线程。
+*/
+class rpc_client_pool : private boost::asio::noncopyable {
+  public:
+    // host也可以是uri，见endpoint_uri；
+    // connections：连接数；io_threads：io线程数，连接依次分配到各线程
+    rpc_client_pool(const std::string &host, unsigned short port,
+                    size_t connections, size_t io_threads = 1)
+        : io_service_pool_(io_threads == 0 ? 1 : io_threads) {
+        if (connections == 0) {
+            throw std::invalid_argument("rpc_client_pool connections is 0");
+        }
+        for (size_t i = 0; i < connections; ++i) {
+            clients_.emplace_back(std::make_unique<rpc_client>(
+                io_service_pool_.get_io_service(), host, port));
+        }
+        io_service_pool_.start();
+    }
+
+    ~rpc_client_pool() {
+        // 先停止io线程，保证连接析构后不再有回调执行
+        io_service_pool_.stop();
+        io_service_pool_.join();
+    }
+
+    // 建立所有连接，至少一条连接成功时返回true
+    bool connect(size_t timeout = 3) {
+        bool any = false;
+        for (auto &c : clients_) {
+            any = c->connect(timeout) || any;
+        }
+        return any;
+    }
+
+    // 连接数
+    size_t size() const { return clients_.size(); }
+
+    // 仍然连接着的连接数，断开的连接不再被选中
+    size_t connected() const {
+        size_t n = 0;
+        for (auto &c : clients_) {
+            n += c->has_connected();
+        }
+        return n;
+    }
+
+    // 所有连接的未完成请求数
+    size_t outstanding() const {
+        size_t n = 0;
+        for (auto &c : clients_) {
+            n += c->outstanding();
+        }
+        return n;
+    }
+
+    // 阻塞式调用，参数同rpc_client::call，可以在method前指定期限
+    template <typename T, typename... Args>
+    T call(Args &&...args) {
+        return pick().template call<T>(std::forward<Args>(args)...);
+    }
+
+    // 非阻塞式调用，future式或回调式，见rpc_client::async_call
+    template <typename T, typename... Args>
+    auto async_call(Args &&...args) {
+        return pick().template async_call<T>(std::forward<Args>(args)...);
+    }
+
+    // 批量调用，整批在同一条连接上发出
+    rpc_batch batch() { return pick().batch(); }
+
+    // 流式调用，整个流在同一条连接上，见rpc_client::stream
+    template <typename T, typename... Args>
+    rpc_stream<T> stream(Args &&...args) {
+        return pick().template stream<T>(std::forward<Args>(args)...);
+    }
+
+#ifdef TINY_RPC_HAS_COROUTINE
+    // 协程式调用
+    template <typename T, typename... Args>
+    call_awaiter<T> co_call(Args &&...args) {
+        return pick().template co_call<T>(std::forward<Args>(args)...);
+    }
+#endif
+
+  private:
+    // 选择未完成请求最少的已连接连接；从轮转的起点开始比较，使相同负载时均匀分布
+    rpc_client &pick() {
+        size_t n = clients_.size();
+        size_t start = next_.fetch_add(1, std::memory_order_relaxed) % n;
+        rpc_client *best = nullptr;
+        size_t best_load = 0;
+        for (size_t i = 0; i < n; ++i) {
+            rpc_client *c = clients_[(start + i) % n].get();
+            if (!c->has_connected()) {
+                continue;
+            }
+            size_t load = c->outstanding();
+            if (best == nullptr || load < best_load) {
+                best = c;
+                best_load = load;
+                if (load == 0) {
+                    break;
+                }
+            }
+        }
+        // 全部断开时仍交给一条连接，由其以BADCONNECTION结束调用
+        return best != nullptr ? *best : *clients_[start];
+    }
+
+    io_service_pool io_service_pool_;                  // io线程及其io_service
+    std::vector<std::unique_ptr<rpc_client>> clients_; // 各条连接
+    std::atomic<size_t> next_{0};                      // 轮转起点
+};
+
+#endif
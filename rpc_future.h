@@ -0,0 +1,244 @@
+#pragma once
+#ifndef TINY_RPC_FUTURE_H_
+#define TINY_RPC_FUTURE_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+/*
+* 异步调用的结果
+ 与std::future用法一致，额外支持then()注册完成回调，
+ 结果由io线程直接设置，不需要额外的等待线程。
+*/
+template <typename T> class rpc_future;
+
+namespace future_detail {
+// 共享状态：结果或异常，以及一个完成回调
+template <typename T> struct shared_state {
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool ready = false;
+    bool continued = false; // 已注册过完成回调
+    std::optional<T> value;
+    std::exception_ptr error;
+    std::function<void()> continuation;
+
+    // 设置结果，回调在锁外执行
+    template <typename Setter> void finish(Setter &&setter) {
+        std::function<void()> cont;
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            if (ready) {
+                throw std::future_error(
+                    std::future_errc::promise_already_satisfied);
+            }
+            setter();
+            ready = true;
+            cont = std::move(continuation);
+        }
+        cv.notify_all();
+        if (cont) {
+            cont();
+        }
+    }
+};
+} // namespace future_detail
+
+template <typename T> class rpc_promise {
+  public:
+    rpc_promise() : state_(std::make_shared<future_detail::shared_state<T>>()) {}
+
+    rpc_future<T> get_future() const { return rpc_future<T>(state_); }
+
+    void set_value(T value) {
+        auto st = state_;
+        st->finish([&st, &value] { st->value.emplace(std::move(value)); });
+    }
+
+    void set_exception(std::exception_ptr e) {
+        auto st = state_;
+        st->finish([&st, &e] { st->error = std::move(e); });
+    }
+
+  private:
+    std::shared_ptr<future_detail::shared_state<T>> state_;
+};
+
+template <typename T> class rpc_future {
+  public:
+    rpc_future() = default;
+    explicit rpc_future(std::shared_ptr<future_detail::shared_state<T>> st)
+        : state_(std::move(st)) {}
+
+    bool valid() const { return state_ != nullptr; }
+
+    bool ready() const {
+        check();
+        std::unique_lock<std::mutex> lock(state_->mtx);
+        return state_->ready;
+    }
+
+    void wait() const {
+        check();
+        std::unique_lock<std::mutex> lock(state_->mtx);
+        state_->cv.wait(lock, [this] { return state_->ready; });
+    }
+
+    template <typename Rep, typename Period>
+    std::future_status
+    wait_for(const std::chrono::duration<Rep, Period> &timeout) const {
+        check();
+        std::unique_lock<std::mutex> lock(state_->mtx);
+        bool ok = state_->cv.wait_for(lock, timeout,
+                                      [this] { return state_->ready; });
+        return ok ? std::future_status::ready : std::future_status::timeout;
+    }
+
+    // 阻塞等待结果，失败时抛出异常；与std::future一样只能取一次
+    T get() {
+        wait();
+        auto st = std::move(state_);
+        if (st->error) {
+            std::rethrow_exception(st->error);
+        }
+        return std::move(*st->value);
+    }
+
+    // 注册完成回调，参数为已完成的future；已完成则立即在当前线程执行。
+    // 未完成时回调在设置结果的线程（通常是io线程）上执行，不应阻塞。
+    // 回调取走结果，一个future只能注册一次，再次注册抛出future_error
+    template <typename Callback> void then(Callback &&cb) {
+        check();
+        auto st = state_;
+        std::function<void()> cont = [st, cb = std::forward<Callback>(
+                                              cb)]() mutable {
+            cb(rpc_future<T>(st));
+        };
+        {
+            std::unique_lock<std::mutex> lock(st->mtx);
+            if (st->continued) {
+                throw std::future_error(
+                    std::future_errc::future_already_retrieved);
+            }
+            st->continued = true;
+            if (!st->ready) {
+                st->continuation = std::move(cont);
+                return;
+            }
+        }
+        cont();
+    }
+
+  private:
+    void check() const {
+        if (!state_) {
+            throw std::future_error(std::future_errc::no_state);
+        }
+    }
+
+    std::shared_ptr<future_detail::shared_state<T>> state_;
+};
+
+// 所有调用完成后得到按顺序排列的结果，任一失败则以第一个异常结束；
+// 对每个future注册完成回调，已注册过回调的future会使其抛出future_error。
+// 结果在捕获异常的范围之外设置，后续回调抛出的异常原样传出，不影响计数
+template <typename T>
+rpc_future<std::vector<T>> when_all(std::vector<rpc_future<T>> futures) {
+    struct join_state {
+        std::mutex mtx;
+        std::vector<T> values;
+        size_t remaining = 0;
+        bool failed = false;
+        rpc_promise<std::vector<T>> prom;
+    };
+    auto st = std::make_shared<join_state>();
+    auto result = st->prom.get_future();
+    st->values.resize(futures.size());
+    st->remaining = futures.size();
+    if (futures.empty()) {
+        st->prom.set_value({});
+        return result;
+    }
+
+    for (size_t i = 0; i < futures.size(); ++i) {
+        futures[i].then([st, i](rpc_future<T> f) {
+            std::optional<T> v;
+            try {
+                v.emplace(f.get());
+            } catch (...) {
+                std::unique_lock<std::mutex> lock(st->mtx);
+                --st->remaining;
+                if (!st->failed) {
+                    st->failed = true;
+                    lock.unlock();
+                    st->prom.set_exception(std::current_exception());
+                }
+                return;
+            }
+            std::unique_lock<std::mutex> lock(st->mtx);
+            st->values[i] = std::move(*v);
+            if (--st->remaining == 0 && !st->failed) {
+                auto values = std::move(st->values);
+                lock.unlock();
+                st->prom.set_value(std::move(values));
+            }
+        });
+    }
+    return result;
+}
+
+// 第一个成功完成的调用，结果为(下标，值)；全部失败则以最后一个异常结束；
+// 与when_all一样对每个future注册完成回调，结果在捕获异常的范围之外设置
+template <typename T>
+rpc_future<std::pair<size_t, T>> when_any(std::vector<rpc_future<T>> futures) {
+    struct any_state {
+        std::mutex mtx;
+        size_t remaining = 0;
+        bool done = false;
+        rpc_promise<std::pair<size_t, T>> prom;
+    };
+    auto st = std::make_shared<any_state>();
+    auto result = st->prom.get_future();
+    st->remaining = futures.size();
+    if (futures.empty()) {
+        st->prom.set_exception(std::make_exception_ptr(
+            std::invalid_argument("when_any: no futures")));
+        return result;
+    }
+
+    for (size_t i = 0; i < futures.size(); ++i) {
+        futures[i].then([st, i](rpc_future<T> f) {
+            std::optional<T> v;
+            try {
+                v.emplace(f.get());
+            } catch (...) {
+                std::unique_lock<std::mutex> lock(st->mtx);
+                if (--st->remaining == 0 && !st->done) {
+                    st->done = true;
+                    lock.unlock();
+                    st->prom.set_exception(std::current_exception());
+                }
+                return;
+            }
+            std::unique_lock<std::mutex> lock(st->mtx);
+            --st->remaining;
+            if (!st->done) {
+                st->done = true;
+                lock.unlock();
+                st->prom.set_value(std::make_pair(i, std::move(*v)));
+            }
+        });
+    }
+    return result;
+}
+
+#endif
@@ -5,189 +5,655 @@
 #include <boost/asio.hpp>
 #include <thread>
 #include <mutex>
-#include <unordered_map>
 #include <condition_variable>
+#include <unordered_map>
+#include <optional>
 #include "connection.h"
 #include "io_service_pool.h"
+#include "rpc_task.h"
+#ifdef __linux__
+#include <linux/filter.h>
+#endif
+
+struct rpc_server_bench_access;
 
 // 单例模式不可复制
 class rpc_server : private boost::asio::noncopyable {
   public:
+    // 在所有地址上监听tcp端口，port为0时由系统分配，见port()；
+    // 超过timeout_seconds没有收到数据的连接被断开(有订阅的连接除外)，0表示不限。
+    // 连接关闭时即从连接表删除，check_seconds只为兼容保留，不再使用。
+    // reuseport为true时每个io线程使用自己的SO_REUSEPORT接收器，由内核在各线程间
+    // 分配新连接，连接留在接受它的线程上，线程之间不再经过同一个接收器；
+    // 只适用于tcp，其他传输方式仍使用一个接收器
     rpc_server(unsigned short port, size_t size, size_t timeout_seconds = 15,
-               size_t check_seconds = 10)
-        : io_service_pool_(size),
-          acceptor_(
-              io_service_pool_.get_io_service(),
-              boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), port)),
-          timeout_seconds_(timeout_seconds), check_seconds_(check_seconds) {
-        stop_check_ = false;
-        conn_id_ = 0;
+               size_t check_seconds = 10, bool reuseport = false)
+        : rpc_server(endpoint_uri::make(std::string(), port), size,
+                     timeout_seconds, check_seconds, reuseport) {}
+
+    // 按uri监听：tcp://host:port、unix:///path或shm://name，见endpoint_uri；
+    // unix域套接字的路径上残留的套接字文件会被删除，已有其他类型的文件时抛出异常
+    rpc_server(const std::string &uri, size_t size, size_t timeout_seconds = 15,
+               size_t check_seconds = 10, bool reuseport = false)
+        : rpc_server(endpoint_uri::parse(uri), size, timeout_seconds,
+                     check_seconds, reuseport) {}
+
+    rpc_server(const endpoint_uri &endpoint, size_t size,
+               size_t timeout_seconds, size_t check_seconds,
+               bool reuseport = false)
+        : io_service_pool_(size), endpoint_(endpoint),
+          acceptor_(io_service_pool_.get_io_service(0)),
+          timeout_seconds_(timeout_seconds) {
+        (void)check_seconds;
+        // SO_REUSEPORT须在绑定之前设置，之后的接收器才能加入同一组
+        reuseport = reuseport && endpoint_.kind == transport_kind::tcp &&
+                    io_service_pool_.size() > 1;
+        open_acceptor(acceptor_, listen_endpoint(endpoint), reuseport);
+        if (endpoint_.kind == transport_kind::tcp && endpoint_.port == 0) {
+            // 由系统分配的端口，之后的SO_REUSEPORT接收器也绑定该端口
+            endpoint_.port = local_port(acceptor_);
+        }
         // 初始化注册函数表指针
-        sharedMapPtr_ = std::make_shared<std::unordered_map<
-            std::string,
-            std::function<void(const char *, size_t, std::string &)>>>();
-        // 开始递归等待连接
-        do_accept();
-        // 启动线程用于清理删除超时连接,减少空间占用
-        check_thread_ =
-            std::make_shared<std::thread>([this] { this->clean(); });
+        sharedMapPtr_ = std::make_shared<handler_table>();
+        // 处理函数线程池，set_handler_pool()配置后才会启动
+        handlerPoolPtr_ = std::make_shared<thread_pool>();
+        // 应答缓冲区池，发送完成后缓冲区归还复用
+        bufferPoolPtr_ = std::make_shared<buffer_pool>();
+        // 准入控制，set_admission()配置后才会限制
+        admissionPtr_ = std::make_shared<admission_control>();
+        // 应答压缩，set_compression()配置后才会压缩
+        compressionPtr_ = std::make_shared<frame_compression>();
+        // 发布订阅的主题表
+        hubPtr_ = std::make_shared<pubsub_hub>();
+        // 当前连接表，连接关闭时自行删除
+        connectionsPtr_ = std::make_shared<connection_table>();
+        // 开始递归等待连接；SO_REUSEPORT时acceptor_是第0个线程的接收器
+        if (reuseport) {
+            do_accept(acceptor_, &io_service_pool_.get_io_service(0));
+            open_reuseport_acceptors();
+        } else {
+            do_accept(acceptor_, nullptr);
+        }
     };
 
     ~rpc_server() {
+        io_service_pool_.stop();
+        // run()在其他线程时，等它join完io线程再析构io_service_pool
         {
-            std::unique_lock<std::mutex> lock(mtx_);
-            stop_check_ = true;
-            cv_.notify_all();
+            std::unique_lock<std::mutex> lock(run_mtx_);
+            run_cv_.wait(lock, [this] { return !running_; });
         }
-        check_thread_->join();
-        io_service_pool_.stop();
+        // 唤醒等待流控窗口的流式函数，否则线程池等待它们结束时会一直阻塞
+        connectionsPtr_->cancel_streams();
+        handlerPoolPtr_->stop();
     }
 
     // 开始服务，创建子线程监听io_service
-    void run() { io_service_pool_.run(); }
+    void run() {
+        if (pool_threads_ > 0) {
+            handlerPoolPtr_->start(pool_threads_, pool_queue_);
+        }
+        if (!acceptors_.empty()) {
+            attach_cpu_steering(acceptor_);
+        }
+        {
+            std::unique_lock<std::mutex> lock(run_mtx_);
+            running_ = true;
+        }
+        io_service_pool_.run();
+        // 持锁通知，析构函数被唤醒时本线程已不再访问成员
+        std::unique_lock<std::mutex> lock(run_mtx_);
+        running_ = false;
+        run_cv_.notify_all();
+    }
+
+    // 停止所有io线程，run()随之返回，可以从其他线程调用
+    void stop() { io_service_pool_.stop(); }
 
-    // 函数注册
+    // 配置处理函数线程池，需在run()之前调用；
+    // 未配置时offload方式注册的函数也在io线程执行
+    void set_handler_pool(size_t thread_count, size_t max_queue = 10000) {
+        pool_threads_ = thread_count;
+        pool_queue_ = max_queue;
+    }
+
+    // 配置准入控制，需在run()之前调用，各项为0表示不限：
+    // 每个连接和服务端的在途请求上限，以及请求的排队时间上限；
+    // 排队时间从投递到处理函数线程池算起，只对offload的处理函数有效，
+    // 在io线程上直接执行的处理函数不检查；超过限制的请求以result_code::OVERLOADED拒绝，客户端可换节点重试
+    void set_admission(size_t max_conn_inflight, size_t max_server_inflight,
+                       std::chrono::milliseconds max_queue_delay =
+                           std::chrono::milliseconds(0)) {
+        admissionPtr_->max_conn_inflight = max_conn_inflight;
+        admissionPtr_->max_server_inflight = max_server_inflight;
+        admissionPtr_->max_queue_delay = max_queue_delay;
+    }
+
+    // 配置流式函数等待窗口的限制，需在run()之前调用：等待窗口的时间上限(默认30秒)，
+    // 超过时流以FAIL结束；同时等待窗口的流数上限(默认不限)，超过时流以OVERLOADED结束。
+    // 等待中的流式函数占用处理函数线程池的线程，二者避免慢速的客户端占满线程池；0表示不限
+    void set_stream_limits(std::chrono::milliseconds stall_timeout,
+                           size_t max_stalled = 0) {
+        admissionPtr_->stream_stall_timeout = stall_timeout;
+        admissionPtr_->max_stalled_streams = max_stalled;
+    }
+
+    // 服务端当前的在途请求数，未配置在途上限时不计数
+    size_t inflight() const { return admissionPtr_->inflight.load(); }
+
+    // 正在等待客户端窗口的流数
+    size_t stalled_streams() const {
+        return admissionPtr_->stalled_streams.load();
+    }
+
+    // 当前未关闭的连接数
+    size_t connection_count() const { return connectionsPtr_->size(); }
+
+    // 监听的tcp端口，构造时为0则为系统分配的端口；其他传输方式为0
+    unsigned short port() const { return endpoint_.port; }
+
+    // 配置应答压缩，需在run()之前调用：超过threshold字节的应答体压缩后发送，
+    // 只对在握手中表明支持压缩的客户端生效；0表示不压缩。收到的压缩请求总是解压
+    void set_compression(size_t threshold) {
+        compressionPtr_->threshold = threshold;
+    }
+
+    // 压缩统计：应答的压缩率和压缩耗时，以及请求的解压耗时
+    compression_stats compress_stats() const {
+        return compressionPtr_->stats();
+    }
+
+    // 配置发布订阅，需在run()之前调用：每个订阅者未发送的发布消息上限，
+    // 以及达到上限时的处理方式
+    void set_pubsub(size_t max_queue,
+                    slow_consumer_policy policy =
+                        slow_consumer_policy::drop_oldest) {
+        hubPtr_->max_queue = max_queue == 0 ? 1 : max_queue;
+        hubPtr_->policy = policy;
+    }
+
+    // 向订阅了topic的所有连接发布一条消息，多线程安全，返回订阅者数；
+    // 消息体为[topic, value]，只编码一次，所有订阅者的发送队列共享同一个缓冲区
+    template <typename T>
+    size_t publish(const std::string &topic, const T &value) {
+        auto subs = hubPtr_->subscribers(topic);
+        if (!subs) {
+            return 0;
+        }
+        auto msg = std::make_shared<buffer_type>();
+        msgpack::packer<buffer_type> pk(*msg);
+        pk.pack_array(2);
+        pk.pack(topic);
+        pk.pack(value);
+        if (msg->size() >= MAX_BUF_LEN) {
+            throw std::invalid_argument("publish message is too large");
+        }
+        hubPtr_->published.fetch_add(1, std::memory_order_relaxed);
+        std::shared_ptr<const buffer_type> shared = std::move(msg);
+        size_t n = 0;
+        for (auto &s : *subs) {
+            if (auto conn = s.conn.lock()) {
+                conn->deliver(shared);
+                ++n;
+            }
+        }
+        return n;
+    }
+
+    // 发布订阅统计
+    pubsub_stats publish_stats() const { return hubPtr_->stats(); }
+
+    // tcp连接是否设置TCP_NODELAY，默认设置：小的应答立即发出，不被Nagle算法
+    // 与对端的延迟确认互相等待而推迟；关闭后小包合并发送，包数更少而延迟更高。
+    // 对之后接受的连接生效，其他传输方式忽略
+    void set_no_delay(bool enable) { no_delay_ = enable; }
+
+    // 第i个io线程固定在cpus[i % cpus.size()]上运行，需在run()之前调用；
+    // 构造时指定reuseport且每个线程有各自的CPU时，新连接交给其所在CPU上的线程，
+    // 使连接跟随网卡RSS/RPS的分流，收包和处理在同一个CPU上
+    void set_cpu_affinity(const std::vector<int> &cpus) {
+        io_service_pool_.set_cpu_affinity(cpus);
+    }
+
+    // 选择连接的io后端，需在run()之前调用；内核不支持io_uring时退回epoll，
+    // 实际使用的后端见get_io_backend()。shm连接的数据不经过套接字，不受影响
+    void set_io_backend(io_backend backend) {
+#ifdef TINY_RPC_HAS_IO_URING
+        if (backend == io_backend::uring && !uring_service::supported()) {
+            backend = io_backend::epoll;
+        }
+#else
+        backend = io_backend::epoll;
+#endif
+        backend_ = backend;
+    }
+
+    io_backend get_io_backend() const { return backend_; }
+
+    // 函数注册，policy指定在io线程执行还是投递到处理函数线程池；
+    // 同时按函数名的哈希登记方法id，与已注册函数冲突时抛出std::invalid_argument
     template <typename Function>
-    void register_handler(std::string const &name, const Function &f) {
+    void register_handler(std::string const &name, const Function &f,
+                          exec_policy policy = exec_policy::inline_io) {
         // 注册函数
-        register_nonmember_func(name, std::move(f));
+        register_nonmember_func(name, std::move(f), policy);
+    }
+
+    // 流式函数注册：第一个参数为stream_writer&，通过它依次写出多个结果，
+    // 函数返回后流结束，抛出异常时以错误结束；结果不受MAX_BUF_LEN限制。
+    // 写出受客户端的流控窗口限制，窗口用完时阻塞，因此总是在处理函数线程池中执行，
+    // 需要先set_handler_pool()；每个进行中的流占用线程池的一个线程，等待窗口的限制见set_stream_limits()
+    template <typename Function>
+    void register_stream(std::string const &name, const Function &f) {
+        using params_type = typename meta_util::tuple_tail<
+            typename meta_util::function_traits<Function>::params_tuple>::type;
+        handler_entry entry;
+        entry.policy = exec_policy::offload;
+        entry.stream = [f](const msgpack::object_array &params,
+                           stream_writer &writer) {
+            auto tp =
+                RPCbufferPack::msgpack_codec::unpack_params<params_type>(params);
+            std::apply(
+                [&f, &writer](auto &&...args) {
+                    f(writer, std::move(args)...);
+                },
+                std::move(tp));
+        };
+        sharedMapPtr_->add(name, std::move(entry));
     }
 
   private:
-    // 启动异步接受连接操作
-    void do_accept() {
-        // 重置指针所有权
-        conn_.reset(new connection(io_service_pool_.get_io_service(),
-                                   timeout_seconds_, sharedMapPtr_));
+    // 基准测试不经过网络直接调用分发入口，见bench/codec_bench.cpp
+    friend struct rpc_server_bench_access;
+
+    // 查找已注册的函数，返回连接所用的分发入口，未注册时为空
+    const handler_entry *find_handler(std::string_view name) const {
+        return sharedMapPtr_->find(name);
+    }
+
+    using acceptor_type =
+        boost::asio::basic_socket_acceptor<boost::asio::generic::stream_protocol>;
+
+    // 启动异步接受连接操作；ios为空时连接依次分配到各io线程，否则留在ios上
+    void do_accept(acceptor_type &acceptor, boost::asio::io_service *ios) {
+        std::shared_ptr<connection> conn(new connection(
+            ios != nullptr ? *ios : io_service_pool_.get_io_service(),
+            timeout_seconds_, sharedMapPtr_, handlerPoolPtr_, bufferPoolPtr_,
+            admissionPtr_, compressionPtr_, hubPtr_, connectionsPtr_));
         // 异步等待连接,使用lambda表达式
-        acceptor_.async_accept(
-            conn_->socket(), [this](boost::system::error_code ec) -> void {
+        acceptor.async_accept(
+            conn->socket().stream(),
+            [this, conn, &acceptor, ios](boost::system::error_code ec) -> void {
                 if (ec) {
                     return;
                 }
+                if (endpoint_.kind == transport_kind::shm) {
+                    // 等待连接方交来共享内存，不阻塞后续的接受；
+                    // 超时未完成的连接被关闭，等待时间不超过空闲超时
+                    conn->socket().async_accept_shm(
+                        shm_handshake_timeout(),
+                        [this, conn](boost::system::error_code ec) {
+                            if (!ec) {
+                                start_connection(conn);
+                            }
+                        });
+                } else {
+                    start_connection(conn);
+                }
+                // 递归调用自身，不断接收新的连接
+                do_accept(acceptor, ios);
+            });
+    }
+
+    // 打开并监听接收器，reuseport时在绑定之前设置SO_REUSEPORT
+    static void open_acceptor(acceptor_type &acceptor,
+                              const endpoint_uri::endpoint_type &ep,
+                              bool reuseport) {
+        acceptor.open(ep.protocol());
+        acceptor.set_option(boost::asio::socket_base::reuse_address(true));
+        if (reuseport) {
+            acceptor.set_option(
+                boost::asio::detail::socket_option::boolean<SOL_SOCKET,
+                                                            SO_REUSEPORT>(true));
+        }
+        acceptor.bind(ep);
+        acceptor.listen();
+    }
+
+    // 为第1个及之后的每个io线程打开一个绑定同一端口的SO_REUSEPORT接收器，
+    // 构造时调用，acceptor_一直在监听，已排队的连接不受影响
+    void open_reuseport_acceptors() {
+        auto ep = endpoint_.socket_endpoint();
+        size_t n = io_service_pool_.size();
+        for (size_t i = 1; i < n; ++i) {
+            auto &ios = io_service_pool_.get_io_service(i);
+            auto acceptor = std::make_unique<acceptor_type>(ios);
+            open_acceptor(*acceptor, ep, true);
+            acceptors_.emplace_back(std::move(acceptor));
+            do_accept(*acceptors_.back(), &ios);
+        }
+    }
 
-                // 获取连接的远程端点信息
-                boost::asio::ip::tcp::endpoint remoteEndpoint =
-                    conn_->socket().remote_endpoint();
+    // 按收到连接的CPU选择接收器：第i个接收器属于固定在cpus[i]上的线程，
+    // 其他CPU按取模分配。需要每个线程有各自的CPU，设置失败时由内核按哈希分配
+    void attach_cpu_steering(acceptor_type &acceptor) {
+#ifdef __linux__
+        const auto &cpus = io_service_pool_.cpu_affinity();
+        size_t n = io_service_pool_.size();
+        if (cpus.size() < n) {
+            return;
+        }
+        std::vector<sock_filter> code;
+        code.push_back(BPF_STMT(BPF_LD | BPF_W | BPF_ABS,
+                                static_cast<uint32_t>(SKF_AD_OFF + SKF_AD_CPU)));
+        for (size_t i = 0; i < n; ++i) {
+            code.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,
+                                    static_cast<uint32_t>(cpus[i]), 0, 1));
+            code.push_back(BPF_STMT(BPF_RET | BPF_K, static_cast<uint32_t>(i)));
+        }
+        code.push_back(BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, static_cast<uint32_t>(n)));
+        code.push_back(BPF_STMT(BPF_RET | BPF_A, 0));
+        sock_fprog prog;
+        prog.len = static_cast<unsigned short>(code.size());
+        prog.filter = code.data();
+        ::setsockopt(acceptor.native_handle(), SOL_SOCKET,
+                     SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog));
+#else
+        (void)acceptor;
+#endif
+    }
 
-                // 输出连接的 IP 和端口号
-                std::cout << "Accepted connection from: "
-                          << remoteEndpoint.address().to_string() << ":"
-                          << remoteEndpoint.port() << std::endl;
+    void start_connection(const std::shared_ptr<connection> &conn) {
+        // 输出连接的对端
+        std::cerr << "Accepted connection from: " << conn->socket().peer_name()
+                  << std::endl;
 
-                // 连接的读取
-                conn_->start();
+        conn->socket().set_no_delay(no_delay_);
 
-                // 添加连接编号，使用在局部域避免死锁
-                {
-                    std::unique_lock<std::mutex> lock(mtx_);
-                    conn_->set_conn_id(conn_id_);
-                    connections_[conn_id_++] = conn_;
-                }
-                // 递归调用自身，不断接收新的连接
-                do_accept();
+        // 先加入连接表再开始读取，连接关闭时按编号删除
+        conn->set_conn_id(connectionsPtr_->add(conn));
+
+        // 连接的读取；io_uring需要在连接所属的io线程上启用
+        if (backend_ == io_backend::uring &&
+            endpoint_.kind != transport_kind::shm) {
+            boost::asio::dispatch(conn->socket().get_executor(), [conn] {
+                conn->socket().use_uring();
+                conn->start();
             });
+        } else {
+            conn->start();
+        }
     }
 
-    // 映射中删除超时连接，避免空间膨胀
-    void clean() {
-        while (!stop_check_) {
-            std::unique_lock<std::mutex> lock(mtx_);
-            // 更重要的是提高一种定时机制，定时删除以断开的连接
-            cv_.wait_for(lock, std::chrono::seconds(check_seconds_));
-            for (auto it = connections_.begin(); it != connections_.end();) {
-                if (it->second->has_closed()) {
-                    it = connections_.erase(it);
-                } else {
-                    ++it;
+    // 共享内存握手的等待时间：不超过空闲超时，也不超过shm_channel::HANDSHAKE_TIMEOUT
+    std::chrono::steady_clock::duration shm_handshake_timeout() const {
+        std::chrono::steady_clock::duration limit =
+            shm_channel::HANDSHAKE_TIMEOUT;
+        if (timeout_seconds_ != 0) {
+            limit = std::min(limit, std::chrono::steady_clock::duration(
+                                        std::chrono::seconds(timeout_seconds_)));
+        }
+        return limit;
+    }
+
+    // 监听的套接字地址，unix域套接字先删除路径上残留的套接字文件；
+    // 路径上已有的不是套接字时抛出std::invalid_argument，不删除
+    static endpoint_uri::endpoint_type
+    listen_endpoint(const endpoint_uri &endpoint) {
+        if (endpoint.kind == transport_kind::local) {
+            struct stat st;
+            if (::lstat(endpoint.path.c_str(), &st) == 0) {
+                if (!S_ISSOCK(st.st_mode)) {
+                    throw std::invalid_argument(
+                        "unix socket path exists and is not a socket: " +
+                        endpoint.path);
                 }
+                ::unlink(endpoint.path.c_str());
             }
         }
+        return endpoint.socket_endpoint();
+    }
+
+    // 接收器实际绑定的tcp端口
+    static unsigned short local_port(const acceptor_type &acceptor) {
+        auto ep = acceptor.local_endpoint();
+        boost::asio::ip::tcp::endpoint tcp_ep;
+        memcpy(tcp_ep.data(), ep.data(), ep.size());
+        tcp_ep.resize(ep.size());
+        return tcp_ep.port();
     }
 
-    /*远程过程的调用的系列函数,注意特化第一个为string*/
+    /*远程过程的调用的系列函数,参数元组不含函数名*/
   private:
-    template <typename Function, size_t... Indices, typename Arg,
-              typename... Args>
-    static typename std::result_of<Function(Args...)>::type
+    template <typename Function, size_t... Indices, typename... Args>
+    static typename std::invoke_result<Function, Args...>::type
     call_helper(const Function &f, const std::index_sequence<Indices...> &,
-                std::tuple<Arg, Args...> tup) {
-        return f(std::move(std::get<Indices + 1>(tup))...);
+                [[maybe_unused]] std::tuple<Args...> tup) {
+        return f(std::move(std::get<Indices>(tup))...);
     }
 
     // 处理返回类型 void 的函数调用。
-    template <typename Function, typename Arg, typename... Args>
+    template <typename Function, typename... Args>
     static typename std::enable_if<std::is_void<
-        typename std::result_of<Function(Args...)>::type>::value>::type
-    call(const Function &f, std::string &result, std::tuple<Arg, Args...> tp) {
+        typename std::invoke_result<Function, Args...>::type>::value>::type
+    call(const Function &f, buffer_type &result, std::tuple<Args...> tp) {
         call_helper(f, std::make_index_sequence<sizeof...(Args)>{},
                     std::move(tp));
-        RPCbufferPack::msgpack_codec codec;
-        result = RPCbufferPack::msgpack_codec::pack_args_str(result_code::OK);
+        RPCbufferPack::msgpack_codec::pack_args_to(result, result_code::OK);
     }
 
     // 处理返回类型非 void 的函数调用。
-    template <typename Function, typename Arg, typename... Args>
+    template <typename Function, typename... Args>
     static typename std::enable_if<!std::is_void<
-        typename std::result_of<Function(Args...)>::type>::value>::type
-    call(const Function &f, std::string &result, std::tuple<Arg, Args...> tp) {
+        typename std::invoke_result<Function, Args...>::type>::value>::type
+    call(const Function &f, buffer_type &result, std::tuple<Args...> tp) {
         auto r = call_helper(f, std::make_index_sequence<sizeof...(Args)>{},
                              std::move(tp));
-        RPCbufferPack::msgpack_codec codec;
-        result =
-            RPCbufferPack::msgpack_codec::pack_args_str(result_code::OK, r);
+        RPCbufferPack::msgpack_codec::pack_args_to(result, result_code::OK, r);
     }
 
     template <typename Function> struct invoker {
-        // result 是返回结果字符串
-        static inline void apply(const Function &func, const char *data,
-                                 size_t size, std::string &result) {
-            // 多了一个string参数
-            using argstuple =
-                typename meta_util::function_traits<Function>::args_tuple;
-            RPCbufferPack::msgpack_codec codec;
+        // params 是已解析的参数数组，result 是结果打包进的缓冲区
+        static inline void apply(const Function &func,
+                                 const msgpack::object_array &params,
+                                 buffer_type &result) {
+            using params_type =
+                typename meta_util::function_traits<Function>::params_tuple;
             try {
-                auto tp = codec.unpack<argstuple>(data, size);
-                // 使用模板调用==这里报错了
+                // 直接从已解析的对象转换参数，不再重新解码
+                auto tp =
+                    RPCbufferPack::msgpack_codec::unpack_params<params_type>(
+                        params);
                 call(func, result, std::move(tp));
             } catch (std::invalid_argument &e) {
-                result = codec.pack_args_str(result_code::FAIL, e.what());
+                result.clear();
+                RPCbufferPack::msgpack_codec::pack_args_to(
+                    result, result_code::FAIL, e.what());
+            } catch (const std::exception &e) {
+                result.clear();
+                RPCbufferPack::msgpack_codec::pack_args_to(
+                    result, result_code::FAIL, e.what());
+            }
+        }
+    };
+
+    // 平坦编码的处理函数：参数从请求的参数区按内存布局拷出，结果直接写入缓冲区
+    template <typename Function> struct flat_invoker {
+        using traits = meta_util::function_traits<Function>;
+        using layout =
+            RPCbufferPack::flat_codec::layout<typename traits::return_type,
+                                              typename traits::params_tuple>;
+
+        static inline void apply(const Function &func, const char *data,
+                                 size_t size, buffer_type &result) {
+            using params_type = typename traits::params_tuple;
+            try {
+                auto tp = RPCbufferPack::flat_codec::unpack_args<params_type>(
+                    data, size);
+                if constexpr (std::is_void_v<typename traits::return_type>) {
+                    call_helper(func,
+                                std::make_index_sequence<
+                                    std::tuple_size<params_type>::value>{},
+                                std::move(tp));
+                    RPCbufferPack::flat_codec::pack_result(result,
+                                                           result_code::OK);
+                } else {
+                    auto r = call_helper(
+                        func,
+                        std::make_index_sequence<
+                            std::tuple_size<params_type>::value>{},
+                        std::move(tp));
+                    RPCbufferPack::flat_codec::pack_result(result,
+                                                           result_code::OK, r);
+                }
+            } catch (const std::exception &e) {
+                result.clear();
+                RPCbufferPack::flat_codec::pack_error(result, result_code::FAIL,
+                                                      e.what());
+            }
+        }
+    };
+
+#ifdef TINY_RPC_HAS_COROUTINE
+    // 协程处理函数：先解出参数再启动协程，完成时打包结果
+    template <typename Function> struct co_invoker {
+        using task_type =
+            typename meta_util::function_traits<Function>::return_type;
+
+        static void apply(const Function &func,
+                          const msgpack::object_array &params,
+                          std::function<void(std::string)> done) {
+            using params_type =
+                typename meta_util::function_traits<Function>::params_tuple;
+            std::optional<task_type> task;
+            try {
+                auto tp =
+                    RPCbufferPack::msgpack_codec::unpack_params<params_type>(
+                        params);
+                task.emplace(run(func, std::move(tp)));
             } catch (const std::exception &e) {
-                result = codec.pack_args_str(result_code::FAIL, e.what());
+                done(RPCbufferPack::msgpack_codec::pack_args_str(
+                    result_code::FAIL, e.what()));
+                return;
+            }
+            task->start([done = std::move(done)](
+                            typename task_type::promise_type &p) {
+                try {
+                    if constexpr (std::is_void_v<decltype(p.get())>) {
+                        p.get();
+                        done(RPCbufferPack::msgpack_codec::pack_args_str(
+                            result_code::OK));
+                    } else {
+                        done(RPCbufferPack::msgpack_codec::pack_args_str(
+                            result_code::OK, p.get()));
+                    }
+                } catch (const std::exception &e) {
+                    done(RPCbufferPack::msgpack_codec::pack_args_str(
+                        result_code::FAIL, e.what()));
+                }
+            });
+        }
+
+      private:
+        // 参数元组放在包装协程的帧中，处理函数完成之前一直有效，
+        // 以引用接收参数的协程处理函数在挂起之后仍可使用它们
+        template <typename Tuple>
+        static task_type run(Function func, Tuple tp) {
+            if constexpr (std::is_void_v<typename task_type::value_type>) {
+                co_await std::apply(
+                    [&func](auto &...args) { return func(std::move(args)...); },
+                    tp);
+            } else {
+                co_return co_await std::apply(
+                    [&func](auto &...args) { return func(std::move(args)...); },
+                    tp);
             }
         }
     };
+#endif
+
+    // 返回类型为rpc_task的处理函数按协程注册
+    template <typename Function> static constexpr bool is_coroutine_func() {
+#ifdef TINY_RPC_HAS_COROUTINE
+        return is_rpc_task<typename meta_util::function_traits<
+            Function>::return_type>::value;
+#else
+        return false;
+#endif
+    }
 
-    // 注册函数,使用lambda创建新的函数
+    // 注册函数,使用lambda创建新的函数；
+    // 参数和返回类型都可平坦编码时同时登记平坦编码的处理，由请求的帧标志选择
     template <typename Function>
-    void register_nonmember_func(std::string const &name, Function f) {
-        (*sharedMapPtr_)[name] = [f](const char *data, size_t size,
-                                     std::string &result) {
-            invoker<Function>::apply(std::move(f), data, size, result);
-        };
+    void register_nonmember_func(std::string const &name, Function f,
+                                 exec_policy policy) {
+        handler_entry entry;
+        entry.policy = policy;
+        if constexpr (is_coroutine_func<Function>()) {
+#ifdef TINY_RPC_HAS_COROUTINE
+            entry.async = [f](const msgpack::object_array &params,
+                              std::function<void(std::string)> done) {
+                co_invoker<Function>::apply(f, params, std::move(done));
+            };
+#endif
+        } else {
+            // 有类型只能平坦编码时只登记平坦编码的处理
+            if constexpr (!flat_invoker<Function>::layout::flat_only) {
+                entry.sync = [f](const msgpack::object_array &params,
+                                 buffer_type &result) {
+                    invoker<Function>::apply(f, params, result);
+                };
+            }
+            if constexpr (flat_invoker<Function>::layout::supported) {
+                entry.flat = [f](const char *data, size_t size,
+                                 buffer_type &result) {
+                    flat_invoker<Function>::apply(f, data, size, result);
+                };
+                entry.flat_signature =
+                    flat_invoker<Function>::layout::signature;
+            }
+        }
+        sharedMapPtr_->add(name, std::move(entry));
     }
 
   private:
-    io_service_pool io_service_pool_;         // io事件池
-    boost::asio::ip::tcp::acceptor acceptor_; // tcp接收器
-    std::shared_ptr<connection> conn_;        // 连接类的指针
+    io_service_pool io_service_pool_; // io事件池
+    endpoint_uri endpoint_;           // 监听的地址
+    io_backend backend_ = io_backend::epoll; // 连接的io后端
+    acceptor_type acceptor_;          // 接收器，tcp或unix域套接字
+    // SO_REUSEPORT时第1个及之后的io线程的接收器，第0个线程使用acceptor_
+    std::vector<std::unique_ptr<acceptor_type>> acceptors_;
+    bool no_delay_ = true; // tcp连接设置TCP_NODELAY
     // std::shared_ptr<std::thread> thd_; // 异步执行的线程
     std::size_t timeout_seconds_; // 超时连接的时间
 
-    // 连接所用变量
-    int64_t conn_id_ = 0;
-    std::unordered_map<int64_t, std::shared_ptr<connection>>
-        connections_;                           // 连接序号映射
-    std::shared_ptr<std::thread> check_thread_; // 定时清理的线程
-    size_t check_seconds_;                      // 定时清理的时间
-    bool stop_check_ = false;
-    std::mutex mtx_;             // 互斥锁
-    std::condition_variable cv_; // 条件变量
+    // 当前连接表，和每个connection共享
+    std::shared_ptr<connection_table> connectionsPtr_;
 
     // 函数映射表指针，和每个connection共享
-    std::shared_ptr<std::unordered_map<
-        std::string, std::function<void(const char *, size_t, std::string &)>>>
-        sharedMapPtr_;
+    std::shared_ptr<handler_table> sharedMapPtr_;
+
+    // 处理函数线程池，和每个connection共享
+    std::shared_ptr<thread_pool> handlerPoolPtr_;
+    size_t pool_threads_ = 0;
+    size_t pool_queue_ = 0;
+
+    // run()是否在执行，析构时等待其返回
+    std::mutex run_mtx_;
+    std::condition_variable run_cv_;
+    bool running_ = false;
+
+    // 应答缓冲区池，和每个connection共享
+    std::shared_ptr<buffer_pool> bufferPoolPtr_;
+
+    // 准入控制，和每个connection共享
+    std::shared_ptr<admission_control> admissionPtr_;
+
+    // 压缩配置及统计，和每个connection共享
+    std::shared_ptr<frame_compression> compressionPtr_;
+
+    // 发布订阅的主题表，和每个connection共享
+    std::shared_ptr<pubsub_hub> hubPtr_;
 };
 
 #endif
\ No newline at end of file
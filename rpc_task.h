@@ -0,0 +1,143 @@
+#pragma once
+#ifndef TINY_RPC_TASK_H_
+#define TINY_RPC_TASK_H_
+
+// 协程支持需要C++20，低版本编译时整个头文件为空
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+#define TINY_RPC_HAS_COROUTINE 1
+
+/*
+* 协程任务类型
+ 惰性启动：可以在另一个协程中co_await，也可以通过start()分离执行，
+ 完成时调用回调并自行销毁协程帧。服务端协程处理函数以此为返回类型。
+*/
+template <typename T> class rpc_task;
+
+namespace task_detail {
+// 保存协程的返回值或异常
+template <typename T> struct task_result {
+    std::optional<T> value;
+    std::exception_ptr error;
+
+    void return_value(T v) { value.emplace(std::move(v)); }
+
+    T get() {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        return std::move(*value);
+    }
+};
+
+template <> struct task_result<void> {
+    std::exception_ptr error;
+
+    void return_void() {}
+
+    void get() {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+};
+} // namespace task_detail
+
+template <typename T> class rpc_task {
+  public:
+    using value_type = T;
+
+    struct promise_type : task_detail::task_result<T> {
+        std::coroutine_handle<> continuation;   // co_await本任务的协程
+        std::function<void(promise_type &)> on_done; // 分离执行时的完成回调
+
+        rpc_task get_return_object() {
+            return rpc_task(
+                std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        struct final_awaiter {
+            bool await_ready() noexcept { return false; }
+
+            std::coroutine_handle<>
+            await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+                auto &p = h.promise();
+                if (p.continuation) {
+                    return p.continuation;
+                }
+                if (p.on_done) {
+                    auto done = std::move(p.on_done);
+                    done(p);
+                    h.destroy();
+                }
+                return std::noop_coroutine();
+            }
+
+            void await_resume() noexcept {}
+        };
+
+        final_awaiter final_suspend() noexcept { return {}; }
+
+        void unhandled_exception() { this->error = std::current_exception(); }
+    };
+
+    using handle_type = std::coroutine_handle<promise_type>;
+
+    rpc_task(rpc_task &&other) noexcept
+        : handle_(std::exchange(other.handle_, {})) {}
+
+    rpc_task &operator=(rpc_task &&other) noexcept {
+        if (this != &other) {
+            destroy();
+            handle_ = std::exchange(other.handle_, {});
+        }
+        return *this;
+    }
+
+    ~rpc_task() { destroy(); }
+
+    // 在另一个协程中等待本任务
+    bool await_ready() const noexcept { return false; }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> cont) {
+        handle_.promise().continuation = cont;
+        return handle_;
+    }
+
+    T await_resume() { return handle_.promise().get(); }
+
+    // 分离执行，完成时以promise调用回调，之后协程帧自行销毁
+    template <typename Callback> void start(Callback &&cb) {
+        auto h = std::exchange(handle_, {});
+        h.promise().on_done = std::forward<Callback>(cb);
+        h.resume();
+    }
+
+  private:
+    explicit rpc_task(handle_type h) : handle_(h) {}
+
+    void destroy() {
+        if (handle_) {
+            handle_.destroy();
+            handle_ = {};
+        }
+    }
+
+    handle_type handle_;
+};
+
+// 判断处理函数是否为协程
+template <typename T> struct is_rpc_task : std::false_type {};
+template <typename T> struct is_rpc_task<rpc_task<T>> : std::true_type {};
+
+#endif
+
+#endif
@@ -0,0 +1,68 @@
+// 准入控制：超过连接和服务端的在途上限、或在线程池中排队过久的请求以OVERLOADED拒绝
+#include "test_util.h"
+#include "rpc_client.h"
+
+using namespace std::chrono_literals;
+
+static int slow(int ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+    return ms;
+}
+
+// 等待全部结果，返回成功数和被拒绝数
+static std::pair<int, int> collect(std::vector<rpc_future<int>> &fs) {
+    int ok = 0, overloaded = 0;
+    for (auto &f : fs) {
+        try {
+            f.get();
+            ok++;
+        } catch (const rpc_error &e) {
+            overloaded += e.code() == error_code::OVERLOADED;
+        }
+    }
+    return {ok, overloaded};
+}
+
+int main() {
+    // 每个连接4个、服务端6个在途请求
+    auto *s = new rpc_server(0, 1);
+    s->set_handler_pool(8, 1000);
+    s->set_admission(4, 6);
+    s->register_handler("slow", slow, exec_policy::offload);
+    start_server(s);
+    rpc_client a("127.0.0.1", s->port()), b("127.0.0.1", s->port());
+    CHECK(a.connect(3));
+    CHECK(b.connect(3));
+    std::vector<rpc_future<int>> fa, fb;
+    for (int i = 0; i < 10; ++i) {
+        fa.push_back(a.async_call<int>("slow", 100));
+    }
+    // a的4个请求占住名额之后b才发出
+    CHECK(wait_until([s] { return s->inflight() == 4; }));
+    for (int i = 0; i < 10; ++i) {
+        fb.push_back(b.async_call<int>("slow", 100));
+    }
+    auto ra = collect(fa), rb = collect(fb);
+    CHECK(ra.first == 4 && ra.second == 6);
+    CHECK(rb.first == 2 && rb.second == 8);
+    // 名额在应答发送完成后释放，可能晚于客户端收到应答
+    CHECK(wait_until([s] { return s->inflight() == 0; }));
+    CHECK(a.call<int>("slow", 1) == 1);
+
+    // 排队时间上限：单个工作线程，排队超过30ms的请求被拒绝
+    auto *s2 = new rpc_server(0, 1);
+    s2->set_handler_pool(1, 1000);
+    s2->set_admission(0, 0, 30ms);
+    s2->register_handler("slow", slow, exec_policy::offload);
+    start_server(s2);
+    rpc_client c("127.0.0.1", s2->port());
+    CHECK(c.connect(3));
+    std::vector<rpc_future<int>> fc;
+    for (int i = 0; i < 10; ++i) {
+        fc.push_back(c.async_call<int>("slow", 20));
+    }
+    auto rc = collect(fc);
+    CHECK(rc.first >= 1 && rc.first <= 3);
+    CHECK(rc.first + rc.second == 10);
+    return test_result("test_admission");
+}
@@ -0,0 +1,80 @@
+// 负载均衡：轮转、两选一、一致性哈希的key亲和，以及节点的摘除与重新加入
+#include <map>
+#include "test_util.h"
+#include "rpc_balancer.h"
+
+// 启动一个节点，whoami返回其端口；port为0时由系统分配
+static unsigned short start_node(unsigned short port = 0) {
+    auto *s = new rpc_server(port, 1);
+    unsigned short p = s->port();
+    s->register_handler("whoami", [p]() { return static_cast<int>(p); });
+    start_server(s);
+    return p;
+}
+
+int main() {
+    std::vector<rpc_endpoint> eps;
+    for (int i = 0; i < 3; ++i) {
+        eps.push_back({"127.0.0.1", start_node()});
+    }
+    // 第4个节点开始时不可用
+    unsigned short late = free_port();
+    eps.push_back({"127.0.0.1", late});
+
+    // 轮转：不可用的节点被摘除，其余节点均分
+    {
+        rpc_balancer lb(eps, lb_policy::round_robin, 1, 1);
+        CHECK(lb.connect(1));
+        CHECK(lb.healthy() == 3);
+        std::map<int, int> hits;
+        for (int i = 0; i < 300; ++i) {
+            hits[lb.call<int>("whoami")]++;
+        }
+        CHECK(hits.size() == 3);
+        CHECK(hits.count(late) == 0);
+        for (auto &h : hits) {
+            CHECK(h.second == 100);
+        }
+        // 节点恢复后由重连线程重新加入
+        start_node(late);
+        CHECK(wait_until([&] { return lb.healthy() == 4; },
+                         std::chrono::milliseconds(5000)));
+        hits.clear();
+        for (int i = 0; i < 400; ++i) {
+            hits[lb.call<int>("whoami")]++;
+        }
+        CHECK(hits[late] > 0);
+    }
+
+    // 两选一：并发的异步调用分布到所有节点
+    {
+        rpc_balancer lb(eps, lb_policy::power_of_two);
+        CHECK(lb.connect(1));
+        std::vector<rpc_future<int>> fs;
+        for (int i = 0; i < 400; ++i) {
+            fs.push_back(lb.async_call<int>("whoami"));
+        }
+        std::map<int, int> hits;
+        for (auto &f : fs) {
+            hits[f.get()]++;
+        }
+        CHECK(hits.size() == 4);
+    }
+
+    // 一致性哈希：相同的key总是落在同一节点，不同的key分布到所有节点
+    {
+        rpc_balancer lb(eps, lb_policy::consistent_hash);
+        CHECK(lb.connect(1));
+        std::map<int, int> hits;
+        for (int k = 0; k < 200; ++k) {
+            std::string key = "user" + std::to_string(k);
+            int first = lb.call_by_key<int>(key, "whoami");
+            for (int i = 0; i < 3; ++i) {
+                CHECK(lb.call_by_key<int>(key, "whoami") == first);
+            }
+            hits[first]++;
+        }
+        CHECK(hits.size() == 4);
+    }
+    return test_result("test_balancer");
+}
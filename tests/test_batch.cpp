@@ -0,0 +1,58 @@
+// 批量调用：结果与请求一一对应，单个失败不影响其他，offload的函数并行执行
+#include "test_util.h"
+#include "rpc_client.h"
+
+static int add(int a, int b) { return a + b; }
+static std::string slow_echo(std::string s) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    return s;
+}
+static void nothing() {}
+
+int main() {
+    auto *s = new rpc_server(0, 1);
+    s->set_handler_pool(4, 1000);
+    s->register_handler("add", add);
+    s->register_handler("slow_echo", slow_echo, exec_policy::offload);
+    s->register_handler("nothing", nothing);
+    start_server(s);
+    rpc_client c("127.0.0.1", s->port());
+    CHECK(c.connect(3));
+
+    auto b = c.batch();
+    for (int i = 0; i < 100; ++i) {
+        b.add<int>(i % 2 ? rpc_method::by_id("add") : rpc_method("add"), i, 1);
+    }
+    for (int i = 0; i < 4; ++i) {
+        b.add<std::string>("slow_echo", std::string(i * 10, 'x'));
+    }
+    b.add<int>("no_such", 1);
+    b.add<int>("add", 1); // 参数个数不符
+    b.add<void>("nothing");
+    auto t0 = std::chrono::steady_clock::now();
+    auto r = b.execute().get();
+    auto elapsed = std::chrono::steady_clock::now() - t0;
+    CHECK(r.size() == 107);
+    for (int i = 0; i < 100; ++i) {
+        CHECK(r.ok(i) && r.get<int>(i) == i + 1);
+    }
+    for (int i = 0; i < 4; ++i) {
+        CHECK(r.get<std::string>(100 + i) == std::string(i * 10, 'x'));
+    }
+    CHECK(!r.ok(104));
+    CHECK(!r.ok(105));
+    CHECK(r.ok(106));
+    bool thrown = false;
+    try {
+        r.get<int>(104);
+    } catch (const rpc_error &) {
+        thrown = true;
+    }
+    CHECK(thrown);
+    // 4个20ms的函数在线程池中并行
+    CHECK(elapsed < std::chrono::milliseconds(70));
+
+    CHECK(c.batch().execute().get().size() == 0);
+    CHECK(c.call<int>("add", 2, 3) == 5);
+    return test_result("test_batch");
+}
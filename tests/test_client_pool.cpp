@@ -0,0 +1,89 @@
+// 连接池客户端：并发的调用分到未完成请求最少的连接，断开的连接不再被选中，
+// 连接数可以多于io线程数
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "test_util.h"
+#include "rpc_client_pool.h"
+
+static std::atomic<bool> g_release{false};
+
+// 在处理函数线程池中等待放行，返回参数
+static int hold(int v) {
+    wait_until([] { return g_release.load(); }, std::chrono::milliseconds(5000));
+    return v;
+}
+static int add(int a, int b) { return a + b; }
+
+int main() {
+    // 每个连接只允许1个在途请求：4个并发调用都成功说明分到了4条不同的连接
+    {
+        auto *s = new rpc_server(0, 2);
+        s->set_handler_pool(8);
+        s->set_admission(1, 0);
+        s->register_handler("hold", hold, exec_policy::offload);
+        s->register_handler("add", add);
+        start_server(s);
+        rpc_client_pool pool("127.0.0.1", s->port(), 4, 2);
+        CHECK(pool.connect(3));
+        CHECK(pool.size() == 4 && pool.connected() == 4);
+
+        std::vector<rpc_future<int>> fs;
+        for (int i = 0; i < 4; ++i) {
+            fs.push_back(pool.async_call<int>("hold", i));
+        }
+        CHECK(pool.outstanding() == 4);
+        CHECK(wait_until([s] { return s->inflight() == 4; }));
+        g_release = true;
+        for (int i = 0; i < 4; ++i) {
+            CHECK(fs[i].get() == i);
+        }
+
+        // 多个线程共享连接池
+        std::atomic<int> wrong{0};
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([&, t] {
+                for (int i = 0; i < 200; ++i) {
+                    try {
+                        wrong += pool.call<int>("add", t, i) != t + i;
+                    } catch (const rpc_error &e) {
+                        // 同一连接上的请求超过准入上限时被拒绝
+                        wrong += e.code() != error_code::OVERLOADED;
+                    }
+                }
+            });
+        }
+        for (auto &t : threads) {
+            t.join();
+        }
+        CHECK(wrong == 0);
+    }
+
+    // 空闲超时1秒：3条连接上有处理中的请求，空闲的一条被服务端断开，之后的调用不再选中它
+    {
+        g_release = false;
+        auto *s = new rpc_server(0, 1, 1);
+        s->set_handler_pool(4);
+        s->register_handler("hold", hold, exec_policy::offload);
+        s->register_handler("add", add);
+        start_server(s);
+        rpc_client_pool pool("127.0.0.1", s->port(), 4, 2);
+        CHECK(pool.connect(3));
+        std::vector<rpc_future<int>> fs;
+        for (int i = 0; i < 3; ++i) {
+            fs.push_back(pool.async_call<int>("hold", i));
+        }
+        CHECK(wait_until([s] { return s->connection_count() == 3; },
+                         std::chrono::milliseconds(5000)));
+        CHECK(wait_until([&pool] { return pool.connected() == 3; }));
+        g_release = true;
+        for (int i = 0; i < 3; ++i) {
+            CHECK(fs[i].get() == i);
+        }
+        for (int i = 0; i < 30; ++i) {
+            CHECK(pool.call<int>("add", i, 1) == i + 1);
+        }
+    }
+    return test_result("test_client_pool");
+}
@@ -0,0 +1,92 @@
+// 编码：msgpack可编码的类型同时支持两种编码，只能平坦编码的类型只接受平坦编码；
+// 平坦编码只自动接受算术类型，其他类型需标明，大小相同的不同类型互不接受
+#include <array>
+#include "test_util.h"
+#include "rpc_client.h"
+
+enum class color : int { red, green, blue };
+MSGPACK_ADD_ENUM(color);
+
+// 没有msgpack适配的结构体，标明只能平坦编码
+struct point {
+    int x;
+    int y;
+};
+// 与point大小相同的另一个结构体，标明可以平坦编码
+struct extent {
+    int w;
+    int h;
+    MSGPACK_DEFINE(w, h);
+};
+namespace RPCbufferPack {
+template <> struct flat_only_type<point> : std::true_type {};
+template <> struct flat_type<extent> : std::true_type {};
+} // namespace RPCbufferPack
+
+using flat_layout = RPCbufferPack::flat_codec;
+static_assert(flat_layout::layout<int, std::tuple<double, std::string>>::supported);
+static_assert(flat_layout::layout<extent, std::tuple<std::vector<extent>>>::supported);
+// bool、枚举和未标明的结构体不自动平坦编码
+static_assert(!flat_layout::layout<bool, std::tuple<>>::supported);
+static_assert(!flat_layout::layout<int, std::tuple<color>>::supported);
+static_assert(!flat_layout::layout<int, std::tuple<std::pair<int, int>>>::supported);
+static_assert(flat_layout::layout<point, std::tuple<>>::signature !=
+              flat_layout::layout<extent, std::tuple<>>::signature);
+
+static color next_color(color c) {
+    return static_cast<color>((static_cast<int>(c) + 1) % 3);
+}
+static int sum3(std::array<int, 3> v) { return v[0] + v[1] + v[2]; }
+static point move_point(point p, int d) { return point{p.x + d, p.y + d}; }
+static extent grow(extent e, int d) { return extent{e.w + d, e.h + d}; }
+
+int main() {
+    auto *s = new rpc_server(0, 1);
+    s->register_handler("next_color", next_color);
+    s->register_handler("sum3", sum3);
+    s->register_handler("move_point", move_point);
+    s->register_handler("grow", grow);
+    start_server(s);
+    rpc_client c("127.0.0.1", s->port());
+    CHECK(c.connect(3));
+
+    // 枚举和std::array：默认按msgpack调用，也可以指定平坦编码
+    CHECK(c.call<color>("next_color", color::blue) == color::red);
+    CHECK(c.call<int>("sum3", std::array<int, 3>{1, 2, 3}) == 6);
+    auto flat = rpc_method("sum3").with_codec(codec_type::flat);
+    CHECK(c.call<int>(flat, std::array<int, 3>{4, 5, 6}) == 15);
+    constexpr rpc_method next_id = rpc_method::by_id("next_color");
+    CHECK(c.call<color>(next_id, color::red) == color::green);
+
+    // 批量请求只使用msgpack
+    auto r = c.batch()
+                 .add<color>("next_color", color::green)
+                 .add<int>("sum3", std::array<int, 3>{7, 8, 9})
+                 .add<int>("move_point", 1, 1)
+                 .execute()
+                 .get();
+    CHECK(r.ok(0) && r.get<color>(0) == color::blue);
+    CHECK(r.ok(1) && r.get<int>(1) == 24);
+    // 只能平坦编码的函数拒绝msgpack编码的请求
+    CHECK(!r.ok(2));
+
+    // 只能平坦编码的类型，客户端自动使用平坦编码
+    point p = c.call<point>("move_point", point{1, 2}, 10);
+    CHECK(p.x == 11 && p.y == 12);
+
+    // 标明的结构体两种编码都可以使用
+    auto grow_flat = rpc_method("grow").with_codec(codec_type::flat);
+    extent e = c.call<extent>(grow_flat, extent{1, 2}, 1);
+    CHECK(e.w == 2 && e.h == 3);
+    e = c.call<extent>("grow", extent{1, 2}, 2);
+    CHECK(e.w == 3 && e.h == 4);
+    // 大小相同的不同结构体由类型签名拒绝，不按内存布局重新解释
+    bool rejected = false;
+    try {
+        c.call<point>("grow", point{1, 2}, 1);
+    } catch (const std::exception &) {
+        rejected = true;
+    }
+    CHECK(rejected);
+    return test_result("test_codec");
+}
@@ -0,0 +1,64 @@
+// 压缩：lz的往返与损坏输入，以及超过阈值的帧在连接上的压缩与解压
+#include <cstring>
+#include <random>
+#include "test_util.h"
+#include "rpc_client.h"
+
+static std::string echo(std::string s) { return s; }
+
+int main() {
+    std::mt19937 rng(1);
+    for (int t = 0; t < 200; ++t) {
+        size_t n = rng() % 70000;
+        std::string src(n, '\0');
+        int alphabet = 1 + rng() % 255;
+        for (auto &ch : src) {
+            ch = static_cast<char>(rng() % alphabet);
+        }
+        std::vector<char> packed(lz::compress_bound(n));
+        size_t m = lz::compress(src.data(), n, packed.data(), packed.size());
+        // 多留一个字节，用于检查声明的原始长度与实际不符的情况
+        std::string out(n + 1, '\0');
+        CHECK(m != 0 && lz::decompress(packed.data(), m, &out[0], n));
+        CHECK(out.compare(0, n, src) == 0);
+        if (n == 0) {
+            continue;
+        }
+        // 截断的输入、长度不符的输入报错，翻转字节的输入不能越界
+        CHECK(!lz::decompress(packed.data(), m - 1, &out[0], n));
+        CHECK(!lz::decompress(packed.data(), m, &out[0], n + 1));
+        packed[m / 2] ^= 0x5a;
+        lz::decompress(packed.data(), m, &out[0], n);
+    }
+
+    auto *s = new rpc_server(0, 1);
+    s->set_handler_pool(2, 1000);
+    s->set_compression(4096);
+    s->register_handler("echo", echo, exec_policy::offload);
+    start_server(s);
+    rpc_client c("127.0.0.1", s->port());
+    c.set_compression(4096);
+    CHECK(c.connect(3));
+    // 握手的回复先于该调用的应答到达，之后的请求按服务端的支持压缩
+    CHECK(c.call<std::string>("echo", std::string("hello")) == "hello");
+
+    std::string big(2 * 1024 * 1024, 'x');
+    for (size_t i = 0; i < big.size(); i += 7) {
+        big[i] = static_cast<char>('a' + i % 26);
+    }
+    CHECK(c.call<std::string>("echo", big) == big);
+    CHECK(c.call<std::string>("echo", std::string("tiny")) == "tiny");
+    auto cs = c.compress_stats(), ss = s->compress_stats();
+    CHECK(cs.compressed_frames == 1 && cs.decompressed_frames == 1);
+    CHECK(ss.compressed_frames == 1 && ss.decompressed_frames == 1);
+    CHECK(cs.ratio() < 0.5);
+
+    // 压缩无效果的帧按原样发送
+    std::string noise(100000, '\0');
+    for (auto &ch : noise) {
+        ch = static_cast<char>(rng());
+    }
+    CHECK(c.call<std::string>("echo", noise) == noise);
+    CHECK(c.compress_stats().skipped_frames == 1);
+    return test_result("test_compression");
+}
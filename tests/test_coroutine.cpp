@@ -0,0 +1,83 @@
+// 协程：协程处理函数挂起后以引用参数继续执行，客户端以co_call等待结果
+#include <future>
+#include "test_util.h"
+#include "rpc_client.h"
+
+// 在另一个线程上恢复协程，模拟等待其他服务的处理函数
+struct resume_later {
+    bool await_ready() const { return false; }
+    void await_suspend(std::coroutine_handle<> h) {
+        std::thread([h] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            h.resume();
+        }).detach();
+    }
+    void await_resume() {}
+};
+
+// 以引用接收参数，挂起时请求数据已释放，参数须仍然有效
+static rpc_task<std::string> greet(const std::string &name, int times) {
+    co_await resume_later{};
+    std::string r;
+    for (int i = 0; i < times; ++i) {
+        r += name;
+    }
+    co_return r;
+}
+
+static rpc_task<void> check_positive(const int &v) {
+    co_await resume_later{};
+    if (v <= 0) {
+        throw std::invalid_argument("not positive");
+    }
+}
+
+// 客户端协程：依次等待两个调用
+static rpc_task<std::string> two_calls(rpc_client &c) {
+    auto a = co_await c.co_call<std::string>("greet", std::string("ab"), 2);
+    auto b = co_await c.co_call<std::string>("greet", std::string(300, 'z'), 1);
+    co_return a + std::to_string(b.size());
+}
+
+int main() {
+    auto *s = new rpc_server(0, 1);
+    s->register_handler("greet", greet);
+    s->register_handler("check_positive", check_positive);
+    start_server(s);
+    rpc_client c("127.0.0.1", s->port());
+    CHECK(c.connect(3));
+
+    CHECK(c.call<std::string>("greet", std::string(1000, 'x'), 3) ==
+          std::string(3000, 'x'));
+    std::vector<rpc_future<std::string>> fs;
+    for (int i = 0; i < 100; ++i) {
+        fs.push_back(c.async_call<std::string>("greet", std::to_string(i), 2));
+    }
+    for (int i = 0; i < 100; ++i) {
+        CHECK(fs[i].get() == std::to_string(i) + std::to_string(i));
+    }
+    // 批量请求中的协程项，返回void的协程以异常结束时该项失败
+    auto r = c.batch()
+                 .add<std::string>("greet", std::string("q"), 4)
+                 .add<void>("check_positive", 1)
+                 .add<void>("check_positive", 0)
+                 .execute()
+                 .get();
+    CHECK(r.ok(0) && r.get<std::string>(0) == "qqqq");
+    CHECK(r.ok(1));
+    CHECK(!r.ok(2) && r.error(2) == "not positive");
+
+    std::promise<std::string> done;
+    auto result = done.get_future();
+    two_calls(c).start([&done](rpc_task<std::string>::promise_type &p) {
+        try {
+            done.set_value(p.get());
+        } catch (...) {
+            done.set_exception(std::current_exception());
+        }
+    });
+    CHECK(result.wait_for(std::chrono::seconds(3)) ==
+          std::future_status::ready);
+    CHECK(result.get() == "abab300");
+    return test_result("test_coroutine");
+}
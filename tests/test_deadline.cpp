@@ -0,0 +1,60 @@
+// 调用期限：超时的调用以TIMEOUT结束，服务端不再执行已过期的排队请求
+#include <atomic>
+#include "test_util.h"
+#include "rpc_client.h"
+
+using namespace std::chrono_literals;
+
+static std::atomic<int> executed{0};
+static int slow(int ms) {
+    executed++;
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+    return ms;
+}
+static int fast(int a) { return a; }
+
+int main() {
+    auto *s = new rpc_server(0, 1);
+    s->set_handler_pool(1, 1000);
+    s->register_handler("slow", slow, exec_policy::offload);
+    s->register_handler("fast", fast);
+    start_server(s);
+    rpc_client c("127.0.0.1", s->port());
+    CHECK(c.connect(3));
+
+    // 第一个调用占住唯一的工作线程，后面期限较短的调用都应超时且不被执行
+    auto first = c.async_call<int>(500ms, "slow", 200);
+    std::vector<rpc_future<int>> fs;
+    for (int i = 0; i < 10; ++i) {
+        fs.push_back(c.async_call<int>(50ms, "slow", 10));
+    }
+    int timeouts = 0;
+    for (auto &f : fs) {
+        try {
+            f.get();
+        } catch (const rpc_error &e) {
+            timeouts += e.code() == error_code::TIMEOUT;
+        }
+    }
+    CHECK(timeouts == 10);
+    CHECK(first.get() == 200);
+    // 唯一的工作线程按序处理，此调用返回时排在前面的请求都已被取出
+    CHECK(c.call<int>(1000ms, "slow", 0) == 0);
+    CHECK(executed == 2);
+    CHECK(c.outstanding() == 0);
+
+    // 阻塞式调用的期限
+    bool timed_out = false;
+    try {
+        c.call<int>(20ms, "slow", 100);
+    } catch (const rpc_error &e) {
+        timed_out = e.code() == error_code::TIMEOUT;
+    }
+    CHECK(timed_out);
+    // 不限期的调用排在超时的调用之后，返回时迟到的应答已到达并被忽略
+    c.set_timeout(0ms);
+    CHECK(c.call<int>("slow", 1) == 1);
+    CHECK(c.call<int>("fast", 7) == 7);
+    CHECK(c.outstanding() == 0);
+    return test_result("test_deadline");
+}
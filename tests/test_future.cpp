@@ -0,0 +1,135 @@
+// 异步结果的组合：when_all、when_any、then只能注册一次，后续回调抛出的异常不影响计数
+#include <stdexcept>
+#include "test_util.h"
+#include "rpc_client.h"
+
+static int add(int a, int b) { return a + b; }
+
+template <typename T> static bool throws_future_error(rpc_future<T> &f) {
+    try {
+        f.then([](rpc_future<T>) {});
+    } catch (const std::future_error &) {
+        return true;
+    }
+    return false;
+}
+
+int main() {
+    // when_all按顺序给出结果，与完成的先后无关
+    {
+        std::vector<rpc_promise<int>> ps(3);
+        std::vector<rpc_future<int>> fs;
+        for (auto &p : ps) {
+            fs.push_back(p.get_future());
+        }
+        auto all = when_all(fs);
+        ps[2].set_value(30);
+        ps[0].set_value(10);
+        CHECK(!all.ready());
+        ps[1].set_value(20);
+        CHECK((all.get() == std::vector<int>{10, 20, 30}));
+        // 已由when_all注册回调的future不能再注册
+        CHECK(throws_future_error(fs[0]));
+    }
+    // when_all以第一个异常结束，之后的完成不再设置结果
+    {
+        std::vector<rpc_promise<int>> ps(3);
+        std::vector<rpc_future<int>> fs;
+        for (auto &p : ps) {
+            fs.push_back(p.get_future());
+        }
+        auto all = when_all(fs);
+        ps[1].set_exception(std::make_exception_ptr(std::runtime_error("x")));
+        ps[0].set_exception(std::make_exception_ptr(std::logic_error("y")));
+        ps[2].set_value(3);
+        bool failed = false;
+        try {
+            all.get();
+        } catch (const std::runtime_error &) {
+            failed = true;
+        }
+        CHECK(failed);
+        CHECK(when_all(std::vector<rpc_future<int>>{}).get().empty());
+    }
+    // 后续回调抛出的异常原样传给设置结果的一方，不变成future_error
+    {
+        rpc_promise<int> p;
+        auto all = when_all(std::vector<rpc_future<int>>{p.get_future()});
+        all.then([](rpc_future<std::vector<int>>) {
+            throw std::domain_error("continuation");
+        });
+        bool domain = false;
+        try {
+            p.set_value(1);
+        } catch (const std::domain_error &) {
+            domain = true;
+        } catch (const std::future_error &) {
+        }
+        CHECK(domain);
+    }
+    // when_any给出第一个成功的下标和值，失败的不算
+    {
+        std::vector<rpc_promise<int>> ps(3);
+        std::vector<rpc_future<int>> fs;
+        for (auto &p : ps) {
+            fs.push_back(p.get_future());
+        }
+        auto any = when_any(fs);
+        ps[0].set_exception(std::make_exception_ptr(std::runtime_error("x")));
+        CHECK(!any.ready());
+        ps[2].set_value(7);
+        ps[1].set_value(5);
+        auto r = any.get();
+        CHECK(r.first == 2 && r.second == 7);
+    }
+    // when_any全部失败时以最后一个异常结束
+    {
+        std::vector<rpc_promise<int>> ps(2);
+        auto any = when_any(
+            std::vector<rpc_future<int>>{ps[0].get_future(), ps[1].get_future()});
+        ps[0].set_exception(std::make_exception_ptr(std::runtime_error("x")));
+        ps[1].set_exception(std::make_exception_ptr(std::logic_error("y")));
+        bool failed = false;
+        try {
+            any.get();
+        } catch (const std::logic_error &) {
+            failed = true;
+        }
+        CHECK(failed);
+        rpc_promise<int> p;
+        auto any2 = when_any(std::vector<rpc_future<int>>{p.get_future()});
+        any2.then([](rpc_future<std::pair<size_t, int>>) {
+            throw std::domain_error("continuation");
+        });
+        bool domain = false;
+        try {
+            p.set_value(1);
+        } catch (const std::domain_error &) {
+            domain = true;
+        } catch (const std::future_error &) {
+        }
+        CHECK(domain);
+    }
+    // 经回环连接的调用
+    {
+        auto *s = new rpc_server(0, 1);
+        s->register_handler("add", add);
+        start_server(s);
+        rpc_client c("127.0.0.1", s->port());
+        CHECK(c.connect(3));
+        std::vector<rpc_future<int>> fs;
+        for (int i = 0; i < 100; ++i) {
+            fs.push_back(c.async_call<int>("add", i, i));
+        }
+        auto values = when_all(fs).get();
+        CHECK(values.size() == 100);
+        for (int i = 0; i < 100; ++i) {
+            CHECK(values[i] == 2 * i);
+        }
+        auto r = when_any(std::vector<rpc_future<int>>{
+                              c.async_call<int>("add", 1, 2)})
+                     .get();
+        CHECK(r.first == 0 && r.second == 3);
+    }
+    return test_result("test_future");
+}
@@ -0,0 +1,121 @@
+// 发布订阅：所有订阅者按序收到消息，退订后不再收到，慢速订阅者按策略丢弃或断开，
+// 压缩的订阅请求正确处理，只接收消息的订阅者超过空闲时间也不断开
+#include <atomic>
+#include <future>
+#include "test_util.h"
+#include "rpc_client.h"
+
+using namespace std::chrono_literals;
+
+static int ping() { return 1; }
+
+// 同一连接上的请求按序处理，应答返回时之前发出的订阅和退订都已生效，
+// 之前发布给该连接的消息也都已交给回调
+static bool sync(rpc_client &c) { return c.call<int>("ping") == 1; }
+
+int main() {
+    auto *s = new rpc_server(0, 2);
+    s->set_pubsub(4, slow_consumer_policy::drop_oldest);
+    s->register_handler("ping", ping);
+    start_server(s);
+    const int N = 10;
+    std::vector<std::unique_ptr<rpc_client>> subs;
+    std::atomic<int> received{0}, out_of_order{0};
+    std::promise<void> all_received;
+    std::vector<int> last(N, -1);
+    for (int i = 0; i < N; ++i) {
+        subs.emplace_back(std::make_unique<rpc_client>("127.0.0.1", s->port()));
+        subs.back()->subscribe<int>("cfg", [&, i](int v) {
+            out_of_order += v <= last[i];
+            last[i] = v;
+            if (++received == 3 * N) {
+                all_received.set_value();
+            }
+        });
+        CHECK(subs.back()->connect(3));
+        CHECK(sync(*subs.back()));
+    }
+    for (int k = 0; k < 3; ++k) {
+        CHECK(s->publish("cfg", k) == N);
+    }
+    CHECK(all_received.get_future().wait_for(3s) == std::future_status::ready);
+    CHECK(received == 3 * N);
+    CHECK(out_of_order == 0);
+    subs[0]->unsubscribe("cfg");
+    CHECK(sync(*subs[0]));
+    CHECK(s->publish("cfg", 100) == N - 1);
+    CHECK(s->publish("none", 1) == 0);
+
+    // 回调阻塞的订阅者：发送队列满后丢弃最早的消息
+    std::promise<void> gate;
+    auto opened = gate.get_future().share();
+    std::atomic<int> slow_received{0};
+    rpc_client slow("127.0.0.1", s->port());
+    slow.subscribe<std::string>("big", [&](const std::string &) {
+        opened.wait();
+        slow_received++;
+    });
+    CHECK(slow.connect(3));
+    CHECK(sync(slow));
+    for (int k = 0; k < 300; ++k) {
+        s->publish("big", std::string(64 * 1024, 'a'));
+    }
+    CHECK(wait_until([s] { return s->publish_stats().dropped > 0; }));
+    gate.set_value();
+    CHECK(sync(slow));
+    CHECK(slow_received > 0 && slow_received < 300);
+
+    // disconnect策略：慢速订阅者被断开，其订阅随之删除
+    auto *s2 = new rpc_server(0, 1);
+    s2->set_pubsub(2, slow_consumer_policy::disconnect);
+    s2->register_handler("ping", ping);
+    start_server(s2);
+    std::promise<void> gate2;
+    auto opened2 = gate2.get_future().share();
+    rpc_client slow2("127.0.0.1", s2->port());
+    slow2.subscribe<std::string>("big",
+                                 [&](const std::string &) { opened2.wait(); });
+    CHECK(slow2.connect(3));
+    CHECK(sync(slow2));
+    for (int k = 0; k < 300; ++k) {
+        s2->publish("big", std::string(64 * 1024, 'b'));
+    }
+    CHECK(wait_until([s2] { return s2->publish_stats().disconnected == 1; }));
+    CHECK(s2->publish("big", std::string("x")) == 0);
+    gate2.set_value();
+
+    // 超过压缩阈值的订阅请求先解压再处理
+    rpc_client packed("127.0.0.1", s->port());
+    packed.set_compression(64);
+    CHECK(packed.connect(3));
+    CHECK(sync(packed)); // 握手的回复已到达，之后的请求可以压缩
+    std::string long_topic(4096, 't');
+    std::promise<int> packed_value;
+    packed.subscribe<int>(long_topic,
+                          [&](int v) { packed_value.set_value(v); });
+    CHECK(sync(packed));
+    CHECK(packed.compress_stats().compressed_frames == 1);
+    CHECK(s->publish(long_topic, 42) == 1);
+    auto pv = packed_value.get_future();
+    CHECK(pv.wait_for(3s) == std::future_status::ready && pv.get() == 42);
+
+    // 空闲超时为1秒：只接收消息的订阅者保持连接，不订阅的空闲连接被断开
+    auto *s3 = new rpc_server(0, 1, 1);
+    s3->register_handler("ping", ping);
+    start_server(s3);
+    rpc_client listener("127.0.0.1", s3->port());
+    std::promise<int> late_value;
+    listener.subscribe<int>("late", [&](int v) { late_value.set_value(v); });
+    CHECK(listener.connect(3));
+    CHECK(sync(listener));
+    rpc_client quiet("127.0.0.1", s3->port());
+    CHECK(quiet.connect(3));
+    CHECK(sync(quiet));
+    CHECK(s3->connection_count() == 2);
+    CHECK(wait_until([s3] { return s3->connection_count() == 1; }, 5s));
+    CHECK(wait_until([&] { return !quiet.has_connected(); }));
+    CHECK(s3->publish("late", 7) == 1);
+    auto lv = late_value.get_future();
+    CHECK(lv.wait_for(3s) == std::future_status::ready && lv.get() == 7);
+    return test_result("test_pubsub");
+}
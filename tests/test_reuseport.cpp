@@ -0,0 +1,43 @@
+// SO_REUSEPORT：每个io线程一个接收器，run()之前建立的连接在启动后正常服务
+#include <memory>
+#include <vector>
+#include "test_util.h"
+#include "rpc_client.h"
+
+static int add(int a, int b) { return a + b; }
+
+int main() {
+    auto *s = new rpc_server(0, 4, 15, 10, true);
+    s->register_handler("add", add);
+    CHECK(s->port() != 0);
+
+    // 服务端尚未运行，连接在接收器的队列中等待
+    std::vector<std::unique_ptr<rpc_client>> early;
+    for (int i = 0; i < 8; ++i) {
+        early.emplace_back(std::make_unique<rpc_client>("127.0.0.1", s->port()));
+        CHECK(early.back()->connect(3));
+    }
+    start_server(s);
+    for (int i = 0; i < 8; ++i) {
+        CHECK(early[i]->call<int>("add", i, 1) == i + 1);
+    }
+
+    // 启动之后的连接由各线程的接收器接受
+    std::vector<std::unique_ptr<rpc_client>> late;
+    for (int i = 0; i < 32; ++i) {
+        late.emplace_back(std::make_unique<rpc_client>("127.0.0.1", s->port()));
+        CHECK(late.back()->connect(3));
+        CHECK(late.back()->call<int>("add", i, 2) == i + 2);
+    }
+    CHECK(wait_until([s] { return s->connection_count() == 40; }));
+
+    // 同一端口上不使用SO_REUSEPORT的服务端不能绑定
+    bool rejected = false;
+    try {
+        rpc_server other(s->port(), 1);
+    } catch (const std::exception &) {
+        rejected = true;
+    }
+    CHECK(rejected);
+    return test_result("test_reuseport");
+}
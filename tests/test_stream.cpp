@@ -0,0 +1,174 @@
+// 流式调用：结果按序到达，慢速的客户端限制服务端的写出，取消和错误正确结束流，
+// 等待窗口过久或过多的流以错误结束，过载时以OVERLOADED拒绝，进行中的流不算空闲
+#include <atomic>
+#include <future>
+#include "test_util.h"
+#include "rpc_client.h"
+
+using namespace std::chrono_literals;
+
+static std::atomic<int> written{0};
+static std::atomic<int> stopped{0};
+
+static void scan(stream_writer &w, int n) {
+    for (int i = 0; i < n; ++i) {
+        if (!w.write(i)) {
+            stopped++;
+            return;
+        }
+        written++;
+    }
+}
+
+static void fails(stream_writer &w, int n) {
+    w.write(n);
+    throw std::runtime_error("boom");
+}
+
+// 每个结果之间停顿，期间客户端不发送任何数据
+static void slow_scan(stream_writer &w, int n) {
+    for (int i = 0; i < n; ++i) {
+        std::this_thread::sleep_for(600ms);
+        w.write(i);
+    }
+}
+
+// 读完流，返回结束时的错误码，正常结束为OK
+static error_code drain(rpc_stream<int> &st, int &count) {
+    int v = 0;
+    try {
+        while (st.next(v)) {
+            count++;
+        }
+    } catch (const rpc_error &e) {
+        return e.code();
+    }
+    return error_code::OK;
+}
+
+int main() {
+    auto *s = new rpc_server(0, 1);
+    s->set_handler_pool(2, 1000);
+    s->register_stream("scan", scan);
+    s->register_stream("fails", fails);
+    start_server(s);
+    rpc_client c("127.0.0.1", s->port());
+    CHECK(c.connect(3));
+
+    int count = 0;
+    for (auto &v : c.stream<int>("scan", 1000)) {
+        CHECK(v == count);
+        count++;
+    }
+    CHECK(count == 1000);
+
+    // 客户端只授予8个窗口，读取20个后共授予28个，服务端停在窗口处
+    c.set_stream_window(8);
+    written = 0;
+    stopped = 0;
+    {
+        auto st = c.stream<int>("scan", 100000);
+        int v = 0;
+        for (int i = 0; i < 20; ++i) {
+            CHECK(st.next(v) && v == i);
+        }
+        CHECK(wait_until([] { return written == 28; }));
+    } // 析构时取消
+    CHECK(wait_until([] { return stopped == 1; }));
+    CHECK(written == 28);
+
+    // 函数抛出异常时，已写出的结果先到达，之后以错误结束
+    bool failed = false;
+    try {
+        auto st = c.stream<int>("fails", 7);
+        int v = 0;
+        CHECK(st.next(v) && v == 7);
+        st.next(v);
+    } catch (const rpc_error &) {
+        failed = true;
+    }
+    CHECK(failed);
+
+    // 等待窗口超过时间上限的流以FAIL结束，已写出的结果先到达
+    auto *limited = new rpc_server(0, 1);
+    limited->set_handler_pool(4, 1000);
+    limited->set_stream_limits(100ms);
+    limited->register_stream("scan", scan);
+    start_server(limited);
+    rpc_client e("127.0.0.1", limited->port());
+    CHECK(e.connect(3));
+    e.set_stream_window(2);
+    stopped = 0;
+    {
+        auto st = e.stream<int>("scan", 1000);
+        CHECK(wait_until([] { return stopped == 1; }));
+        count = 0;
+        CHECK(drain(st, count) == error_code::FAIL);
+        CHECK(count == 2);
+    }
+    // 最多一个流等待窗口：已有一个流在等待时，再等待的流以OVERLOADED结束
+    auto *crowded = new rpc_server(0, 1);
+    crowded->set_handler_pool(4, 1000);
+    crowded->set_stream_limits(10s, 1);
+    crowded->register_stream("scan", scan);
+    start_server(crowded);
+    rpc_client h("127.0.0.1", crowded->port());
+    CHECK(h.connect(3));
+    h.set_stream_window(2);
+    {
+        auto first = h.stream<int>("scan", 1000);
+        CHECK(wait_until([&] { return crowded->stalled_streams() == 1; }));
+        auto second = h.stream<int>("scan", 1000);
+        count = 0;
+        CHECK(drain(second, count) == error_code::OVERLOADED);
+        CHECK(count == 2);
+    }
+
+    // 超过连接的在途上限时，流以带类型的错误帧拒绝，错误码为OVERLOADED
+    auto *admitted = new rpc_server(0, 1);
+    admitted->set_handler_pool(2, 1000);
+    admitted->set_admission(1, 0);
+    admitted->register_stream("scan", scan);
+    start_server(admitted);
+    rpc_client f("127.0.0.1", admitted->port());
+    CHECK(f.connect(3));
+    f.set_stream_window(2);
+    {
+        auto holding = f.stream<int>("scan", 1000);
+        auto rejected = f.stream<int>("scan", 10);
+        count = 0;
+        CHECK(drain(rejected, count) == error_code::OVERLOADED);
+        CHECK(count == 0);
+    }
+
+    // 流进行中客户端不发送数据，超过空闲时间也不断开连接
+    auto *idle = new rpc_server(0, 1, 1);
+    idle->set_handler_pool(2, 1000);
+    idle->register_stream("slow_scan", slow_scan);
+    start_server(idle);
+    rpc_client g("127.0.0.1", idle->port());
+    CHECK(g.connect(3));
+    {
+        auto st = g.stream<int>("slow_scan", 3);
+        count = 0;
+        CHECK(drain(st, count) == error_code::OK);
+        CHECK(count == 3);
+    }
+
+    // 流停在窗口处时析构服务端：等待中的流式函数被唤醒，析构不会阻塞
+    auto *stalled = new rpc_server(0, 1);
+    stalled->set_handler_pool(2, 1000);
+    stalled->register_stream("scan", scan);
+    start_server(stalled);
+    rpc_client d("127.0.0.1", stalled->port());
+    CHECK(d.connect(3));
+    d.set_stream_window(2);
+    auto st = d.stream<int>("scan", 100000);
+    int v = 0;
+    CHECK(st.next(v));
+    CHECK(wait_until([stalled] { return stalled->stalled_streams() == 1; }));
+    auto destroyed =
+        std::async(std::launch::async, [stalled] { delete stalled; });
+    CHECK(destroyed.wait_for(3s) == std::future_status::ready);
+    return test_result("test_stream");
+}
@@ -0,0 +1,129 @@
+// 时间轮：以tick直接推进，各层之间的降级在准确的tick到期，
+// 检查时仍有活动的条目重新加入，与当前槽同号的上层槽在转满一圈后才到期
+#include <memory>
+#include <vector>
+#include "test_util.h"
+#include "timer_wheel.h"
+
+struct idle_conn {
+    uint64_t last = 0;    // 最近活动的tick
+    uint64_t timeout = 0; // 空闲多少tick后关闭
+    uint64_t closed = 0;  // 关闭时的tick，0表示未关闭
+};
+
+using wheel = timer_wheel<idle_conn>;
+
+// 从start起延迟delay个tick的条目恰好在start+delay到期
+static bool expires_on_tick(uint64_t start, uint64_t delay) {
+    wheel w;
+    w.advance(start, [](uint64_t, std::weak_ptr<idle_conn>) {});
+    auto c = std::make_shared<idle_conn>();
+    w.add(start + delay, c);
+    uint64_t fired = 0;
+    auto on_expire = [&](uint64_t, std::weak_ptr<idle_conn>) {
+        fired = w.now();
+    };
+    // 先一次推进到到期前一个tick，再逐个tick推进
+    w.advance(start + delay - 1, on_expire);
+    if (fired != 0) {
+        return false;
+    }
+    w.advance(start + delay, on_expire);
+    return fired == start + delay && w.empty();
+}
+
+// 逐个tick推进，检查时仍有活动的连接按最近活动重新加入
+static void run_idle(wheel &w, uint64_t tick) {
+    while (w.now() < tick) {
+        w.advance(w.now() + 1, [&w](uint64_t, std::weak_ptr<idle_conn> t) {
+            auto p = t.lock();
+            if (!p) {
+                return;
+            }
+            if (w.now() >= p->last + p->timeout) {
+                p->closed = w.now();
+            } else {
+                w.add(p->last + p->timeout, std::move(t));
+            }
+        });
+    }
+}
+
+int main() {
+    // 各层边界两侧的延迟，从不同的起点开始
+    const uint64_t delays[] = {1,    2,    63,   64,    65,    100,
+                               4095, 4096, 4097, 10000, 262143, 262144,
+                               262145, 300000};
+    const uint64_t starts[] = {0, 1, 63, 64, 70, 4095, 4096, 4100, 262143};
+    for (uint64_t start : starts) {
+        for (uint64_t delay : delays) {
+            bool ok = expires_on_tick(start, delay);
+            if (!ok) {
+                std::cerr << "start=" << start << " delay=" << delay
+                          << std::endl;
+            }
+            CHECK(ok);
+        }
+    }
+
+    // 上层与当前时刻同号的槽：第1层的槽号与now相同，需等转满一圈
+    {
+        wheel w;
+        w.advance(70, [](uint64_t, std::weak_ptr<idle_conn>) {});
+        auto c = std::make_shared<idle_conn>();
+        w.add(70 + 4095, c);
+        uint64_t fired = 0;
+        for (uint64_t t = 71; t <= 70 + 4095; ++t) {
+            w.advance(t, [&](uint64_t expire, std::weak_ptr<idle_conn>) {
+                CHECK(expire == 70 + 4095);
+                fired = w.now();
+            });
+        }
+        CHECK(fired == 70 + 4095);
+    }
+
+    // 活动推迟关闭：第0层和需要跨层降级的两种超时
+    for (uint64_t timeout : {uint64_t(10), uint64_t(100), uint64_t(5000)}) {
+        wheel w;
+        auto c = std::make_shared<idle_conn>();
+        c->timeout = timeout;
+        w.add(timeout, c);
+        run_idle(w, timeout / 2);
+        c->last = w.now(); // touch
+        run_idle(w, timeout);
+        CHECK(c->closed == 0);
+        CHECK(w.size() == 1);
+        run_idle(w, c->last + timeout - 1);
+        CHECK(c->closed == 0);
+        run_idle(w, c->last + timeout);
+        CHECK(c->closed == c->last + timeout);
+        CHECK(w.empty());
+    }
+
+    // 目标销毁后条目在到期时丢弃
+    {
+        wheel w;
+        auto c = std::make_shared<idle_conn>();
+        w.add(5000, c);
+        c.reset();
+        size_t dropped = 0;
+        w.advance(5000, [&](uint64_t, std::weak_ptr<idle_conn> t) {
+            dropped += t.expired();
+        });
+        CHECK(dropped == 1 && w.empty());
+    }
+
+    // 过去的时刻在下一个tick到期
+    {
+        wheel w;
+        w.advance(100, [](uint64_t, std::weak_ptr<idle_conn>) {});
+        auto c = std::make_shared<idle_conn>();
+        w.add(50, c);
+        uint64_t fired = 0;
+        w.advance(200, [&](uint64_t, std::weak_ptr<idle_conn>) {
+            fired = w.now();
+        });
+        CHECK(fired == 101);
+    }
+    return test_result("test_timer_wheel");
+}
@@ -0,0 +1,106 @@
+// 传输方式：unix域套接字和共享内存上的调用、大消息、流和多线程并发，
+// 不是套接字的路径不被删除，不完成共享内存握手的连接被关闭
+#include <atomic>
+#include <fcntl.h>
+#include "test_util.h"
+#include "rpc_client.h"
+
+static int add(int a, int b) { return a + b; }
+static std::string echo(std::string s) { return s; }
+static void scan(stream_writer &w, int n) {
+    for (int i = 0; i < n; ++i) {
+        w.write(i);
+    }
+}
+
+static void run(const std::string &uri) {
+    auto *s = new rpc_server(uri, 2);
+    s->set_handler_pool(2);
+    s->register_handler("add", add);
+    s->register_handler("echo", echo);
+    s->register_stream("scan", scan);
+    start_server(s);
+    rpc_client c(uri);
+    CHECK(c.connect(3));
+    CHECK(c.call<int>("add", 2, 3) == 5);
+    // 超过共享内存环形缓冲区大小的消息
+    std::string big(5 * 1024 * 1024, 'q');
+    big[12345] = 'x';
+    CHECK(c.call<std::string>("echo", big) == big);
+    std::vector<rpc_future<int>> fs;
+    for (int i = 0; i < 10000; ++i) {
+        fs.push_back(c.async_call<int>("add", i, 1));
+    }
+    for (int i = 0; i < 10000; ++i) {
+        CHECK(fs[i].get() == i + 1);
+    }
+    int count = 0;
+    for (auto v : c.stream<int>("scan", 5000)) {
+        CHECK(v == count);
+        count++;
+    }
+    CHECK(count == 5000);
+    std::atomic<int> wrong{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&, t] {
+            for (int i = 0; i < 1000; ++i) {
+                wrong += c.call<int>("add", t, i) != t + i;
+            }
+        });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+    CHECK(wrong == 0);
+}
+
+// 路径上已有普通文件时构造抛出异常，文件保留
+static void keep_regular_file(const std::string &path) {
+    int fd = ::open(path.c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0600);
+    CHECK(fd >= 0);
+    ::close(fd);
+    bool rejected = false;
+    try {
+        rpc_server s("unix://" + path, 1);
+    } catch (const std::invalid_argument &) {
+        rejected = true;
+    }
+    CHECK(rejected);
+    CHECK(::access(path.c_str(), F_OK) == 0);
+    ::unlink(path.c_str());
+}
+
+// 只建立控制连接而不交来共享内存的连接方，在握手超时后被服务端关闭
+static void reap_silent_peer(const std::string &name) {
+    auto *s = new rpc_server("shm://" + name, 1, 1, 1);
+    start_server(s);
+    boost::asio::io_service ios;
+    boost::asio::generic::stream_protocol::socket sock(ios);
+    sock.connect(endpoint_uri::parse("shm://" + name).socket_endpoint());
+    auto begin = std::chrono::steady_clock::now();
+    char c;
+    boost::system::error_code ec;
+    sock.read_some(boost::asio::buffer(&c, 1), ec);
+    CHECK(ec == boost::asio::error::eof ||
+          ec == boost::asio::error::connection_reset);
+    CHECK(std::chrono::steady_clock::now() - begin <
+          std::chrono::seconds(shm_channel::HANDSHAKE_TIMEOUT));
+}
+
+int main() {
+    // 路径和名字带进程号，并行运行的测试互不影响
+    std::string id = std::to_string(::getpid());
+    run("unix:///tmp/tiny_rpc_test." + id + ".sock");
+    run("shm://tiny_rpc_test." + id);
+    keep_regular_file("/tmp/tiny_rpc_test." + id + ".file");
+    reap_silent_peer("tiny_rpc_silent." + id);
+    bool rejected = false;
+    try {
+        endpoint_uri::parse("udp://host:1");
+    } catch (const std::invalid_argument &) {
+        rejected = true;
+    }
+    CHECK(rejected);
+    return test_result("test_transport");
+}
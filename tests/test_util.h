@@ -0,0 +1,63 @@
+#pragma once
+#ifndef TINY_RPC_TEST_UTIL_H_
+#define TINY_RPC_TEST_UTIL_H_
+
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <unistd.h>
+#include "rpc_server.h"
+
+/*
+* 回环测试的公共部分
+ 每个测试程序在进程内启动服务端并经本机连接调用，失败的检查打印位置并计数，
+ 结束时以失败数决定退出码。服务端监听端口0，由系统分配端口，测试可以并行运行；
+ 等待其他线程时等待future或条件，不按固定时长睡眠。
+*/
+static int g_failures = 0;
+
+#define CHECK(cond)                                                            \
+    do {                                                                       \
+        if (!(cond)) {                                                         \
+            ++g_failures;                                                      \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #cond       \
+                      << ") failed" << std::endl;                              \
+        }                                                                      \
+    } while (0)
+
+// 在分离的线程中运行服务端；接收器在构造时已开始监听，连接无需等待run()
+inline rpc_server *start_server(rpc_server *server) {
+    std::thread([server] { server->run(); }).detach();
+    return server;
+}
+
+// 取一个当前空闲的tcp端口，用于先确定地址、之后才启动的服务端
+inline unsigned short free_port() {
+    boost::asio::io_service ios;
+    boost::asio::ip::tcp::acceptor acceptor(
+        ios, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), 0));
+    return acceptor.local_endpoint().port();
+}
+
+// 等待其他线程使条件成立，超时返回false；用于没有完成通知的服务端状态
+template <typename Pred>
+inline bool wait_until(Pred pred, std::chrono::milliseconds timeout =
+                                      std::chrono::milliseconds(3000)) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (!pred()) {
+        if (std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+// 报告结果并退出；服务端仍在分离的线程中运行，不析构而直接结束进程
+inline int test_result(const char *name) {
+    std::cout << name << (g_failures ? ": FAILED " : ": OK ") << g_failures
+              << std::endl;
+    _exit(g_failures ? 1 : 0);
+}
+
+#endif
@@ -0,0 +1,102 @@
+#pragma once
+#ifndef TINY_RPC_THREAD_POOL_H_
+#define TINY_RPC_THREAD_POOL_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <boost/asio.hpp>
+
+/*
+* 处理函数的工作线程池
+ 有界任务队列，队列满时try_post失败而不是阻塞调用者，
+ 避免io线程被慢处理函数拖住。
+*/
+class thread_pool : private boost::asio::noncopyable {
+  public:
+    using task_type = std::function<void()>;
+
+    thread_pool() = default;
+
+    ~thread_pool() { stop(); }
+
+    // 启动工作线程，重复调用无效
+    void start(std::size_t thread_count, std::size_t max_queue) {
+        std::unique_lock<std::mutex> lock(mtx_);
+        if (!threads_.empty() || thread_count == 0) {
+            return;
+        }
+        max_queue_ = max_queue;
+        stopped_ = false;
+        for (std::size_t i = 0; i < thread_count; ++i) {
+            threads_.emplace_back(
+                std::make_shared<std::thread>([this] { worker(); }));
+        }
+    }
+
+    // 停止接收任务，等待已入队任务执行完毕后退出
+    void stop() {
+        std::vector<std::shared_ptr<std::thread>> threads;
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            stopped_ = true;
+            threads.swap(threads_);
+        }
+        cv_.notify_all();
+        for (auto &t : threads) {
+            if (t->joinable()) {
+                t->join();
+            }
+        }
+    }
+
+    // 是否有工作线程
+    bool running() const {
+        std::unique_lock<std::mutex> lock(mtx_);
+        return !threads_.empty() && !stopped_;
+    }
+
+    // 投递任务，未启动、已停止或队列已满时返回false
+    bool try_post(task_type task) {
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            if (threads_.empty() || stopped_ || tasks_.size() >= max_queue_) {
+                return false;
+            }
+            tasks_.emplace_back(std::move(task));
+        }
+        cv_.notify_one();
+        return true;
+    }
+
+  private:
+    void worker() {
+        for (;;) {
+            task_type task;
+            {
+                std::unique_lock<std::mutex> lock(mtx_);
+                cv_.wait(lock, [this] { return stopped_ || !tasks_.empty(); });
+                if (tasks_.empty()) {
+                    return;
+                }
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+            }
+            task();
+        }
+    }
+
+  private:
+    mutable std::mutex mtx_;
+    std::condition_variable cv_;
+    std::deque<task_type> tasks_;
+    std::vector<std::shared_ptr<std::thread>> threads_;
+    std::size_t max_queue_ = 0;
+    bool stopped_ = false;
+};
+
+#endif
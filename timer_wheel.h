@@ -0,0 +1,211 @@
+#pragma once
+#ifndef TINY_RPC_TIMER_WHEEL_H_
+#define TINY_RPC_TIMER_WHEEL_H_
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+#include <boost/asio.hpp>
+
+/*
+* 分层时间轮
+ 时间以tick计，共LEVELS层，每层SLOTS个槽：第0层一个槽为一个tick，
+ 上一层的一个槽为下一层转一圈。条目按到期时刻与当前时刻之差放入能容纳它的最低一层，
+ 下层转完一圈时把上层对应槽中的条目按剩余时间重新放入下层。
+ 推进时只访问到期的槽，开销与到期的条目数成正比，和条目总数无关。
+ 条目只保存目标的弱引用，目标销毁后在到期时自然丢弃，不需要主动删除。
+ 非线程安全，由所属的io线程访问。
+*/
+template <typename T> class timer_wheel {
+  public:
+    static const unsigned SLOT_BITS = 6;
+    static const size_t SLOTS = size_t(1) << SLOT_BITS;
+    static const size_t LEVELS = 4;
+
+    // 当前tick
+    uint64_t now() const { return now_; }
+
+    // 条目数，包括目标已销毁但尚未到期的
+    size_t size() const { return size_; }
+
+    bool empty() const { return size_ == 0; }
+
+    // 在expire时刻到期，早于当前时刻的在下一个tick到期
+    void add(uint64_t expire, std::weak_ptr<T> target) {
+        place(entry{expire, std::move(target)}, now_ + 1);
+        ++size_;
+    }
+
+    // 推进到tick，对到期的每个条目调用f(expire, target)；f中可以再添加条目
+    template <typename F> void advance(uint64_t tick, F &&f) {
+        if (empty()) {
+            now_ = std::max(now_, tick);
+            return;
+        }
+        while (now_ < tick) {
+            ++now_;
+            // 下层转完一圈时，从低到高依次把上层转到的槽降到下层
+            for (size_t level = 1;
+                 level < LEVELS && index(now_, level - 1) == 0; ++level) {
+                cascade(level);
+            }
+            auto &slot = slots_[0][index(now_, 0)];
+            if (slot.empty()) {
+                continue;
+            }
+            std::vector<entry> expired;
+            expired.swap(slot);
+            size_ -= expired.size();
+            for (auto &e : expired) {
+                f(e.expire, std::move(e.target));
+            }
+            // 复用容量，避免每个tick重新分配
+            expired.clear();
+            if (slot.empty()) {
+                slot.swap(expired);
+            }
+        }
+    }
+
+    void clear() {
+        for (auto &level : slots_) {
+            for (auto &slot : level) {
+                slot.clear();
+            }
+        }
+        size_ = 0;
+    }
+
+  private:
+    struct entry {
+        uint64_t expire;
+        std::weak_ptr<T> target;
+    };
+
+    static size_t index(uint64_t tick, size_t level) {
+        return (tick >> (SLOT_BITS * level)) & (SLOTS - 1);
+    }
+
+    // 放入能容纳它的最低一层，早于earliest的按earliest放入
+    void place(entry e, uint64_t earliest) {
+        if (e.expire < earliest) {
+            e.expire = earliest;
+        }
+        uint64_t delta = e.expire - now_;
+        size_t level = 0;
+        while (level + 1 < LEVELS && delta >= (uint64_t(1) << (SLOT_BITS * (level + 1)))) {
+            ++level;
+        }
+        slots_[level][index(e.expire, level)].push_back(std::move(e));
+    }
+
+    void cascade(size_t level) {
+        auto &slot = slots_[level][index(now_, level)];
+        if (slot.empty()) {
+            return;
+        }
+        std::vector<entry> moved;
+        moved.swap(slot);
+        // 在当前tick到期的放入第0层的当前槽，随后在本tick处理
+        for (auto &e : moved) {
+            place(std::move(e), now_);
+        }
+    }
+
+    std::array<std::array<std::vector<entry>, SLOTS>, LEVELS> slots_;
+    uint64_t now_ = 0;
+    size_t size_ = 0;
+};
+
+/*
+* 空闲连接的时间轮服务
+ 每个io_context(即每个io线程)一个，用boost::asio::use_service<>取得。
+ 目标在收到数据时只记录now()，不操作定时器；条目到期时调用目标的check_idle(now)，
+ 由目标根据最近活动时刻决定关闭或返回下次检查的tick(0表示不再检查)。
+ 只在有条目时以TICK为间隔运行一个定时器。
+*/
+template <typename T>
+class idle_wheel_service : public boost::asio::execution_context::service {
+  public:
+    inline static boost::asio::execution_context::id id;
+
+    static constexpr std::chrono::milliseconds TICK{100};
+
+    explicit idle_wheel_service(boost::asio::io_context &ioc)
+        : boost::asio::execution_context::service(ioc), timer_(ioc),
+          start_(std::chrono::steady_clock::now()) {}
+
+    // 当前tick，至多落后于实际时间一个tick
+    uint64_t now() const { return wheel_.now(); }
+
+    // 时长对应的tick数，至少为1
+    static uint64_t ticks(std::chrono::steady_clock::duration d) {
+        auto n = std::chrono::duration_cast<std::chrono::milliseconds>(d) / TICK;
+        return n > 0 ? static_cast<uint64_t>(n) : 1;
+    }
+
+    // delay个tick后检查target，需在所属io线程上调用
+    void watch(std::weak_ptr<T> target, uint64_t delay) {
+        if (wheel_.empty()) {
+            // 空闲期间定时器未运行，先追上实际时间
+            wheel_.advance(clock(), [](uint64_t, std::weak_ptr<T>) {});
+        }
+        wheel_.add(wheel_.now() + delay, std::move(target));
+        arm();
+    }
+
+    // 条目数
+    size_t size() const { return wheel_.size(); }
+
+  private:
+    void shutdown() override {
+        boost::system::error_code ignored_ec;
+        timer_.cancel(ignored_ec);
+        wheel_.clear();
+    }
+
+    uint64_t clock() const {
+        return static_cast<uint64_t>(
+            (std::chrono::steady_clock::now() - start_) / TICK);
+    }
+
+    void arm() {
+        if (armed_ || wheel_.empty()) {
+            return;
+        }
+        armed_ = true;
+        timer_.expires_at(start_ + TICK * (wheel_.now() + 1));
+        timer_.async_wait([this](const boost::system::error_code &ec) {
+            armed_ = false;
+            if (ec) {
+                return;
+            }
+            tick();
+        });
+    }
+
+    void tick() {
+        wheel_.advance(clock(), [this](uint64_t, std::weak_ptr<T> target) {
+            auto p = target.lock();
+            if (!p) {
+                return;
+            }
+            uint64_t next = p->check_idle(wheel_.now());
+            if (next != 0) {
+                wheel_.add(next, std::move(target));
+            }
+        });
+        arm();
+    }
+
+    timer_wheel<T> wheel_;
+    boost::asio::steady_timer timer_;
+    std::chrono::steady_clock::time_point start_;
+    bool armed_ = false;
+};
+
+#endif
@@ -0,0 +1,712 @@
+#pragma once
+#ifndef TINY_RPC_TRANSPORT_H_
+#define TINY_RPC_TRANSPORT_H_
+
+#include <boost/asio.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "uring.h"
+
+// 传输方式
+enum class transport_kind : uint8_t {
+    tcp,   // tcp://host:port
+    local, // unix:///path，本机的unix域套接字
+    shm,   // shm://name，本机的共享内存环形缓冲区
+};
+
+/*
+* 服务端地址
+ 由uri指定传输方式：tcp://host:port、unix:///path或shm://name。
+ shm的连接先经抽象命名空间的unix域套接字建立，交换共享内存和唤醒用的eventfd，
+ 之后的数据都经共享内存传递，该套接字只用于感知对端关闭。
+*/
+struct endpoint_uri {
+    using endpoint_type = boost::asio::generic::stream_protocol::endpoint;
+
+    transport_kind kind = transport_kind::tcp;
+    std::string host;        // tcp的地址，服务端为空时监听所有地址
+    unsigned short port = 0; // tcp的端口
+    std::string path;        // unix域套接字的路径，或共享内存的名字
+
+    // 解析uri，格式不正确时抛出std::invalid_argument
+    static endpoint_uri parse(const std::string &uri) {
+        endpoint_uri ep;
+        auto pos = uri.find("://");
+        if (pos == std::string::npos) {
+            throw std::invalid_argument("invalid endpoint: " + uri);
+        }
+        std::string scheme = uri.substr(0, pos);
+        std::string rest = uri.substr(pos + 3);
+        if (scheme == "tcp") {
+            auto colon = rest.rfind(':');
+            if (colon == std::string::npos) {
+                throw std::invalid_argument("invalid endpoint: " + uri);
+            }
+            ep.host = rest.substr(0, colon);
+            int port = 0;
+            try {
+                port = std::stoi(rest.substr(colon + 1));
+            } catch (const std::exception &) {
+                port = 0;
+            }
+            if (port <= 0 || port > 65535) {
+                throw std::invalid_argument("invalid endpoint: " + uri);
+            }
+            ep.port = static_cast<unsigned short>(port);
+        } else if (scheme == "unix") {
+            ep.kind = transport_kind::local;
+            ep.path = rest;
+        } else if (scheme == "shm") {
+            ep.kind = transport_kind::shm;
+            ep.path = rest;
+            if (rest.find('/') != std::string::npos) {
+                throw std::invalid_argument("invalid endpoint: " + uri);
+            }
+        } else {
+            throw std::invalid_argument("unsupported endpoint: " + uri);
+        }
+        if (ep.kind != transport_kind::tcp && ep.path.empty()) {
+            throw std::invalid_argument("invalid endpoint: " + uri);
+        }
+        return ep;
+    }
+
+    // 兼容地址加端口的写法：host中含有"://"时按uri解析并忽略port
+    static endpoint_uri make(const std::string &host, unsigned short port) {
+        if (host.find("://") != std::string::npos) {
+            return parse(host);
+        }
+        endpoint_uri ep;
+        ep.host = host;
+        ep.port = port;
+        return ep;
+    }
+
+    // 监听或连接的套接字地址
+    endpoint_type socket_endpoint() const {
+        switch (kind) {
+        case transport_kind::local:
+            return endpoint_type(
+                boost::asio::local::stream_protocol::endpoint(path));
+        case transport_kind::shm:
+            // 抽象命名空间，不在文件系统中留下文件
+            return endpoint_type(boost::asio::local::stream_protocol::endpoint(
+                std::string("\0tiny_rpc.shm.", 14) + path));
+        default:
+            if (host.empty()) {
+                return endpoint_type(boost::asio::ip::tcp::endpoint(
+                    boost::asio::ip::tcp::v4(), port));
+            }
+            return endpoint_type(boost::asio::ip::tcp::endpoint(
+                boost::asio::ip::address::from_string(host), port));
+        }
+    }
+};
+
+/*
+* 共享内存通道
+ 连接方创建一块共享内存，其中为两个单生产者单消费者的环形缓冲区，各负责一个方向；
+ 读写位置只增不减，各由一端修改。缓冲区空或满时，等待方先置等待标志再复查，
+ 之后在自己的eventfd上等待，对端写入或取走数据后看到标志即写eventfd唤醒，
+ 不等待时收发都不经过系统调用。
+ 提供与套接字相同的async_read_some/async_write_some，可以用于asio的组合操作。
+*/
+class shm_channel : public std::enable_shared_from_this<shm_channel> {
+  public:
+    using executor_type = boost::asio::any_io_executor;
+
+    static const size_t RING_SIZE = 1 << 20; // 每个方向的缓冲区大小，2的幂
+    static const uint32_t MAGIC = 0x54525348;
+    // 服务端等待连接方交来共享内存的时间上限
+    static constexpr std::chrono::seconds HANDSHAKE_TIMEOUT{5};
+
+    // 连接方：创建共享内存和eventfd，经控制连接sock交给服务端
+    static std::shared_ptr<shm_channel>
+    create(const executor_type &ex, int sock, boost::system::error_code &ec) {
+        size_t len = 2 * (sizeof(ring_header) + RING_SIZE);
+        int memfd = ::memfd_create("tiny_rpc", MFD_CLOEXEC);
+        if (memfd < 0 || ::ftruncate(memfd, len) != 0) {
+            ec = last_error();
+            close_fd(memfd);
+            return nullptr;
+        }
+        // 客户端收、客户端可写、服务端收、服务端可写
+        int fds[5] = {memfd, -1, -1, -1, -1};
+        for (int i = 1; i < 5; ++i) {
+            fds[i] = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (fds[i] < 0) {
+                ec = last_error();
+                close_fds(fds, 5);
+                return nullptr;
+            }
+        }
+        auto ch = std::shared_ptr<shm_channel>(new shm_channel(ex));
+        if (!ch->map(memfd, len, true, ec)) {
+            close_fds(fds, 5);
+            return nullptr;
+        }
+        uint32_t hello[2] = {MAGIC, static_cast<uint32_t>(RING_SIZE)};
+        if (!send_fds(sock, hello, sizeof(hello), fds, 5, ec)) {
+            close_fds(fds, 5);
+            return nullptr;
+        }
+        close_fd(memfd);
+        ch->attach(fds[1], fds[2], fds[3], fds[4]);
+        return ch;
+    }
+
+    // 服务端：从控制连接sock接收连接方的共享内存和eventfd，
+    // 尚未到达时ec为would_block
+    static std::shared_ptr<shm_channel>
+    accept(const executor_type &ex, int sock, boost::system::error_code &ec) {
+        // 抽象命名空间的套接字没有文件权限，只接受同一用户或root的连接方
+        struct ucred cred;
+        socklen_t cred_len = sizeof(cred);
+        if (::getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) != 0) {
+            ec = last_error();
+            return nullptr;
+        }
+        if (cred.uid != ::geteuid() && cred.uid != 0) {
+            ec = boost::asio::error::access_denied;
+            return nullptr;
+        }
+        uint32_t hello[2] = {0, 0};
+        int fds[5] = {-1, -1, -1, -1, -1};
+        if (!recv_fds(sock, hello, sizeof(hello), fds, 5, ec)) {
+            return nullptr;
+        }
+        struct stat st;
+        size_t len = 2 * (sizeof(ring_header) + RING_SIZE);
+        if (hello[0] != MAGIC || hello[1] != RING_SIZE ||
+            ::fstat(fds[0], &st) != 0 || static_cast<size_t>(st.st_size) != len) {
+            ec = boost::asio::error::invalid_argument;
+            close_fds(fds, 5);
+            return nullptr;
+        }
+        auto ch = std::shared_ptr<shm_channel>(new shm_channel(ex));
+        if (!ch->map(fds[0], len, false, ec)) {
+            close_fds(fds, 5);
+            return nullptr;
+        }
+        close_fd(fds[0]);
+        ch->attach(fds[3], fds[4], fds[1], fds[2]);
+        return ch;
+    }
+
+    ~shm_channel() {
+        close();
+        close_fd(peer_data_fd_);
+        close_fd(peer_space_fd_);
+        if (base_ != nullptr) {
+            ::munmap(base_, map_len_);
+        }
+    }
+
+    executor_type get_executor() { return executor_; }
+
+    // 读取收到的数据，至少一个字节；对端关闭且数据已读完时为eof
+    template <typename MutableBufferSequence, typename Handler>
+    void async_read_some(const MutableBufferSequence &buffers,
+                         Handler &&handler) {
+        size_t n = transfer(*rx_, buffers, false);
+        if (broken_) {
+            complete(std::forward<Handler>(handler), protocol_error(), 0);
+            return;
+        }
+        if (n > 0 || boost::asio::buffer_size(buffers) == 0) {
+            complete(std::forward<Handler>(handler),
+                     boost::system::error_code(), n);
+            return;
+        }
+        if (peer_closed_) {
+            complete(std::forward<Handler>(handler), boost::asio::error::eof,
+                     0);
+            return;
+        }
+        // 先置等待标志再复查，对端在两者之间写入时也会看到标志
+        rx_->reader_waiting.store(1);
+        if (rx_->head.load() != rx_->tail.load() || peer_closed_) {
+            rx_->reader_waiting.store(0);
+            async_read_some(buffers, std::forward<Handler>(handler));
+            return;
+        }
+        data_efd_.async_read_some(
+            boost::asio::buffer(&data_counter_, sizeof(data_counter_)),
+            [self = shared_from_this(), buffers,
+             h = std::decay_t<Handler>(std::forward<Handler>(handler))](
+                boost::system::error_code ec, size_t) mutable {
+                if (ec) {
+                    self->complete(std::move(h), ec, 0);
+                    return;
+                }
+                self->async_read_some(buffers, std::move(h));
+            });
+    }
+
+    // 写入数据，至少一个字节；对端关闭后为broken_pipe
+    template <typename ConstBufferSequence, typename Handler>
+    void async_write_some(const ConstBufferSequence &buffers,
+                          Handler &&handler) {
+        if (peer_closed_) {
+            complete(std::forward<Handler>(handler),
+                     boost::asio::error::broken_pipe, 0);
+            return;
+        }
+        size_t n = transfer(*tx_, buffers, true);
+        if (broken_) {
+            complete(std::forward<Handler>(handler), protocol_error(), 0);
+            return;
+        }
+        if (n > 0 || boost::asio::buffer_size(buffers) == 0) {
+            complete(std::forward<Handler>(handler),
+                     boost::system::error_code(), n);
+            return;
+        }
+        tx_->writer_waiting.store(1);
+        if (tx_->head.load() - tx_->tail.load() < RING_SIZE || peer_closed_) {
+            tx_->writer_waiting.store(0);
+            async_write_some(buffers, std::forward<Handler>(handler));
+            return;
+        }
+        space_efd_.async_read_some(
+            boost::asio::buffer(&space_counter_, sizeof(space_counter_)),
+            [self = shared_from_this(), buffers,
+             h = std::decay_t<Handler>(std::forward<Handler>(handler))](
+                boost::system::error_code ec, size_t) mutable {
+                if (ec) {
+                    self->complete(std::move(h), ec, 0);
+                    return;
+                }
+                self->async_write_some(buffers, std::move(h));
+            });
+    }
+
+    // 对端关闭，唤醒本端的等待
+    void peer_closed() {
+        peer_closed_ = true;
+        if (data_efd_.is_open()) {
+            ::eventfd_write(data_efd_.native_handle(), 1);
+        }
+        if (space_efd_.is_open()) {
+            ::eventfd_write(space_efd_.native_handle(), 1);
+        }
+    }
+
+    // 关闭本端，等待中的操作以operation_aborted结束
+    void close() {
+        boost::system::error_code ignored_ec;
+        data_efd_.close(ignored_ec);
+        space_efd_.close(ignored_ec);
+    }
+
+  private:
+    // 单个方向的缓冲区头，读写两端的字段分处不同的缓存行
+    struct ring_header {
+        alignas(64) std::atomic<uint64_t> head; // 写入位置，只由写端修改
+        alignas(64) std::atomic<uint64_t> tail; // 读取位置，只由读端修改
+        alignas(64) std::atomic<uint32_t> reader_waiting;
+        std::atomic<uint32_t> writer_waiting;
+    };
+
+    explicit shm_channel(const executor_type &ex)
+        : executor_(ex), data_efd_(ex), space_efd_(ex) {}
+
+    static boost::system::error_code last_error() {
+        return boost::system::error_code(errno,
+                                         boost::asio::error::get_system_category());
+    }
+
+    static boost::system::error_code protocol_error() {
+        return boost::system::errc::make_error_code(
+            boost::system::errc::protocol_error);
+    }
+
+    static void close_fd(int fd) {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    static void close_fds(int *fds, size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            close_fd(fds[i]);
+        }
+    }
+
+    // 映射共享内存，第0个缓冲区为连接方到服务端的方向
+    bool map(int memfd, size_t len, bool creator,
+             boost::system::error_code &ec) {
+        void *p = ::mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED,
+                         memfd, 0);
+        if (p == MAP_FAILED) {
+            ec = last_error();
+            return false;
+        }
+        base_ = static_cast<char *>(p);
+        map_len_ = len;
+        char *first = base_;
+        char *second = base_ + sizeof(ring_header) + RING_SIZE;
+        if (creator) {
+            new (first) ring_header();
+            new (second) ring_header();
+        }
+        auto *up = reinterpret_cast<ring_header *>(first);
+        auto *down = reinterpret_cast<ring_header *>(second);
+        rx_ = creator ? down : up;
+        tx_ = creator ? up : down;
+        return true;
+    }
+
+    void attach(int data_fd, int space_fd, int peer_data_fd,
+                int peer_space_fd) {
+        data_efd_.assign(data_fd);
+        space_efd_.assign(space_fd);
+        peer_data_fd_ = peer_data_fd;
+        peer_space_fd_ = peer_space_fd;
+    }
+
+    static char *ring_data(ring_header &r) {
+        return reinterpret_cast<char *>(&r) + sizeof(ring_header);
+    }
+
+    // 在缓冲区和buffers之间复制尽可能多的数据，write为true时写入缓冲区；
+    // 之后按对端的等待标志唤醒对端。
+    // 读写位置在对端可以修改的共享内存中，不可信：已用量超过缓冲区大小时
+    // 视为协议错误，关闭通道并置broken_
+    template <typename BufferSequence>
+    size_t transfer(ring_header &r, const BufferSequence &buffers, bool write) {
+        if (broken_) {
+            return 0;
+        }
+        uint64_t head = write ? r.head.load(std::memory_order_relaxed)
+                              : r.head.load(std::memory_order_acquire);
+        uint64_t tail = write ? r.tail.load(std::memory_order_acquire)
+                              : r.tail.load(std::memory_order_relaxed);
+        uint64_t used = head - tail;
+        if (used > RING_SIZE) {
+            broken_ = true;
+            close();
+            return 0;
+        }
+        size_t avail = write ? RING_SIZE - used : used;
+        uint64_t pos = write ? head : tail;
+        size_t done = 0;
+        char *data = ring_data(r);
+        for (auto it = boost::asio::buffer_sequence_begin(buffers);
+             it != boost::asio::buffer_sequence_end(buffers) && done < avail;
+             ++it) {
+            char *p = static_cast<char *>(const_cast<void *>(
+                static_cast<const void *>((*it).data())));
+            size_t len = std::min({(*it).size(), avail - done, RING_SIZE});
+            size_t off = (pos + done) & (RING_SIZE - 1);
+            size_t first = std::min(len, RING_SIZE - off);
+            if (write) {
+                memcpy(data + off, p, first);
+                memcpy(data, p + first, len - first);
+            } else {
+                memcpy(p, data + off, first);
+                memcpy(p + first, data, len - first);
+            }
+            done += len;
+        }
+        if (done == 0) {
+            return 0;
+        }
+        // 与等待方的置标志、复查构成先写后读的顺序，都使用seq_cst
+        if (write) {
+            r.head.store(head + done);
+            if (r.reader_waiting.load() && r.reader_waiting.exchange(0)) {
+                ::eventfd_write(peer_data_fd_, 1);
+            }
+        } else {
+            r.tail.store(tail + done);
+            if (r.writer_waiting.load() && r.writer_waiting.exchange(0)) {
+                ::eventfd_write(peer_space_fd_, 1);
+            }
+        }
+        return done;
+    }
+
+    // 完成回调总是投递到其关联的执行器上，不在发起操作的调用中执行
+    template <typename Handler>
+    void complete(Handler &&handler, const boost::system::error_code &ec,
+                  size_t n) {
+        auto ex = boost::asio::get_associated_executor(handler, executor_);
+        boost::asio::post(
+            ex, [h = std::decay_t<Handler>(std::forward<Handler>(handler)),
+                 ec, n]() mutable { h(ec, n); });
+    }
+
+    static bool send_fds(int sock, const void *data, size_t len, const int *fds,
+                         size_t n, boost::system::error_code &ec) {
+        char control[CMSG_SPACE(sizeof(int) * 5)];
+        memset(control, 0, sizeof(control));
+        iovec iov{const_cast<void *>(data), len};
+        msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * n);
+        cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * n);
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * n);
+        if (::sendmsg(sock, &msg, MSG_NOSIGNAL) != static_cast<ssize_t>(len)) {
+            ec = last_error();
+            return false;
+        }
+        return true;
+    }
+
+    static bool recv_fds(int sock, void *data, size_t len, int *fds, size_t n,
+                         boost::system::error_code &ec) {
+        char control[CMSG_SPACE(sizeof(int) * 5)];
+        iovec iov{data, len};
+        msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * n);
+        ssize_t r = ::recvmsg(sock, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+        if (r < 0) {
+            ec = errno == EAGAIN || errno == EWOULDBLOCK
+                     ? boost::system::error_code(boost::asio::error::would_block)
+                     : last_error();
+            return false;
+        }
+        cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        if (cmsg == nullptr || cmsg->cmsg_level != SOL_SOCKET ||
+            cmsg->cmsg_type != SCM_RIGHTS) {
+            ec = r == 0 ? boost::system::error_code(boost::asio::error::eof)
+                        : boost::system::error_code(
+                              boost::asio::error::invalid_argument);
+            return false;
+        }
+        size_t got = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * std::min(got, n));
+        if (got != n || static_cast<size_t>(r) != len) {
+            ec = boost::asio::error::invalid_argument;
+            close_fds(fds, std::min(got, n));
+            return false;
+        }
+        return true;
+    }
+
+    executor_type executor_;
+    char *base_ = nullptr;
+    size_t map_len_ = 0;
+    ring_header *rx_ = nullptr; // 本端读取的方向
+    ring_header *tx_ = nullptr; // 本端写入的方向
+    boost::asio::posix::stream_descriptor data_efd_;  // 可读时被唤醒
+    boost::asio::posix::stream_descriptor space_efd_; // 可写时被唤醒
+    int peer_data_fd_ = -1;                           // 唤醒对端读取
+    int peer_space_fd_ = -1;                          // 唤醒对端写入
+    bool broken_ = false; // 对端破坏了读写位置，通道不再可用
+    uint64_t data_counter_ = 0;
+    uint64_t space_counter_ = 0;
+    std::atomic<bool> peer_closed_{false};
+};
+
+/*
+* 连接所用的套接字
+ tcp和unix域套接字共用asio的通用流套接字；shm在控制连接建立后切换到共享内存通道；
+ 服务端可以改用io_uring收发。
+ 提供asio流的接口，connection和rpc_client的读写不区分传输方式。
+*/
+class rpc_socket {
+  public:
+    using socket_type = boost::asio::generic::stream_protocol::socket;
+    using executor_type = socket_type::executor_type;
+
+    explicit rpc_socket(boost::asio::io_service &ios)
+        : ios_(ios), socket_(ios) {}
+
+    executor_type get_executor() { return socket_.get_executor(); }
+
+    // 底层的套接字，用于接受和发起连接
+    socket_type &stream() { return socket_; }
+
+    bool is_open() const { return socket_.is_open(); }
+
+    template <typename MutableBufferSequence, typename Handler>
+    void async_read_some(const MutableBufferSequence &buffers,
+                         Handler &&handler) {
+        if (shm_) {
+            shm_->async_read_some(buffers, std::forward<Handler>(handler));
+#ifdef TINY_RPC_HAS_IO_URING
+        } else if (uring_) {
+            uring_->async_read_some(buffers, std::forward<Handler>(handler));
+#endif
+        } else {
+            socket_.async_read_some(buffers, std::forward<Handler>(handler));
+        }
+    }
+
+    template <typename ConstBufferSequence, typename Handler>
+    void async_write_some(const ConstBufferSequence &buffers,
+                          Handler &&handler) {
+        if (shm_) {
+            shm_->async_write_some(buffers, std::forward<Handler>(handler));
+#ifdef TINY_RPC_HAS_IO_URING
+        } else if (uring_) {
+            uring_->async_write_some(buffers, std::forward<Handler>(handler));
+#endif
+        } else {
+            socket_.async_write_some(buffers, std::forward<Handler>(handler));
+        }
+    }
+
+    // 改用所属io_context上的io_uring收发，在该io_context的线程上、开始读写前调用；
+    // 不支持时返回false，继续使用epoll
+    bool use_uring() {
+#ifdef TINY_RPC_HAS_IO_URING
+        auto &service = boost::asio::use_service<uring_service>(ios_);
+        if (!service.available() || !socket_.is_open()) {
+            return false;
+        }
+        uring_ = std::make_shared<uring_stream>(service, socket_.native_handle());
+        uring_->start();
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // 连接方：控制连接建立后创建共享内存通道
+    bool open_shm(boost::system::error_code &ec) {
+        shm_ = shm_channel::create(socket_.get_executor(),
+                                   socket_.native_handle(), ec);
+        if (!shm_) {
+            return false;
+        }
+        watch_peer();
+        return true;
+    }
+
+    // 服务端：等待连接方交来的共享内存通道，完成后调用handler(ec)；
+    // 超过timeout仍未交来时关闭连接，handler以错误调用，不完成握手的连接不会一直保留
+    template <typename Handler>
+    void async_accept_shm(std::chrono::steady_clock::duration timeout,
+                          Handler handler) {
+        auto timer = std::make_shared<boost::asio::steady_timer>(ios_, timeout);
+        auto done = std::make_shared<bool>(false);
+        // 与握手在同一个io线程上执行，done为false时连接仍由等待的handler持有
+        timer->async_wait([this, done](boost::system::error_code ec) {
+            if (!ec && !*done) {
+                close();
+            }
+        });
+        wait_shm([timer, done, handler = std::move(handler)](
+                     boost::system::error_code ec) mutable {
+            *done = true;
+            timer->cancel();
+            handler(ec);
+        });
+    }
+
+    // tcp连接的TCP_NODELAY：enable为true时关闭Nagle算法，小的请求和应答立即发出，
+    // 不等待对端的确认；其他传输方式忽略
+    void set_no_delay(bool enable) {
+        boost::system::error_code ec;
+        auto ep = socket_.local_endpoint(ec);
+        if (ec) {
+            return;
+        }
+        int family = ep.protocol().family();
+        if (family == AF_INET || family == AF_INET6) {
+            socket_.set_option(
+                boost::asio::detail::socket_option::boolean<IPPROTO_TCP,
+                                                            TCP_NODELAY>(enable),
+                ec);
+        }
+    }
+
+    // 对端的描述，用于日志
+    std::string peer_name() const {
+        boost::system::error_code ec;
+        auto ep = socket_.remote_endpoint(ec);
+        if (ec) {
+            return "unknown";
+        }
+        int family = ep.protocol().family();
+        if (family == AF_INET || family == AF_INET6) {
+            boost::asio::ip::tcp::endpoint tcp_ep;
+            memcpy(tcp_ep.data(), ep.data(), ep.size());
+            tcp_ep.resize(ep.size());
+            return tcp_ep.address().to_string() + ":" +
+                   std::to_string(tcp_ep.port());
+        }
+        return shm_ ? "shm" : "unix";
+    }
+
+    // 断开连接，等待中的读写以错误结束
+    void close() {
+        if (shm_) {
+            shm_->close();
+            shm_.reset();
+        }
+#ifdef TINY_RPC_HAS_IO_URING
+        if (uring_) {
+            uring_->close();
+            uring_.reset();
+        }
+#endif
+        boost::system::error_code ignored_ec;
+        socket_.shutdown(socket_type::shutdown_both, ignored_ec);
+        socket_.close(ignored_ec);
+    }
+
+  private:
+    // 等待控制连接上交来的共享内存和eventfd，数据未到齐时继续等待
+    template <typename Handler> void wait_shm(Handler handler) {
+        socket_.async_wait(
+            socket_type::wait_read,
+            [this, handler = std::move(handler)](
+                boost::system::error_code ec) mutable {
+                if (!ec) {
+                    shm_ = shm_channel::accept(socket_.get_executor(),
+                                               socket_.native_handle(), ec);
+                }
+                if (ec == boost::asio::error::would_block) {
+                    wait_shm(std::move(handler));
+                    return;
+                }
+                if (!ec) {
+                    watch_peer();
+                }
+                handler(ec);
+            });
+    }
+
+    // 控制连接上不再有数据，可读即表示对端关闭或进程退出
+    void watch_peer() {
+        socket_.async_wait(socket_type::wait_read,
+                           [ch = shm_](boost::system::error_code) {
+                               ch->peer_closed();
+                           });
+    }
+
+    boost::asio::io_service &ios_;
+    socket_type socket_;
+    std::shared_ptr<shm_channel> shm_;
+#ifdef TINY_RPC_HAS_IO_URING
+    std::shared_ptr<uring_stream> uring_;
+#endif
+};
+
+#endif
@@ -0,0 +1,785 @@
+#pragma once
+#ifndef TINY_RPC_URING_H_
+#define TINY_RPC_URING_H_
+
+#include <boost/asio.hpp>
+#include <cstdint>
+
+// 服务端连接的io后端
+enum class io_backend : uint8_t {
+    epoll, // asio默认的reactor
+    uring, // io_uring，内核不支持时退回epoll
+};
+
+// io_uring需要Linux 6.0以上的内核头文件(多次接收)，不满足时只有epoll后端
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#if defined(IORING_RECV_MULTISHOT)
+#define TINY_RPC_HAS_IO_URING 1
+#endif
+#endif
+
+#ifdef TINY_RPC_HAS_IO_URING
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace uring_detail {
+inline int setup(unsigned entries, io_uring_params *p) {
+    return static_cast<int>(::syscall(__NR_io_uring_setup, entries, p));
+}
+
+inline int enter(int fd, unsigned to_submit, unsigned min_complete,
+                 unsigned flags) {
+    return static_cast<int>(::syscall(__NR_io_uring_enter, fd, to_submit,
+                                      min_complete, flags, nullptr, 0));
+}
+
+inline int register_op(int fd, unsigned op, void *arg, unsigned nr) {
+    return static_cast<int>(::syscall(__NR_io_uring_register, fd, op, arg, nr));
+}
+} // namespace uring_detail
+
+/*
+* io_uring的提交队列和完成队列
+ 直接使用系统调用，不依赖liburing；只在一个线程上使用。
+*/
+class uring_ring : private boost::asio::noncopyable {
+  public:
+    uring_ring() = default;
+    ~uring_ring() { close(); }
+
+    bool open(unsigned entries, unsigned cq_entries) {
+        io_uring_params p;
+        memset(&p, 0, sizeof(p));
+        p.flags = IORING_SETUP_CQSIZE;
+        p.cq_entries = cq_entries;
+        fd_ = uring_detail::setup(entries, &p);
+        if (fd_ < 0) {
+            return false;
+        }
+        sq_len_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cq_len_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+        if (single) {
+            sq_len_ = cq_len_ = std::max(sq_len_, cq_len_);
+        }
+        sq_ptr_ = ::mmap(nullptr, sq_len_, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+        if (sq_ptr_ == MAP_FAILED) {
+            sq_ptr_ = nullptr;
+            close();
+            return false;
+        }
+        cq_ptr_ = single ? sq_ptr_
+                         : ::mmap(nullptr, cq_len_, PROT_READ | PROT_WRITE,
+                                  MAP_SHARED | MAP_POPULATE, fd_,
+                                  IORING_OFF_CQ_RING);
+        sqes_len_ = p.sq_entries * sizeof(io_uring_sqe);
+        void *sqes = ::mmap(nullptr, sqes_len_, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+        if (cq_ptr_ == MAP_FAILED || sqes == MAP_FAILED) {
+            cq_ptr_ = cq_ptr_ == MAP_FAILED ? nullptr : cq_ptr_;
+            sqes_ = sqes == MAP_FAILED ? nullptr
+                                       : static_cast<io_uring_sqe *>(sqes);
+            close();
+            return false;
+        }
+        sqes_ = static_cast<io_uring_sqe *>(sqes);
+        char *sq = static_cast<char *>(sq_ptr_);
+        char *cq = static_cast<char *>(cq_ptr_);
+        sq_head_ = reinterpret_cast<unsigned *>(sq + p.sq_off.head);
+        sq_tail_ = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+        sq_mask_ = *reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+        sq_flags_ = reinterpret_cast<unsigned *>(sq + p.sq_off.flags);
+        cq_head_ = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe *>(cq + p.cq_off.cqes);
+        sq_entries_ = p.sq_entries;
+        // 提交队列的下标数组固定为一一对应
+        unsigned *array = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+        for (unsigned i = 0; i < sq_entries_; ++i) {
+            array[i] = i;
+        }
+        sqe_tail_ = *sq_tail_;
+        return true;
+    }
+
+    void close() {
+        if (sqes_ != nullptr) {
+            ::munmap(sqes_, sqes_len_);
+            sqes_ = nullptr;
+        }
+        if (cq_ptr_ != nullptr && cq_ptr_ != sq_ptr_) {
+            ::munmap(cq_ptr_, cq_len_);
+        }
+        cq_ptr_ = nullptr;
+        if (sq_ptr_ != nullptr) {
+            ::munmap(sq_ptr_, sq_len_);
+            sq_ptr_ = nullptr;
+        }
+        if (fd_ >= 0) {
+            ::close(fd_);
+            fd_ = -1;
+        }
+    }
+
+    int fd() const { return fd_; }
+
+    // 取一个空闲的提交项，队列满时返回nullptr
+    io_uring_sqe *get_sqe() {
+        unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+        if (sqe_tail_ - head >= sq_entries_) {
+            return nullptr;
+        }
+        io_uring_sqe *sqe = &sqes_[sqe_tail_ & sq_mask_];
+        ++sqe_tail_;
+        memset(sqe, 0, sizeof(*sqe));
+        return sqe;
+    }
+
+    // 一次系统调用提交所有已填好的提交项
+    int submit(unsigned min_complete = 0) {
+        __atomic_store_n(sq_tail_, sqe_tail_, __ATOMIC_RELEASE);
+        unsigned pending = sqe_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+        unsigned flags = min_complete > 0 ? IORING_ENTER_GETEVENTS : 0;
+        if (pending == 0 && min_complete == 0) {
+            return 0;
+        }
+        return uring_detail::enter(fd_, pending, min_complete, flags);
+    }
+
+    // 依次处理所有已完成项；内核暂存了溢出的完成项时取回后继续处理。
+    // 每项先拷出并归还所在位置再回调，回调中提交时内核总能写入新的完成项
+    template <typename Function> void reap(Function &&f) {
+        for (;;) {
+            unsigned head = *cq_head_;
+            unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+            if (head == tail) {
+                if (__atomic_load_n(sq_flags_, __ATOMIC_ACQUIRE) &
+                    IORING_SQ_CQ_OVERFLOW) {
+                    uring_detail::enter(fd_, 0, 0, IORING_ENTER_GETEVENTS);
+                    if (__atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE) != head) {
+                        continue;
+                    }
+                }
+                return;
+            }
+            while (head != tail) {
+                io_uring_cqe cqe = cqes_[head & cq_mask_];
+                __atomic_store_n(cq_head_, ++head, __ATOMIC_RELEASE);
+                f(cqe);
+            }
+        }
+    }
+
+  private:
+    int fd_ = -1;
+    void *sq_ptr_ = nullptr;
+    void *cq_ptr_ = nullptr;
+    size_t sq_len_ = 0;
+    size_t cq_len_ = 0;
+    size_t sqes_len_ = 0;
+    io_uring_sqe *sqes_ = nullptr;
+    io_uring_cqe *cqes_ = nullptr;
+    unsigned *sq_head_ = nullptr;
+    unsigned *sq_tail_ = nullptr;
+    unsigned *sq_flags_ = nullptr;
+    unsigned *cq_head_ = nullptr;
+    unsigned *cq_tail_ = nullptr;
+    unsigned sq_mask_ = 0;
+    unsigned cq_mask_ = 0;
+    unsigned sq_entries_ = 0;
+    unsigned sqe_tail_ = 0; // 已填好但可能未提交的位置
+};
+
+/*
+* 提供给内核的接收缓冲区环
+ 多次接收时由内核从中挑选缓冲区写入，完成项中带回缓冲区编号，
+ 数据取走后立即归还，接收不再逐次传入地址。
+ 这是提供缓冲区环(IORING_REGISTER_PBUF_RING)，不是注册的固定缓冲区
+ (IORING_REGISTER_BUFFERS)：多次接收只能从提供缓冲区中选取，不支持固定缓冲区；
+ 发送的数据在缓冲池的sbuffer中，不在注册的区域内，改用*_FIXED操作需要多一次拷贝，
+ 因此收发都不使用固定缓冲区。
+*/
+class uring_buffers : private boost::asio::noncopyable {
+  public:
+    ~uring_buffers() { close(); }
+
+    bool open(int ring_fd, uint16_t group, unsigned count, unsigned size) {
+        ring_len_ = count * sizeof(io_uring_buf);
+        void *ring = ::mmap(nullptr, ring_len_, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ring == MAP_FAILED) {
+            return false;
+        }
+        ring_ = static_cast<io_uring_buf *>(ring);
+        io_uring_buf_reg reg;
+        memset(&reg, 0, sizeof(reg));
+        reg.ring_addr = reinterpret_cast<uint64_t>(ring_);
+        reg.ring_entries = count;
+        reg.bgid = group;
+        if (uring_detail::register_op(ring_fd, IORING_REGISTER_PBUF_RING, &reg,
+                                      1) != 0) {
+            close();
+            return false;
+        }
+        ring_fd_ = ring_fd;
+        group_ = group;
+        count_ = count;
+        size_ = size;
+        data_.resize(static_cast<size_t>(count) * size);
+        for (unsigned i = 0; i < count; ++i) {
+            recycle(static_cast<uint16_t>(i));
+        }
+        return true;
+    }
+
+    void close() {
+        if (ring_fd_ >= 0) {
+            io_uring_buf_reg reg;
+            memset(&reg, 0, sizeof(reg));
+            reg.bgid = group_;
+            uring_detail::register_op(ring_fd_, IORING_UNREGISTER_PBUF_RING,
+                                      &reg, 1);
+            ring_fd_ = -1;
+        }
+        if (ring_ != nullptr) {
+            ::munmap(ring_, ring_len_);
+            ring_ = nullptr;
+        }
+    }
+
+    uint16_t group() const { return group_; }
+
+    const char *data(uint16_t bid) const {
+        return data_.data() + static_cast<size_t>(bid) * size_;
+    }
+
+    // 把缓冲区交还内核
+    void recycle(uint16_t bid) {
+        io_uring_buf &b = ring_[tail_ & (count_ - 1)];
+        b.addr = reinterpret_cast<uint64_t>(data(bid));
+        b.len = size_;
+        b.bid = bid;
+        ++tail_;
+        // 环尾与第0项的保留字段重叠
+        __atomic_store_n(&ring_[0].resv, tail_, __ATOMIC_RELEASE);
+    }
+
+  private:
+    int ring_fd_ = -1;
+    io_uring_buf *ring_ = nullptr;
+    size_t ring_len_ = 0;
+    uint16_t group_ = 0;
+    unsigned count_ = 0;
+    unsigned size_ = 0;
+    uint16_t tail_ = 0;
+    std::vector<char> data_;
+};
+
+// 一个进行中的io_uring操作，user_data为其地址；多次接收在最后一个完成项后才释放
+struct uring_op {
+    virtual ~uring_op() = default;
+    virtual void complete(int res, uint32_t flags) = 0;
+};
+
+/*
+* 每个io_context一个io_uring实例
+ 作为asio的服务挂在io_context上，与其线程绑定，不需要加锁：
+ 环上注册一个eventfd，asio在该eventfd可读时取出所有完成项；
+ 同一轮回调中产生的提交项合并为一次io_uring_enter。
+ 计时器、strand等仍由asio的reactor处理，只有连接的收发经过io_uring。
+*/
+class uring_service : public boost::asio::execution_context::service {
+  public:
+    inline static boost::asio::execution_context::id id;
+
+    static const unsigned SQ_ENTRIES = 256;
+    static const unsigned CQ_ENTRIES = 4096;
+    static const unsigned BUFFER_COUNT = 256;  // 2的幂
+    static const unsigned BUFFER_SIZE = 16384; // 每个接收缓冲区的大小
+    static const unsigned MAX_SUBMIT_RETRIES = 8; // 取提交项时提交失败的重试次数
+
+    explicit uring_service(boost::asio::io_context &ioc)
+        : boost::asio::execution_context::service(ioc), ioc_(ioc),
+          wake_(ioc) {
+        if (!supported() || !ring_.open(SQ_ENTRIES, CQ_ENTRIES) ||
+            !buffers_.open(ring_.fd(), 0, BUFFER_COUNT, BUFFER_SIZE)) {
+            return;
+        }
+        int efd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (efd < 0) {
+            return;
+        }
+        wake_.assign(efd);
+        if (uring_detail::register_op(ring_.fd(), IORING_REGISTER_EVENTFD,
+                                      &efd, 1) != 0) {
+            return;
+        }
+        available_ = true;
+        wait();
+    }
+
+    ~uring_service() { shutdown(); }
+
+    // 内核是否支持所需的特性：提供缓冲区环和多次接收；只探测一次
+    static bool supported() {
+        static const bool ok = probe();
+        return ok;
+    }
+
+    // 本io_context上的io_uring是否可用，不可用时连接使用epoll
+    bool available() const { return available_; }
+
+    // 取一个提交项，队列满时先提交已有的。内核不接受提交时(如完成队列溢出返回-EBUSY)，
+    // 不在处理完成项的过程中则先取出完成项再重试；仍然失败时返回nullptr，
+    // 由调用方使操作以错误结束，不在io线程上无限重试
+    io_uring_sqe *get_sqe() {
+        io_uring_sqe *sqe = ring_.get_sqe();
+        for (unsigned attempt = 0; sqe == nullptr; ++attempt) {
+            int r = ring_.submit();
+            if (r < 0 && r != -EINTR) {
+                if (reaping_ || attempt >= MAX_SUBMIT_RETRIES ||
+                    (r != -EBUSY && r != -EAGAIN)) {
+                    return nullptr;
+                }
+                reap();
+            }
+            sqe = ring_.get_sqe();
+        }
+        return sqe;
+    }
+
+    // 登记操作，完成后由本服务释放
+    void track(uring_op *op) { ops_.insert(op); }
+
+    // 在本轮回调之后统一提交
+    void schedule_submit() {
+        if (submit_posted_) {
+            return;
+        }
+        submit_posted_ = true;
+        boost::asio::post(ioc_, [this] {
+            submit_posted_ = false;
+            ring_.submit();
+        });
+    }
+
+    // 立即提交，关闭描述符前调用，保证已排队的操作不会作用于复用的描述符
+    void submit_now() { ring_.submit(); }
+
+    uint16_t buffer_group() const { return buffers_.group(); }
+    const char *buffer(uint16_t bid) const { return buffers_.data(bid); }
+    void recycle(uint16_t bid) { buffers_.recycle(bid); }
+
+    boost::asio::io_context &context() { return ioc_; }
+
+  private:
+    void shutdown() override {
+        if (ring_.fd() < 0) {
+            return;
+        }
+        available_ = false;
+        boost::system::error_code ignored_ec;
+        wake_.close(ignored_ec);
+        // 先关闭环，内核不再访问操作中的地址，再释放操作
+        buffers_.close();
+        ring_.close();
+        for (auto *op : ops_) {
+            delete op;
+        }
+        ops_.clear();
+    }
+
+    // 等待eventfd，取出所有完成项后提交期间产生的提交项
+    void wait() {
+        wake_.async_read_some(
+            boost::asio::buffer(&wake_counter_, sizeof(wake_counter_)),
+            [this](boost::system::error_code ec, size_t) {
+                if (ec) {
+                    return;
+                }
+                reap();
+                ring_.submit();
+                wait();
+            });
+    }
+
+    // 取出所有完成项并完成对应的操作；期间再取提交项失败时不重入
+    void reap() {
+        reaping_ = true;
+        ring_.reap([this](const io_uring_cqe &cqe) {
+            if (cqe.user_data == 0) {
+                return; // 取消操作本身的完成项
+            }
+            auto *op = reinterpret_cast<uring_op *>(cqe.user_data);
+            op->complete(cqe.res, cqe.flags);
+            if (!(cqe.flags & IORING_CQE_F_MORE)) {
+                ops_.erase(op);
+                delete op;
+            }
+        });
+        reaping_ = false;
+    }
+
+    // 在socketpair上试一次多次接收
+    static bool probe() {
+        uring_ring ring;
+        if (!ring.open(8, 16)) {
+            return false;
+        }
+        uring_buffers buffers;
+        if (!buffers.open(ring.fd(), 0, 2, 64)) {
+            return false;
+        }
+        int sv[2];
+        if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) != 0) {
+            return false;
+        }
+        io_uring_sqe *sqe = ring.get_sqe();
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = sv[0];
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = 0;
+        sqe->user_data = 1;
+        bool ok = false;
+        if (ring.submit() == 1 && ::write(sv[1], "x", 1) == 1 &&
+            ring.submit(1) >= 0) {
+            ring.reap([&ok](const io_uring_cqe &cqe) {
+                ok = cqe.res == 1 && (cqe.flags & IORING_CQE_F_BUFFER) &&
+                     (cqe.flags & IORING_CQE_F_MORE);
+            });
+        }
+        ::close(sv[0]);
+        ::close(sv[1]);
+        buffers.close();
+        ring.close();
+        return ok;
+    }
+
+    boost::asio::io_context &ioc_;
+    uring_ring ring_;
+    uring_buffers buffers_;
+    boost::asio::posix::stream_descriptor wake_; // 注册在环上的eventfd
+    uint64_t wake_counter_ = 0;
+    std::unordered_set<uring_op *> ops_;
+    bool available_ = false;
+    bool submit_posted_ = false;
+    bool reaping_ = false; // 正在处理完成项
+};
+
+/*
+* 经io_uring收发的连接
+ 接收：一个多次接收操作持续有效，数据由内核写入提供的缓冲区，
+ 有等待中的读时直接复制给它，否则暂存，缓冲区随即归还；
+ 内核缓冲区暂时用尽而结束时重新发起。
+ 发送：每次async_write_some为一个sendmsg，聚合写的各段作为iovec一次提交。
+ 提供与套接字相同的async_read_some/async_write_some，只在所属io_context的线程上使用。
+*/
+class uring_stream : public std::enable_shared_from_this<uring_stream> {
+  public:
+    static const size_t MAX_IOV = 64; // 一次sendmsg的最大段数
+    // 暂存的未读数据超过该值时取消多次接收，读取方取完后重新发起，
+    // 读取方跟不上时由内核的套接字缓冲区和tcp窗口反压对端；
+    // 取消生效前已完成的接收还会暂存，至多为共享接收缓冲区的总大小
+    static const size_t MAX_STAGED = 1 << 20;
+
+    uring_stream(uring_service &service, int fd)
+        : service_(service), fd_(fd) {}
+
+    void start() { arm_recv(); }
+
+    template <typename MutableBufferSequence, typename Handler>
+    void async_read_some(const MutableBufferSequence &buffers,
+                         Handler &&handler) {
+        if (staged_off_ < staged_.size()) {
+            size_t n = boost::asio::buffer_copy(
+                buffers, boost::asio::buffer(staged_.data() + staged_off_,
+                                             staged_.size() - staged_off_));
+            consume_staged(n);
+            post_complete(std::forward<Handler>(handler),
+                          boost::system::error_code(), n);
+            return;
+        }
+        if (read_ec_ || closed_) {
+            post_complete(std::forward<Handler>(handler),
+                          closed_ ? boost::system::error_code(
+                                        boost::asio::error::operation_aborted)
+                                  : read_ec_,
+                          0);
+            return;
+        }
+        read_.reset(new read_op<MutableBufferSequence, std::decay_t<Handler>>(
+            *this, buffers, std::forward<Handler>(handler)));
+    }
+
+    template <typename ConstBufferSequence, typename Handler>
+    void async_write_some(const ConstBufferSequence &buffers,
+                          Handler &&handler) {
+        if (closed_) {
+            post_complete(std::forward<Handler>(handler),
+                          boost::asio::error::bad_descriptor, 0);
+            return;
+        }
+        auto *op = new send_op<std::decay_t<Handler>>(
+            *this, shared_from_this(), std::forward<Handler>(handler));
+        for (auto it = boost::asio::buffer_sequence_begin(buffers);
+             it != boost::asio::buffer_sequence_end(buffers) &&
+             op->msg.msg_iovlen < MAX_IOV;
+             ++it) {
+            boost::asio::const_buffer b(*it);
+            if (b.size() == 0) {
+                continue;
+            }
+            op->iov[op->msg.msg_iovlen].iov_base = const_cast<void *>(b.data());
+            op->iov[op->msg.msg_iovlen].iov_len = b.size();
+            ++op->msg.msg_iovlen;
+        }
+        if (op->msg.msg_iovlen == 0) {
+            op->complete(0, 0);
+            delete op;
+            return;
+        }
+        io_uring_sqe *sqe = service_.get_sqe();
+        if (sqe == nullptr) {
+            op->complete(-EBUSY, 0);
+            delete op;
+            return;
+        }
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = fd_;
+        sqe->addr = reinterpret_cast<uint64_t>(&op->msg);
+        sqe->len = 1;
+        sqe->msg_flags = MSG_NOSIGNAL;
+        sqe->user_data = reinterpret_cast<uint64_t>(op);
+        service_.track(op);
+        service_.schedule_submit();
+    }
+
+    // 取消接收并提交所有已排队的操作，之后才能关闭描述符
+    void close() {
+        if (closed_) {
+            return;
+        }
+        closed_ = true;
+        if (recv_op_ != nullptr) {
+            io_uring_sqe *sqe = service_.get_sqe();
+            if (sqe != nullptr) {
+                sqe->opcode = IORING_OP_ASYNC_CANCEL;
+                sqe->addr = reinterpret_cast<uint64_t>(recv_op_);
+                sqe->user_data = 0;
+            } else {
+                // 无法提交取消时关闭读写，多次接收随之以0结束
+                ::shutdown(fd_, SHUT_RDWR);
+            }
+        }
+        service_.submit_now();
+        finish_read(boost::asio::error::operation_aborted, 0);
+    }
+
+  private:
+    struct pending_read {
+        virtual ~pending_read() = default;
+        virtual size_t fill(const char *data, size_t size) = 0;
+        virtual void complete(const boost::system::error_code &ec,
+                              size_t n) = 0;
+    };
+
+    template <typename MutableBufferSequence, typename Handler>
+    struct read_op : pending_read {
+        read_op(uring_stream &s, const MutableBufferSequence &b, Handler &&h)
+            : stream(s), buffers(b), handler(std::move(h)) {}
+        size_t fill(const char *data, size_t size) override {
+            return boost::asio::buffer_copy(buffers,
+                                            boost::asio::buffer(data, size));
+        }
+        void complete(const boost::system::error_code &ec,
+                      size_t n) override {
+            stream.post_complete(std::move(handler), ec, n);
+        }
+        uring_stream &stream;
+        MutableBufferSequence buffers;
+        Handler handler;
+    };
+
+    template <typename Handler> struct send_op : uring_op {
+        send_op(uring_stream &s, std::shared_ptr<uring_stream> o, Handler &&h)
+            : stream(s), owner(std::move(o)), handler(std::move(h)) {
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = iov;
+        }
+        void complete(int res, uint32_t) override {
+            if (res < 0) {
+                stream.post_complete(
+                    std::move(handler),
+                    boost::system::error_code(
+                        -res, boost::asio::error::get_system_category()),
+                    0);
+            } else {
+                stream.post_complete(std::move(handler),
+                                     boost::system::error_code(),
+                                     static_cast<size_t>(res));
+            }
+        }
+        uring_stream &stream;
+        std::shared_ptr<uring_stream> owner; // 完成前保持存活
+        Handler handler;
+        msghdr msg;
+        iovec iov[MAX_IOV];
+    };
+
+    struct recv_op : uring_op {
+        explicit recv_op(std::shared_ptr<uring_stream> s) : owner(std::move(s)) {}
+        void complete(int res, uint32_t flags) override {
+            owner->on_recv(res, flags);
+        }
+        std::shared_ptr<uring_stream> owner;
+    };
+
+    void arm_recv() {
+        io_uring_sqe *sqe = service_.get_sqe();
+        if (sqe == nullptr) {
+            // 无法重新发起接收，等待中的读以错误结束，连接随之关闭
+            read_ec_ = boost::system::error_code(
+                EBUSY, boost::asio::error::get_system_category());
+            if (staged_off_ == staged_.size()) {
+                finish_read(read_ec_, 0);
+            }
+            return;
+        }
+        recv_op_ = new recv_op(shared_from_this());
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = fd_;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = service_.buffer_group();
+        sqe->user_data = reinterpret_cast<uint64_t>(recv_op_);
+        service_.track(recv_op_);
+        service_.schedule_submit();
+    }
+
+    void on_recv(int res, uint32_t flags) {
+        if (res > 0 && (flags & IORING_CQE_F_BUFFER)) {
+            auto bid = static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT);
+            const char *data = service_.buffer(bid);
+            size_t n = static_cast<size_t>(res);
+            size_t used = 0;
+            if (!closed_) {
+                if (read_ && staged_off_ == staged_.size()) {
+                    used = read_->fill(data, n);
+                }
+                staged_.insert(staged_.end(), data + used, data + n);
+            }
+            service_.recycle(bid);
+            if (staged_.size() - staged_off_ >= MAX_STAGED) {
+                pause_recv();
+            }
+            if (used > 0) {
+                finish_read(boost::system::error_code(), used);
+            }
+        } else if (res == 0) {
+            read_ec_ = boost::asio::error::eof;
+        } else if (res == -ECANCELED) {
+            // 暂停接收时的取消不是错误
+            if (!cancelling_) {
+                read_ec_ = boost::asio::error::operation_aborted;
+            }
+        } else if (res < 0 && res != -ENOBUFS) {
+            read_ec_ = boost::system::error_code(
+                -res, boost::asio::error::get_system_category());
+        }
+        if (!(flags & IORING_CQE_F_MORE)) {
+            recv_op_ = nullptr;
+            cancelling_ = false;
+            // 内核缓冲区暂时用尽时结束，本轮归还后重新发起；
+            // 暂停时等读取方取完暂存的数据
+            if (!closed_ && !read_ec_ && !paused_) {
+                arm_recv();
+            }
+        }
+        if (read_ec_ && staged_off_ == staged_.size()) {
+            finish_read(read_ec_, 0);
+        }
+    }
+
+    void consume_staged(size_t n) {
+        staged_off_ += n;
+        if (staged_off_ == staged_.size()) {
+            staged_.clear();
+            staged_off_ = 0;
+            resume_recv();
+        }
+    }
+
+    // 取消进行中的多次接收，其最后一个完成项到达前收到的数据仍然暂存
+    void pause_recv() {
+        paused_ = true;
+        if (recv_op_ == nullptr || cancelling_) {
+            return;
+        }
+        io_uring_sqe *sqe = service_.get_sqe();
+        if (sqe == nullptr) {
+            return; // 接收继续进行，下一次超过上限时再取消
+        }
+        cancelling_ = true;
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = reinterpret_cast<uint64_t>(recv_op_);
+        sqe->user_data = 0;
+        // 立即提交，否则在本轮完成项处理完之前多次接收会继续产生数据
+        service_.submit_now();
+    }
+
+    // 暂存的数据已取完，取消尚未结束时由其最后一个完成项重新发起
+    void resume_recv() {
+        if (!paused_) {
+            return;
+        }
+        paused_ = false;
+        if (recv_op_ == nullptr && !closed_ && !read_ec_) {
+            arm_recv();
+        }
+    }
+
+    void finish_read(const boost::system::error_code &ec, size_t n) {
+        if (read_) {
+            auto op = std::move(read_);
+            op->complete(ec, n);
+        }
+    }
+
+    // 完成回调投递到其关联的执行器上，不在发起操作的调用中执行
+    template <typename Handler>
+    void post_complete(Handler &&handler, const boost::system::error_code &ec,
+                       size_t n) {
+        auto ex = boost::asio::get_associated_executor(
+            handler, service_.context().get_executor());
+        boost::asio::post(
+            ex, [h = std::decay_t<Handler>(std::forward<Handler>(handler)), ec,
+                 n]() mutable { h(ec, n); });
+    }
+
+    uring_service &service_;
+    int fd_;
+    std::unique_ptr<pending_read> read_; // 等待中的读，同时最多一个
+    std::vector<char> staged_;           // 没有等待中的读时收到的数据
+    size_t staged_off_ = 0;
+    boost::system::error_code read_ec_; // 接收结束的原因
+    recv_op *recv_op_ = nullptr;        // 进行中的多次接收
+    bool paused_ = false;     // 暂存的数据过多，暂停接收
+    bool cancelling_ = false; // 已提交对recv_op_的取消
+    bool closed_ = false;
+};
+#endif // TINY_RPC_HAS_IO_URING
+
+#endif